@@ -1,717 +1,1130 @@
-#include <iostream>
-#include <vector>
-#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef BLACKJACK_HAVE_SERVER
+#include <csignal>
+#include <sys/resource.h>
+#endif
+
+#include "dealer_odds.h"
+#include "game.h"
+#include "history.h"
+#include "house_edge.h"
+#include "metrics.h"
+#ifdef BLACKJACK_HAVE_SERVER
+#include "server.h"
+#endif
+#include "session.h"
+#ifdef BLACKJACK_HAVE_SHARD_RUNNER
+#include "shard_runner.h"
+#endif
+#include "simulator.h"
+#include "strategy.h"
 
 using namespace std;
 
-// classes for error exceptions.
-struct BadSuit
+// Print the results of a simulation.
+void printResult(const SimulationResult &res, double seconds)
 {
-};
-struct BadNumberDecks
+    static const char *names[N_OUTCOME] = {
+        "player bust", "player quit", "player blackjack",
+        "blackjack tie", "dealer bust", "dealer win", "player win",
+        "dealer blackjack", "push", "player surrender"};
+    cout << "Rounds: " << res.rounds << endl;
+    for (int i = 0; i < N_OUTCOME; i++)
+        if (i != PLAYER_QUIT && (i != PLAYER_SURRENDER || res.outcomes[i]))
+            cout << "  " << names[i] << ": " << res.outcomes[i] << endl;
+    cout << "Net chips: " << res.netChips() << endl;
+    cout << "EV per round: " << res.ev() << " +- " << res.margin()
+         << " (95%), standard deviation " << sqrt(res.variance()) << endl;
+    cout << "Elapsed: " << seconds << " s ("
+         << (seconds > 0 ? res.rounds / seconds : 0.0)
+         << " rounds/s)" << endl;
+}
+
+// Print the results of policies compared on the same cards: the EV of
+// every policy, and the difference of every other policy with the first
+// one, with the factor of rounds independent runs would need for the same
+// precision.
+void printComparison(const vector<string> &policies,
+                     const vector<SimulationResult> &results,
+                     const vector<PairedResult> &diffs, double seconds)
 {
-};
+    cout << "Rounds: " << results[0].rounds << " per policy" << endl;
+    for (size_t k = 0; k < policies.size(); k++)
+        cout << "Policy " << policies[k] << ": EV per round "
+             << results[k].ev() << " +- " << results[k].margin()
+             << " (95%)" << endl;
+    for (size_t k = 1; k < policies.size(); k++)
+    {
+        const PairedResult &diff = diffs[k];
+        cout << policies[k] << " - " << policies[0] << ": " << diff.ev()
+             << " +- " << diff.margin() << " (95%)";
+        if (diff.variance() > 0)
+            cout << ", independent runs would need "
+                 << (results[0].variance() + results[k].variance()) /
+                        diff.variance()
+                 << " times the rounds";
+        cout << endl;
+    }
+    cout << "Elapsed: " << seconds << " s" << endl;
+}
 
-// Some global constants.
-const int PLAYER_CHIP = 100;   // Initial number of player's chips.
-const int DEALER_CHIP = 10000; // Initial number of dealer's chips.
-const int MAX_BET = 5;         // Maximum number of chips for a bet in a round.
-const int MAX_CHARACTER = 100; // Maximum number of characters in a line
-// to be used for standard input.
+// Print the share of hands won, pushed and lost out of counts by
+// outcome, under a label.
+void printShares(const string &label, const long long counts[N_OUTCOME])
+{
+    long long won = counts[PLAYER_BLACKJACK] + counts[DEALER_BUST] +
+                    counts[PLAYER_WIN];
+    long long pushed = counts[BLACKJACK_TIE] + counts[PUSH];
+    long long hands = 0;
+    for (int i = 0; i < N_OUTCOME; i++)
+        hands += counts[i];
+    if (hands == 0)
+        return;
+    cout << label << '\t' << hands << '\t' << 100.0 * won / hands << '\t'
+         << 100.0 * pushed / hands << '\t'
+         << 100.0 * (hands - won - pushed) / hands << endl;
+}
 
-// Class that represents a card. It needs a value (rank) and a suit.
-class Card
+// Print the hands won, pushed and lost by dealer's face-up card and by
+// final value of the player.
+void printBreakdown(const SimulationResult &res)
 {
-public:
-    // Constructor.
-    // num should be in the range of 1<= num <=13
-    // (1: Ace, 11:J, 12:Q, 13:K),
-    // suits: 'c' (club), 's' (spade), 'h' (heart), 'd' (diamond).
-    Card(int num1 = 1, char suit1 = 's')
-    {
-        // Assigning the rank of the card using a number.
-        if (num1 < 1)
-            num = 1;
-        else if (num1 > 13)
-            num = 13;
-        else
-            num = num1;
-        // Assigning the suit of the card.
-        if (suit1 == 'c' || suit1 == 'C')
-            suit = 'c';
-        else if (suit1 == 's' || suit1 == 'S')
-            suit = 's';
-        else if (suit1 == 'h' || suit1 == 'H')
-            suit = 'h';
-        else if (suit1 == 'd' || suit1 == 'D')
-            suit = 'd';
-        else
-            throw BadSuit(); // Error exception for bad input.
-    }
-
-    // Get the value of the card (1~13).
-    int getValue() const
-    {
-        return num;
-    }
-
-    // Get the rank of the card (A, 2,..., 10, J, Q, K) as strings.
-    string getRank() const
-    {
-        if (num == 1)
-            return "A";
-        else if (num == 2)
-            return "2";
-        else if (num == 3)
-            return "3";
-        else if (num == 4)
-            return "4";
-        else if (num == 5)
-            return "5";
-        else if (num == 6)
-            return "6";
-        else if (num == 7)
-            return "7";
-        else if (num == 8)
-            return "8";
-        else if (num == 9)
-            return "9";
-        else if (num == 10)
-            return "10";
-        else if (num == 11)
-            return "J";
-        else if (num == 12)
-            return "Q";
-        else if (num == 13)
-            return "K";
-    }
-
-    // Get the suit of the given card.
-    char getSuit() const
-    {
-        return suit;
-    }
-
-private:
-    int num;   // The value (rank) of the card.
-    char suit; // The suit of the card (c, s, h, d).
-};
-
-// outstream operator overloading for the Card class.
-ostream &operator<<(ostream &s, const Card &c)
+    cout << "up\thands\twin%\tpush%\tloss%" << endl;
+    for (int up = 1; up <= N_POINTS; up++)
+        printShares(up == 1 ? "A" : RANK_NAMES[up], res.byUpCard[up]);
+    cout << "total\thands\twin%\tpush%\tloss%" << endl;
+    for (int t = 2; t <= MAX_TOTAL; t++)
+        printShares(t == MAX_TOTAL ? "bust" : to_string(t), res.byTotal[t]);
+}
+
+// Open a hand history for appending, unless file is empty.
+// Returns false (with a message) if it cannot be opened.
+bool openHistory(const string &file, unique_ptr<HistoryWriter> &history)
 {
-    return s << c.getRank() << "(" << c.getSuit() << ')';
+    if (file.empty())
+        return true;
+    history.reset(new HistoryWriter(file));
+    if (history->good())
+        return true;
+    cerr << "*** Cannot open " << file << "\n";
+    return false;
 }
 
-// Class that represents the decks of cards for the game of blackjack.
-// Number of decks allowed here are 1, 2, and 4.
-class Decks
+// Start writing the metrics (see metrics.h) to file every interval
+// seconds, unless file is empty. Returns false (with a message) if the
+// instrumentation is not built in.
+bool openMetrics(const string &file, double interval,
+                 unique_ptr<MetricsExporter> &exporter)
 {
-public:
-    // Constructor. The number of decks should be given (default=1).
-    Decks(int nDeck = 1) : cards(), current(0)
+    if (file.empty())
+        return true;
+    if (!Metrics::enabled())
     {
-        create(nDeck); // create all cards.
+        cerr << "*** Metrics need a build with BLACKJACK_METRICS on.\n";
+        return false;
     }
+    exporter.reset(new MetricsExporter(file, interval > 0 ? interval : 10));
+    return true;
+}
+
+// Read the rules from file into rules, unless file is empty.
+// Returns false (with a message) on errors.
+bool readRules(const string &file, RuleConfig &rules)
+{
+    if (file.empty())
+        return true;
+    ifstream in(file.c_str());
+    string error;
+    if (!in)
+        error = "cannot open the file";
+    else if (rules.read(in, error))
+        return true;
+    cerr << "*** Bad rules " << file << ": " << error << "\n";
+    return false;
+}
 
-    // Create all cards of given number of decks.
-    void create(int nDeck)
+// Play the rounds of a simulation with the specialized engine for the
+// rules, or with the runtime-flag engine.
+template <class Policy>
+SimulationResult runPolicy(const Simulator &sim, const RuleConfig &rules,
+                           bool dynamicRules, long long nRound,
+                           const Policy &policy, HistoryWriter *history)
+{
+    if (dynamicRules)
+        return sim.run(nRound, policy, history, rules);
+    return runWithRules(sim, rules, nRound, policy, history);
+}
+
+// Play the rounds of a table with the specialized engine for the rules,
+// or with the runtime-flag engine.
+vector<SimulationResult> runSeats(const Simulator &sim,
+                                  const RuleConfig &rules, bool dynamicRules,
+                                  long long nRound,
+                                  const vector<PolicyRef> &policies)
+{
+    if (dynamicRules)
+        return sim.runTable(nRound, policies, rules);
+    return runTableWithRules(sim, rules, nRound, policies);
+}
+
+// Compare policies on the same cards with the specialized engine for the
+// rules, or with the runtime-flag engine.
+Comparison runComparison(const Simulator &sim, const RuleConfig &rules,
+                         bool dynamicRules, long long nRound,
+                         const vector<PolicyRef> &policies)
+{
+    if (dynamicRules)
+        return sim.runCompare(nRound, policies, rules);
+    return runCompareWithRules(sim, rules, nRound, policies);
+}
+
+// Split a comma-separated list.
+vector<string> splitList(const string &list)
+{
+    vector<string> items;
+    size_t begin = 0, comma;
+    while ((comma = list.find(',', begin)) != string::npos)
     {
-        if (nDeck != 1 && nDeck != 2 && nDeck != 4)
-            throw BadNumberDecks();
-        cards.resize(nDeck * 52); // size of the array resized.
-        int index = 0;
-        for (int i = 0; i < nDeck; i++)
-            // Creating and storing cards for nDeck decks.
-            for (int n = 1; n <= 13; n++)
-            {
-                cards[index++] = Card(n, 'c');
-                cards[index++] = Card(n, 's');
-                cards[index++] = Card(n, 'h');
-                cards[index++] = Card(n, 'd');
-            }
+        items.push_back(list.substr(begin, comma - begin));
+        begin = comma + 1;
     }
+    items.push_back(list.substr(begin));
+    return items;
+}
 
-    // Randomly shuffle all cards in the deck and set current as 0.
-    void shuffle()
+// Print the shoe, the workers, the seed and the policy of a run.
+void printSettings(const ShardResult &run, const string &workers)
+{
+    cout << run.shoe.nDeck << " deck(s), ";
+    if (run.shoe.continuous)
+        cout << "continuous shuffling, ";
+    else
+        cout << "penetration " << run.shoe.penetration << ", ";
+    cout << workers << ", seed " << run.seed << ", policy " << run.policy;
+}
+
+// Print the results of a run (or of shards of a run merged): of a single
+// seat, of every seat and all seats together, or of the policies
+// compared.
+void printRun(const ShardResult &run, bool breakdown)
+{
+    vector<string> policies = splitList(run.policy);
+    if (!run.diffs.empty())
     {
-        // using the standard library.
-        random_shuffle(cards.begin(), cards.end());
-        current = 0;
+        printComparison(policies, run.results, run.diffs, run.seconds);
+        return;
     }
-
-    // Deal a card that are pointed by current and add 1 to current.
-    Card deal()
+    SimulationResult total;
+    for (size_t s = 0; s < run.results.size(); s++)
+        total.add(run.results[s]);
+    if (run.results.size() > 1)
     {
-        // If all cards are dealt, shuffle cards again.
-        if (current == cards.size())
-            shuffle();
-        return cards[current++];
+        for (size_t s = 0; s < run.results.size(); s++)
+            cout << "Seat " << s + 1 << " ("
+                 << policies[s % policies.size()] << "): EV per round "
+                 << run.results[s].ev() << endl;
+        cout << "All seats:" << endl;
     }
+    printResult(total, run.seconds);
+    if (breakdown)
+        printBreakdown(total);
+}
 
-    // Print all cards at the current shuffled state.
-    void print() const
+// Read result files of shards of a run and merge them into merged.
+// Returns false (with a message) if a file cannot be read, or holds
+// another run or blocks already merged.
+bool mergeShards(const vector<string> &files, ShardResult &merged)
+{
+    for (size_t i = 0; i < files.size(); i++)
     {
-        for (int i = 0; i < cards.size(); i++)
-            cout << cards[i] << endl;
+        ShardResult part;
+        if (!part.load(files[i]))
+        {
+            cerr << "*** Bad result file: " << files[i] << "\n";
+            return false;
+        }
+        if (i == 0)
+            merged = part;
+        else if (!merged.add(part))
+        {
+            cerr << "*** " << files[i] << " holds another run, or blocks "
+                 << "already merged\n";
+            return false;
+        }
     }
+    return true;
+}
 
-private:
-    vector<Card> cards; // Array for all cards.
-    int current;        // The pointer for the current card.
-};
-
-// Class that represents a hand of a player or a dealer.
-class Hand
+#ifdef BLACKJACK_HAVE_SHARD_RUNNER
+// Play a simulation (see simulate()) as nProcess processes, the i-th
+// playing the i-th shard with nThread threads (0: its share of the cpus)
+// and writing its result to resultFile.i, then merge the results into
+// resultFile and print them. With numa, the processes are pinned to the
+// NUMA nodes in turn, each using the cpus of its node.
+int simulateShards(int argc, char *argv[], int nProcess, int nThread,
+                   bool numa, const string &resultFile, bool breakdown)
 {
-public:
-    // Constructor.
-    Hand() : cardsAtHand() {}
+    vector<vector<int> > nodes;
+    if (numa)
+    {
+        nodes = numaNodes();
+        if (nodes.empty())
+            cerr << "*** No NUMA node found: the processes are not "
+                 << "pinned\n";
+    }
+    // The arguments of the processes: the ones of this run, but the
+    // options of the processes.
+    vector<string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        string opt = argv[i];
+        if (opt == "--shards" || opt == "--result" || opt == "--threads")
+            i++;
+        else if (opt != "--numa")
+            args.push_back(opt);
+    }
+    int nCpu = thread::hardware_concurrency();
+    vector<ShardProcess> processes(nProcess);
+    vector<string> files;
+    for (int i = 0; i < nProcess; i++)
+    {
+        ShardProcess &process = processes[i];
+        if (!nodes.empty())
+            process.cpus = nodes[i % nodes.size()];
+        int threads = nThread;
+        if (threads <= 0 && !process.cpus.empty())
+            threads = process.cpus.size();
+        else if (threads <= 0)
+            threads = max(1, nCpu / nProcess);
+        files.push_back(resultFile + "." + to_string(i));
+        process.args = args;
+        process.args.push_back("--shard");
+        process.args.push_back(to_string(i) + "/" + to_string(nProcess));
+        process.args.push_back("--threads");
+        process.args.push_back(to_string(threads));
+        process.args.push_back("--result");
+        process.args.push_back(files.back());
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    int nFailed = runShardProcesses(processes);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    if (nFailed > 0)
+    {
+        cerr << "*** " << nFailed << " shard process(es) failed\n";
+        return 1;
+    }
+    ShardResult run;
+    if (!mergeShards(files, run))
+        return 1;
+    run.seconds = elapsed.count();
+    if (!run.save(resultFile))
+    {
+        cerr << "*** Cannot write " << resultFile << "\n";
+        return 1;
+    }
+    string workers = to_string(nProcess) + " process(es)";
+    if (!nodes.empty())
+        workers += " on " + to_string(min<size_t>(nodes.size(), nProcess)) +
+                   " NUMA node(s)";
+    printSettings(run, workers);
+    cout << endl;
+    cout << "Rules: " << run.rules << endl;
+    printRun(run, breakdown);
+    return 0;
+}
+#endif
 
-    // Add a card to the hand.
-    void addCard(Card card)
+// Run the headless simulation from the command line arguments:
+// --simulate ROUNDS [--decks N] [--penetration F] [--csm]
+//            [--threads N] [--seed N]
+//            [--policy dealer|safe|basic|composition[,...]] [--seats N]
+//            [--history FILE] [--rules FILE [--dynamic-rules]]
+//            [--checkpoint FILE [--checkpoint-every S]]
+//            [--precision E] [--breakdown] [--compare]
+//            [--shard I/N | --shards N [--numa]] [--result FILE]
+// (basic and composition use the strategies generated for the decks;
+// with --seats, N seats (1~7) share every shoe, playing with the listed
+// policies in turn; with --history, every round of a single seat is
+// appended to FILE, see history.h; --rules reads the rules from FILE, see
+// RuleConfig, and plays them with the engine specialized for them, or
+// with the runtime-flag engine if --dynamic-rules is given; with
+// --checkpoint, the state of a single seat's run is saved to FILE every
+// S seconds (60 by default), and an interrupted run started again with
+// the same arguments resumes from it; with --precision, a single seat's
+// run stops as soon as the 95% confidence interval of the EV is within
+// +-E chips, ROUNDS being the most rounds played; --breakdown prints the
+// results by face-up card and by final value; with --compare, the listed
+// policies play the same cards, and the differences of their EVs with the
+// first one are printed, see Simulator::runCompare(); with --shard, only
+// the I-th of N shards of the blocks of the run is played, see
+// Simulator::setShard(); with --shards, the N shards are played by as many
+// processes, see simulateShards(); --result writes the result to FILE,
+// see ShardResult).
+int simulate(int argc, char *argv[])
+{
+    long long nRound = argc > 2 ? atoll(argv[2]) : -1;
+    ShoeConfig shoe;
+    int nThread = 0;
+    uint64_t seed = 0;
+    string policy = "dealer", historyFile, rulesFile, checkpointFile;
+    string resultFile;
+    double checkpointEvery = 60, precision = 0;
+    int nSeat = 1, shardIndex = 0, nShard = 1, nProcess = 0;
+    bool dynamicRules = false, breakdown = false, compare = false;
+    bool numa = false;
+    bool ok = nRound >= 0;
+    for (int i = 3; ok && i < argc; i++)
     {
-        cardsAtHand.push_back(card);
+        string opt = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (opt == "--csm")
+            shoe.continuous = true;
+        else if (opt == "--decks" && hasValue)
+            shoe.nDeck = atoi(argv[++i]);
+        else if (opt == "--penetration" && hasValue)
+            shoe.penetration = atof(argv[++i]);
+        else if (opt == "--threads" && hasValue)
+            nThread = atoi(argv[++i]);
+        else if (opt == "--seed" && hasValue)
+            seed = strtoull(argv[++i], 0, 10);
+        else if (opt == "--policy" && hasValue)
+            policy = argv[++i];
+        else if (opt == "--seats" && hasValue)
+            nSeat = atoi(argv[++i]);
+        else if (opt == "--history" && hasValue)
+            historyFile = argv[++i];
+        else if (opt == "--rules" && hasValue)
+            rulesFile = argv[++i];
+        else if (opt == "--dynamic-rules")
+            dynamicRules = true;
+        else if (opt == "--checkpoint" && hasValue)
+            checkpointFile = argv[++i];
+        else if (opt == "--checkpoint-every" && hasValue)
+            checkpointEvery = atof(argv[++i]);
+        else if (opt == "--precision" && hasValue)
+            precision = atof(argv[++i]);
+        else if (opt == "--breakdown")
+            breakdown = true;
+        else if (opt == "--compare")
+            compare = true;
+        else if (opt == "--shard" && hasValue)
+            ok = sscanf(argv[++i], "%d/%d", &shardIndex, &nShard) == 2;
+        else if (opt == "--shards" && hasValue)
+            nProcess = atoi(argv[++i]);
+        else if (opt == "--numa")
+            numa = true;
+        else if (opt == "--result" && hasValue)
+            resultFile = argv[++i];
+        else
+            ok = false;
     }
+    vector<string> policies = splitList(policy);
+    for (size_t i = 0; i < policies.size(); i++)
+        ok = ok && (policies[i] == "dealer" || policies[i] == "safe" ||
+                    policies[i] == "basic" || policies[i] == "composition");
+    bool atTable = !compare && (nSeat > 1 || policies.size() > 1);
+    int nSingle = !historyFile.empty() + !checkpointFile.empty() +
+                  (precision > 0);
+    if (!ok || nSeat < 1 || nSeat > 7 || (atTable && nSingle > 0) ||
+        nSingle > 1 || !(checkpointEvery > 0) || precision < 0 ||
+        (compare && (policies.size() < 2 || nSeat > 1 || nSingle > 0)) ||
+        nShard < 1 || shardIndex < 0 || shardIndex >= nShard ||
+        ((nShard > 1 || !resultFile.empty()) && precision > 0) ||
+        (nProcess != 0 && (nProcess < 1 || nShard > 1 || nSingle > 0 ||
+                           resultFile.empty())) ||
+        (numa && nProcess == 0))
+    {
+        cerr << "usage: " << argv[0] << " --simulate ROUNDS [--decks N] "
+             << "[--penetration F] [--csm] [--threads N] [--seed N] "
+             << "[--policy dealer|safe|basic|composition[,...]] "
+             << "[--seats N] [--history FILE] "
+             << "[--rules FILE [--dynamic-rules]] "
+             << "[--checkpoint FILE [--checkpoint-every S]] "
+             << "[--precision E] [--breakdown] [--compare] "
+             << "[--shard I/N | --shards N [--numa]] [--result FILE]\n"
+             << "(--seats: 1~7; one of --history, --checkpoint and "
+             << "--precision, only with one seat; --compare: 2 or more "
+             << "policies, alone; --shard: 0 <= I < N; --shards: with "
+             << "--result, without --history, --checkpoint and "
+             << "--precision)\n";
+        return 1;
+    }
+#ifdef BLACKJACK_HAVE_SHARD_RUNNER
+    if (nProcess > 0)
+        return simulateShards(argc, argv, nProcess, nThread, numa,
+                              resultFile, breakdown);
+#else
+    if (nProcess > 0)
+    {
+        cerr << "*** Shard processes are not supported on this system\n";
+        return 1;
+    }
+#endif
+    RuleConfig rules;
+    if (!readRules(rulesFile, rules))
+        return 1;
+    unique_ptr<HistoryWriter> history;
+    if (!openHistory(historyFile, history))
+        return 1;
 
-    // Compute the value of the hand for the blackjack using S17.
-    // This function will be used to determine whether the dealer
-    // should hit or stand (S17 rule is used here), and to find out
-    // the value of the player's hand,
-    // for example,  after the player decides to stand.
-    int getValue() const
+    Simulator sim(shoe, nThread, seed);
+    sim.setShard(shardIndex, nShard);
+    if (!checkpointFile.empty())
+        sim.setCheckpoint(checkpointFile,
+                          "policy " + policy + ", " + rules.describe(),
+                          checkpointEvery);
+    sim.setPrecision(precision);
+    StrategyTable table;
+    CompositionStrategy cd;
+    bool basic = false, composition = false;
+    for (size_t i = 0; i < policies.size(); i++)
+    {
+        basic = basic || policies[i] == "basic";
+        composition = composition || policies[i] == "composition";
+    }
+    if (basic || composition)
+        StrategyGenerator(shoe.nDeck, nThread, rules)
+            .generate(table, composition ? &cd : 0);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    SimulationResult res;
+    vector<SimulationResult> seats;
+    Comparison comparison;
+    if (atTable || compare)
     {
-        int value = 0;
-        // true if an ace exists in the hand.
-        bool ifAce = false;
-        for (int i = 0; i < cardsAtHand.size(); i++)
+        // The seats play the listed policies in turn.
+        MimicDealerPolicy dealer;
+        NeverBustPolicy safe;
+        vector<PolicyRef> refs;
+        for (int s = 0; s < nSeat || s < (int)policies.size(); s++)
         {
-            int cardValue = cardsAtHand[i].getValue();
-            // Give 10 for all face cards (J, Q, K).
-            if (cardValue > 10)
-                cardValue = 10;
-            if (cardValue == 1)
-                ifAce = true;
-            value += cardValue;
+            const string &p = policies[s % policies.size()];
+            if (p == "safe")
+                refs.push_back(PolicyRef(safe));
+            else if (p == "basic")
+                refs.push_back(PolicyRef(table));
+            else if (p == "composition")
+                refs.push_back(PolicyRef(cd));
+            else
+                refs.push_back(PolicyRef(dealer));
         }
-        // Ace is always counted as 11 if doing so dose not
-        // make the hand bust (S17 rule for dealer's hand).
-        if (ifAce && value < 12)
-            value += 10;
-        return value;
+        if (compare)
+            comparison =
+                runComparison(sim, rules, dynamicRules, nRound, refs);
+        else
+            seats = runSeats(sim, rules, dynamicRules, nRound, refs);
     }
-
-    // Return the number of cards of the hand.
-    int size() const
+    else if (policy == "safe")
+        res = runPolicy(sim, rules, dynamicRules, nRound, NeverBustPolicy(),
+                        history.get());
+    else if (policy == "basic")
+        res = runPolicy(sim, rules, dynamicRules, nRound, table,
+                        history.get());
+    else if (policy == "composition")
+        res = runPolicy(sim, rules, dynamicRules, nRound, cd, history.get());
+    else
+        res = runPolicy(sim, rules, dynamicRules, nRound,
+                        MimicDealerPolicy(), history.get());
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    ShardResult run;
+    run.policy = policy;
+    run.rules = rules.describe();
+    run.seed = seed;
+    run.nRound = nRound;
+    run.nBlock = (nRound + Simulator::BLOCK_ROUNDS - 1) /
+                 Simulator::BLOCK_ROUNDS;
+    run.shoe = shoe;
+    run.seconds = elapsed.count();
+    long long first, last;
+    sim.shardBlocks(nRound, first, last);
+    if (first < last)
+        run.blocks.push_back(make_pair(first, last));
+    if (compare)
+    {
+        run.results = comparison.results;
+        run.diffs = comparison.diffs;
+    }
+    else if (atTable)
+        run.results = seats;
+    else
+        run.results.push_back(res);
+    printSettings(run, to_string(sim.threads()) + " thread(s)");
+    if (nShard > 1)
+        cout << ", shard " << shardIndex << "/" << nShard;
+    cout << endl;
+    cout << "Rules: " << run.rules
+         << (dynamicRules ? " (runtime flags)" : "") << endl;
+    printRun(run, breakdown);
+    if (!resultFile.empty() && !run.save(resultFile))
     {
-        return cardsAtHand.size();
+        cerr << "*** Cannot write " << resultFile << "\n";
+        return 1;
     }
+    return history && !history->good() ? 1 : 0;
+}
 
-    // Returns true if the hand is "blackjack"
-    // (getting the value 21 with 2 cards).
-    bool blackjack() const
+// Merge result files of shards of a run (see ShardResult), and print the
+// result: --merge FILE... [--out FILE] [--breakdown]
+// (with --out, the merged result is written to FILE; the blocks merged
+// are shown, so that a missing shard is noticed).
+int mergeResults(int argc, char *argv[])
+{
+    vector<string> files;
+    string outFile;
+    bool breakdown = false, ok = true;
+    for (int i = 2; i < argc; i++)
+    {
+        string opt = argv[i];
+        if (opt == "--out" && i + 1 < argc)
+            outFile = argv[++i];
+        else if (opt == "--breakdown")
+            breakdown = true;
+        else if (opt.compare(0, 2, "--") == 0)
+            ok = false;
+        else
+            files.push_back(opt);
+    }
+    if (!ok || files.empty())
     {
-        return (cardsAtHand.size() == 2 && getValue() == 21);
+        cerr << "usage: " << argv[0] << " --merge FILE... [--out FILE] "
+             << "[--breakdown]\n";
+        return 1;
     }
+    ShardResult run;
+    if (!mergeShards(files, run))
+        return 1;
+    if (!outFile.empty() && !run.save(outFile))
+    {
+        cerr << "*** Cannot write " << outFile << "\n";
+        return 1;
+    }
+    printSettings(run, to_string(files.size()) + " file(s)");
+    cout << endl;
+    cout << "Rules: " << run.rules << endl;
+    cout << "Blocks: " << run.blocksPlayed() << " of " << run.nBlock
+         << (run.complete() ? "" : " (incomplete)") << endl;
+    printRun(run, breakdown);
+    return 0;
+}
 
-    // Remove all cards of the hand.
-    void removeAllCards()
+// Print the exact probabilities of the dealer's final results for every
+// face-up card dealt from a full shoe:  --dealer-odds [--decks N]
+int dealerOdds(int argc, char *argv[])
+{
+    int nDeck = 1;
+    if (argc == 4 && strcmp(argv[2], "--decks") == 0)
+        nDeck = atoi(argv[3]);
+    else if (argc != 2)
     {
-        cardsAtHand.clear();
+        cerr << "usage: " << argv[0] << " --dealer-odds [--decks N]\n";
+        return 1;
     }
 
-    // print the cards in the hand.
-    // (if hideFirst==true, the first card will not be shown).
-    void print(bool hideFirst = false) const
+    DealerProbabilities dealer;
+    cout << nDeck << " deck(s), S17" << endl;
+    cout << "up\t17\t18\t19\t20\t21\tbust\tBJ" << endl;
+    cout.setf(ios::fixed);
+    cout.precision(4);
+    for (int up = 1; up <= N_POINTS; up++)
     {
-        if (cardsAtHand.size() == 0)
-            cout << "No card." << endl;
-        for (int i = 0; i < cardsAtHand.size(); i++)
-            if (i == 0 && hideFirst)
-                cout << "?(?) ";
-            else
-                cout << cardsAtHand[i] << ' ';
+        DealerOdds odds = dealer.compute(nDeck, up);
+        cout << (up == 1 ? "A" : RANK_NAMES[up]);
+        for (int i = 0; i < N_DEALER_RESULT; i++)
+            cout << '\t' << odds.p[i];
         cout << endl;
     }
 
-private:
-    std::vector<Card> cardsAtHand; // Array of cards in a hand.
-};
+    // Time repeated queries, answered from the cache.
+    const int nQuery = 100000;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int q = 0; q < nQuery; q++)
+        dealer.compute(nDeck, 1 + q % N_POINTS);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cout.precision(3);
+    cout << "Cached query: " << elapsed.count() * 1e6 / nQuery << " us ("
+         << dealer.cacheSize() << " states, " << dealer.memoryUsed() / 1024
+         << " KB)" << endl;
+    return 0;
+}
 
-// Class that represents the game (displaying texts using standard output,
-// and managing the flow of the game using 5 stages).
-// User inputs are obtained also using standard input, and only the first
-// character (excluding white spaces) of an input (a line ending with \n)
-// is assumed to be the only user input to reduce confusions.
-class Game
+// Generate and print the optimal strategy for a full shoe and the rules
+// (see RuleConfig): --strategy [--decks N] [--threads N] [--rules FILE]
+//                              [--composition]
+int strategy(int argc, char *argv[])
 {
+    int nDeck = 1, nThread = 0;
+    bool composition = false, ok = true;
+    string rulesFile;
+    for (int i = 2; ok && i < argc; i++)
+    {
+        string opt = argv[i];
+        if (opt == "--composition")
+            composition = true;
+        else if (opt == "--rules" && i + 1 < argc)
+            rulesFile = argv[++i];
+        else if (opt == "--decks" && i + 1 < argc)
+            nDeck = atoi(argv[++i]);
+        else if (opt == "--threads" && i + 1 < argc)
+            nThread = atoi(argv[++i]);
+        else
+            ok = false;
+    }
+    if (!ok)
+    {
+        cerr << "usage: " << argv[0] << " --strategy [--decks N] "
+             << "[--threads N] [--rules FILE] [--composition]\n";
+        return 1;
+    }
+    RuleConfig rules;
+    if (!readRules(rulesFile, rules))
+        return 1;
 
-private:
-    Decks myDecks;                // All cards for the game.
-    Hand playerHand, dealerHand;  // Hands for the game.
-    int nPlayerChip, nDealerChip; // Numbers of chips for players.
-    int nBet;                     // Bet of the current round.
+    StrategyGenerator generator(nDeck, nThread, rules);
+    StrategyTable table;
+    CompositionStrategy cd;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    generator.generate(table, composition ? &cd : 0);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
 
-    char temp[MAX_CHARACTER + 1]; // C-string for temporary storages.
-public:
-    // Constructor.
-    Game() : myDecks(), playerHand(), dealerHand()
+    cout << nDeck << " deck(s), " << rules.describe() << endl;
+    for (int nCard = 2; nCard <= 3; nCard++)
     {
-        nPlayerChip = PLAYER_CHIP;
-        nDealerChip = DEALER_CHIP;
+        table.print(nCard);
+        cout << endl;
     }
+    if (composition)
+        cout << "Composition-dependent hands: " << cd.size() << endl;
+    cout << "Generated in " << elapsed.count() << " s" << endl;
+    return 0;
+}
 
-    // Manage the flow of the game.
-    void play()
+// Compute and print the exact expected return of the rules for a full
+// shoe: --house-edge [--decks N] [--threads N] [--rules FILE]
+//                    [--policy optimal|dealer|safe|basic|composition]
+// (optimal plays the best composition-dependent strategy for the rules;
+// basic and composition use the strategies generated for the decks).
+int houseEdge(int argc, char *argv[])
+{
+    int nDeck = 1, nThread = 0;
+    string policy = "optimal", rulesFile;
+    bool ok = true;
+    for (int i = 2; ok && i < argc; i++)
     {
-        // Setting the random seed.
-        srand(time(NULL));
-        // Starting the game (stage1).
-        char input = beginGame(); // one-character user input.
-        // Keep playing rounds if the player wants.
-        while (input == 'n')
-        {
-            beginRound(); // (stage2)
-            do
-            {
-                input = inRound(); // (stage3)
-            } while (input == 'h');
-            // There are three cases for ending a round:
-            // (1) player busting (input == 'b'),
-            // (2) player stands (input == 's').
-            // (3) player forces to quit while playing.
-            input = endRound(input); // (stage4)
-        }
-        endGame(); // (stage5)
+        string opt = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (opt == "--decks" && hasValue)
+            nDeck = atoi(argv[++i]);
+        else if (opt == "--threads" && hasValue)
+            nThread = atoi(argv[++i]);
+        else if (opt == "--rules" && hasValue)
+            rulesFile = argv[++i];
+        else if (opt == "--policy" && hasValue)
+            policy = argv[++i];
+        else
+            ok = false;
     }
-
-private:
-    // Beginning of the game (stage 1).
-    // Returns the input (n, r, q).
-    // (n: next round, r: rule, q: quit.)
-    char beginGame()
+    if (!ok || (policy != "optimal" && policy != "dealer" &&
+                policy != "safe" && policy != "basic" &&
+                policy != "composition"))
     {
-        cout << "###########################" << endl;
-        cout << "#  The Game of Blackjack  #" << endl;
-        cout << "###########################" << endl;
-        cout << endl;
+        cerr << "usage: " << argv[0] << " --house-edge [--decks N] "
+             << "[--threads N] [--rules FILE] "
+             << "[--policy optimal|dealer|safe|basic|composition]\n";
+        return 1;
+    }
+    RuleConfig rules;
+    if (!readRules(rulesFile, rules))
+        return 1;
 
-        int nDeck;
-        // Get the input, the number of decks (nDeck).
-        do
-        { // (will be repeated until a right input is given).
-            cout << "Choose the number of decks to use ";
-            cout << "[1/2/4] (default: 1):  ";
-            cin.getline(temp, MAX_CHARACTER); // getline is the member function of cin
-            // extract a number from the first char.
-            nDeck = firstChar(temp, MAX_CHARACTER) - '0';
-            // default value is 1 when no input.
-            if (nDeck == 0)
-                nDeck = 1;
-        } while (nDeck != 1 && nDeck != 2 && nDeck != 4);
-        cout << endl;
+    HouseEdgeCalculator calculator(nDeck, nThread);
+    StrategyTable table;
+    CompositionStrategy cd;
+    if (policy == "basic" || policy == "composition")
+        StrategyGenerator(nDeck, nThread, rules)
+            .generate(table, policy == "composition" ? &cd : 0);
+    MimicDealerPolicy dealer;
+    NeverBustPolicy safe;
+    PolicyRef ref = policy == "safe"    ? PolicyRef(safe)
+                    : policy == "basic" ? PolicyRef(table)
+                    : policy == "composition" ? PolicyRef(cd)
+                                              : PolicyRef(dealer);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    HouseEdge edge =
+        calculator.compute(rules, policy == "optimal" ? 0 : &ref);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
 
-        myDecks.create(nDeck); // Creating the decks of cards.
-        cout << nDeck << " deck" << (nDeck == 1 ? "" : "s");
-        cout << " (" << 52 * nDeck << " cards) ";
-        cout << (nDeck == 1 ? "has" : "have");
-        cout << " been created and shuffled." << endl;
-        cout << "You are given " << PLAYER_CHIP;
-        cout << " chips now, and you can bet";
-        cout << " upto " << MAX_BET;
-        cout << " chips for each round.\n"
-             << endl;
-
-        char input; // For user input.
-        do
-        { // (will be repeated until a right input is given).
-            cout << "Type n for a new round, r for rules, ";
-            cout << "and q to quit [n/r/q] (default: n): ";
-            cin.getline(temp, MAX_CHARACTER);
-            // extract the first char.
-            input = firstChar(temp, MAX_CHARACTER);
-            if (input == '0')
-                input = 'n';
-            if (input == 'r')
-                displayRules();
-        } while (input != 'n' && input != 'q');
-        cout << endl;
-        return input;
-    }
-
-    // Beginning of a round (stage 2)
-    // Returns the input (amount of bet; 1-5).
-    void beginRound()
-    {
-        cout << "===================================" << endl;
-        cout << "* Starting a New Round (your chips: ";
-        cout << nPlayerChip << ").\n"
-             << endl;
-
-        bool insufficient = false;
-        // Used when checking (remaining chips) < nBet.
-        do
-        { // (will be repeated until a right input is given).
-            if (insufficient)
-            {
-                cout << "You only have " << nPlayerChip;
-                cout << " chip(s)." << endl;
-            };
-            cout << "How many chips do you want to bet? ";
-            cout << "[1-5] (default: 1): ";
-            insufficient = false; // Set it for a new input.
-
-            // Read a line and store in temp.
-            cin.getline(temp, MAX_CHARACTER);
-            // extract a number from the first char.
-            nBet = firstChar(temp, MAX_CHARACTER) - '0';
-            if (nBet == 0)
-                nBet = 1; // Default is 1.
-            // Check if chips are sufficient.
-            if (nBet > nPlayerChip || nBet > nDealerChip)
-                insufficient = true;
-        } while (nBet < 1 || nBet > MAX_BET || insufficient);
-
-        cout << "You bet " << nBet << " chip";
-        cout << (nBet == 1 ? "." : "s.") << endl;
-
-        dealerHand.removeAllCards(); // return all cards
-        playerHand.removeAllCards(); // return all cards
-        myDecks.shuffle();           // Shuffle the cards.
-
-        // Dealing two cards to each player.
-        dealerHand.addCard(myDecks.deal());
-        playerHand.addCard(myDecks.deal());
-        dealerHand.addCard(myDecks.deal());
-        playerHand.addCard(myDecks.deal());
-    }
-
-    // Middle of a round (stage 3).
-    // Returns a character (h, s, b, j, q).
-    // (h: hit, s: stand, b: busted, j: blackjack, q: quit).
-    char inRound()
-    {
-        int playerValue = playerHand.getValue();
-        // Check for the blackjack.
-        // Then stop the round automatically, and return 'j'
-        if (playerHand.blackjack())
-        {
-            cout << "You got the blackjack!" << endl;
-            return 'j';
-        };
-
-        // Check for the player busting
-        // (if busted, stop the round and return 'b').
-        if (playerValue > 21)
-            return 'b';
-
-        // Show hands (with dealer's first card hidden).
-        showHands(true);
-
-        char input; // user input in this stage.
-        do
-        { // (will be repeated until a right input is given).
-            cout << "Type h for Hit, s for Stand, r for ";
-            cout << "rules, q to quit [h/s/r/q] ";
-            cout << "(default: h): ";
-            cin.getline(temp, MAX_CHARACTER);
-            // extract the first char.
-            input = firstChar(temp, MAX_CHARACTER);
-            // Default is h(Hit).
-            if (input == '0')
-                input = 'h';
-            if (input == 'r')
-                displayRules(); // for rules.
-        } while (input != 'h' && input != 's' && input != 'q');
-
-        // Add a card for "Hit".
-        if (input == 'h')
-            playerHand.addCard(myDecks.deal());
-        return input;
-    }
-
-    // End of a round (stage 4)
-    // (busted=true if the player got busted, false if not).
-    char endRound(char in)
-    {
-        int playerValue = playerHand.getValue();
-        if (in == 'b')
-        { // if the player is busted.
-            cout << "\nYou have:\t ";
-            playerHand.print();
-            cout << "You got busted, and lost ";
-            cout << nBet << " chips." << endl;
-            takeChips(-nBet);
-        }
-        else if (in == 'q')
-        { // if the player quits the game.
-            cout << "\nYou lost " << nBet << " chips.";
-            cout << endl;
-            takeChips(-nBet);
-            return in;
-        }
-        else if (in == 'j')
-        {                // if player gets the blackjack.
-            showHands(); // Show cards.
-            if (dealerHand.blackjack())
-            {
-                cout << "It is tied, and the bet is ";
-                cout << "returned." << endl;
-            }
-            else
-            {
-                cout << "You won, and gained ";
-                cout << nBet << " chips." << endl;
-                takeChips(nBet);
-            };
-        }
+    cout << nDeck << " deck(s), policy " << policy << endl;
+    cout << "Rules: " << rules.describe() << endl;
+    cout << "up\tchance\tEV" << endl;
+    cout.setf(ios::fixed);
+    cout.precision(6);
+    for (int up = 1; up <= N_POINTS; up++)
+        cout << (up == 1 ? "A" : RANK_NAMES[up]) << '\t'
+             << edge.pUpCard[up] << '\t' << edge.evByUpCard[up] << endl;
+    cout << "EV per round: " << edge.ev << " (house edge "
+         << -100 * edge.ev << "%)" << endl;
+    cout.precision(3);
+    cout << "Computed in " << elapsed.count() << " s" << endl;
+    return 0;
+}
+
+// Play the interactive game on the console:
+// [--seed N] [--record FILE] [--history FILE] [--rules FILE]
+// (with --record, the session is appended to FILE as a transcript,
+// with --history, its rounds are appended to FILE as a hand history,
+// and --rules reads the rules from FILE, see RuleConfig).
+int interactive(int argc, char *argv[])
+{
+    uint64_t seed = time(NULL);
+    string record, historyFile, rulesFile;
+    for (int i = 1; i < argc; i++)
+    {
+        string opt = argv[i];
+        if (opt == "--seed" && i + 1 < argc)
+            seed = strtoull(argv[++i], 0, 10);
+        else if (opt == "--record" && i + 1 < argc)
+            record = argv[++i];
+        else if (opt == "--history" && i + 1 < argc)
+            historyFile = argv[++i];
+        else if (opt == "--rules" && i + 1 < argc)
+            rulesFile = argv[++i];
         else
-        { // if the player stands. We need to look at the
-            // dealer's hand. The dealer hits until (
-            // the value of the hand) >= 17 (S17 rule).
-            while (dealerHand.getValue() < 17)
-                dealerHand.addCard(myDecks.deal());
-            showHands(); // Show cards.
-
-            int dealerValue = dealerHand.getValue();
-            // If the dealer gets busted.
-            if (dealerValue > 21)
-            {
-                cout << "Dealer got busted, and you ";
-                cout << "gained " << nBet;
-                cout << " chips." << endl;
-                takeChips(nBet);
-            }
-            // Dealer wins.
-            else if (dealerValue > playerValue)
-            {
-                if (dealerHand.blackjack())
-                {
-                    cout << "Dealer got the ";
-                    cout << "blackjack!\n";
-                }
-                cout << "Dealer won, and you lost ";
-                cout << nBet << " chips." << endl;
-                takeChips(-nBet);
-            }
-            // Player wins.
-            else if (dealerValue < playerValue)
-            {
-                cout << "You won, and you gained ";
-                cout << nBet << " chips." << endl;
-                takeChips(nBet);
-            }
-            // A tie.
-            else
-            {
-                // If the dealer has the blackjack and
-                // the score is tied, the dealer wins.
-                if (dealerHand.blackjack())
-                {
-                    cout << "Dealer got the ";
-                    cout << "blackjack! ";
-                    cout << "You lost " << nBet;
-                    cout << " chips." << endl;
-                    takeChips(-nBet);
-                }
-                // the score is tied, and the dealer
-                // doesn't have blackjack.
-                else
-                {
-                    cout << "It is tied, and the ";
-                    cout << "bet is returned.";
-                    cout << endl;
-                }
-            };
+        {
+            cerr << "usage: " << argv[0] << " [--seed N] [--record FILE] "
+                 << "[--history FILE] [--rules FILE]\n";
+            return 1;
         }
-        cout << "\n* End of the Round (your chips: ";
-        cout << nPlayerChip << ")." << endl;
-        cout << "===================================" << endl;
-
-        // If all chips are used up, the game ends.
-        if (nPlayerChip == 0 || nDealerChip == 0)
-            return 'q';
-
-        char input; // character for the user input.
-        do
-        { // (will be repeated until a right input is given).
-            cout << "\nType n for a new round, r for rules";
-            cout << ", q to quit [n/r/q] (default: n): ";
-            cin.getline(temp, MAX_CHARACTER);
-            // extract the first char.
-            input = firstChar(temp, MAX_CHARACTER);
-            // Default is n(new round).
-            if (input == '0')
-                input = 'n';
-            if (input == 'r')
-                displayRules(); // Rules.
-        } while (input != 'n' && input != 'q');
-        return input;
-    }
-
-    // End of the game (Stage 5)
-    void endGame()
-    {
-        cout << "\nYour remaining chips: " << nPlayerChip;
-        cout << " (you ";
-        int diff = nPlayerChip - PLAYER_CHIP;
-        if (diff > 0)
-            cout << "gained " << diff << " chips).";
-        else if (diff < 0)
-            cout << "lost " << -diff << " chips).";
+    }
+    RuleConfig rules;
+    if (!readRules(rulesFile, rules))
+        return 1;
+    unique_ptr<HistoryWriter> history;
+    if (!openHistory(historyFile, history))
+        return 1;
+
+    if (record.empty())
+    {
+        Game g(cout, rules);
+        g.setHistory(history.get());
+        g.play(cin, seed);
+        return 0;
+    }
+    Session session(seed);
+    recordSession(cin, cout, session, history.get(), rules);
+    ofstream file(record.c_str(), ios::app);
+    writeSession(file, session);
+    return file ? 0 : 1;
+}
+
+// Replay the sessions of a transcript file (see session.h):
+// --replay FILE [--output FILE | --quiet] [--history FILE] [--rules FILE]
+//     [--metrics FILE [--metrics-every S]]
+// The texts of the game are written to the standard output (or to the
+// given file) with full buffering, or suppressed with --quiet.
+int replay(int argc, char *argv[])
+{
+    string output, historyFile, rulesFile, metricsFile;
+    double metricsEvery = 10;
+    bool quiet = false, ok = argc > 2;
+    for (int i = 3; ok && i < argc; i++)
+    {
+        string opt = argv[i];
+        if (opt == "--quiet")
+            quiet = true;
+        else if (opt == "--output" && i + 1 < argc)
+            output = argv[++i];
+        else if (opt == "--history" && i + 1 < argc)
+            historyFile = argv[++i];
+        else if (opt == "--rules" && i + 1 < argc)
+            rulesFile = argv[++i];
+        else if (opt == "--metrics" && i + 1 < argc)
+            metricsFile = argv[++i];
+        else if (opt == "--metrics-every" && i + 1 < argc)
+            metricsEvery = atof(argv[++i]);
         else
-            cout << "have the same number of chips as started).";
-        cout << endl
-             << endl;
-        cout << "###########################" << endl;
-        cout << "#     End of the Game     #" << endl;
-        cout << "###########################" << endl;
+            ok = false;
+    }
+    vector<Session> sessions;
+    ifstream in;
+    if (ok)
+        in.open(argv[2]);
+    if (!ok || !in)
+    {
+        cerr << "usage: " << argv[0] << " --replay FILE "
+             << "[--output FILE | --quiet] [--history FILE] "
+             << "[--rules FILE] [--metrics FILE [--metrics-every S]]\n";
+        return 1;
     }
+    if (!readSessions(in, sessions))
+    {
+        cerr << "*** Bad transcript: " << argv[2] << "\n";
+        return 1;
+    }
+    RuleConfig rules;
+    if (!readRules(rulesFile, rules))
+        return 1;
+    unique_ptr<HistoryWriter> history;
+    if (!openHistory(historyFile, history))
+        return 1;
+    unique_ptr<MetricsExporter> metrics;
+    if (!openMetrics(metricsFile, metricsEvery, metrics))
+        return 1;
 
-    // Display rules.
-    void displayRules()
+    // Fully buffered output.
+    ios::sync_with_stdio(false);
+    vector<char> buffer(1 << 20);
+    NullBuffer null;
+    ofstream file;
+    ostream out(cout.rdbuf());
+    if (quiet)
+        out.rdbuf(&null);
+    else if (!output.empty())
     {
-        cout << endl;
-        cout << "===================================" << endl;
-        cout << "# How to play the game of Blackjack. " << endl;
-        cout << "\n\tThere are two players: a dealer, ";
-        cout << "played by a computer, ";
-        cout << "and a player, played by you. ";
-        cout << "\nThe game will be played as many ";
-        cout << "rounds as the player can or wants, ";
-        cout << "and the winner is determined ";
-        cout << "each round. \nAt the beginning of the game, ";
-        cout << "the player chooses ";
-        cout << "how many decks are used for all rounds, ";
-        cout << "where each deck ";
-        cout << "consists of 52 cards, 13 for each suit ";
-        cout << "(Club, Spade, Heart, and Diamond); ";
-        cout << "here the number of decks can be 1 or 2 or 4. ";
-        cout << "\nYou, the player, start with 100 chips and ";
-        cout << "can bet at least 1 chip each round. ";
-        cout << "\nThe maximum number of chips a player can bet ";
-        cout << "at each round is set at " << MAX_BET;
-        cout << " chips here. \nThe dealer is assumed to have ";
-        cout << DEALER_CHIP << " chips in the beginning. ";
-        cout << "\nIf either the player or the dealer loses all ";
-        cout << "chips, the game ends.\n\n";
-        cout << "\tAt each round, the objective of the player ";
-        cout << "is to win the bet by creating a card total ";
-        cout << "that is higher than the value of ";
-        cout << "the dealer's hand, but not exceeding 21 ";
-        cout << "(called, \"busting\"). ";
-        cout << "\nThe value of a hand is determined by summing ";
-        cout << "over values of all ";
-        cout << "cards in a hand: 2~10 have the same values ";
-        cout << "as the face values, ";
-        cout << "while J, Q, and K (face cards) are counted ";
-        cout << "as 10 and an ace, A, ";
-        cout << "can be counted as 1 or 11. The suits of the ";
-        cout << "cards don't have any meaning.\n\n";
-        cout << "\tOnce the amount of the bet is chosen for ";
-        cout << "each round, ";
-        cout << "two cards are dealt at the beginning of the ";
-        cout << "round: both cards of the player are revealed,";
-        cout << " while only one card is revealed for the ";
-        cout << "dealer. ";
-        cout << "\nThe player has two options: Hit or Stand.\n";
-        cout << "\n(1) Hit: Take another card from the dealer.";
-        cout << "\nIf the player's hand ";
-        cout << "is not busted by exceeding 21, ";
-        cout << "the player has another chance ";
-        cout << "to choose to hit or stand,\n\n";
-        cout << "(2) Stand: Take no more card. ";
-        cout << "\nThen, the player's value is ";
-        cout << "determined by summing over all cards in ";
-        cout << "the hand (An ace, A, can be either 1 or 11, ";
-        cout << "whichever is better).\n\n";
-        cout << "\tIf the player gets busted by exceeding 21, ";
-        cout << "the dealer wins. If the player choose to ";
-        cout << "stand at a value 21 or lower, ";
-        cout << "the dealer should hit until the value is ";
-        cout << "17 or greater (the ace, A, is counted as 11 ";
-        cout << "as long as the sum is less than 21, ";
-        cout << "even when the sum becomes 17, which is ";
-        cout << "called \"S17\" rule). ";
-        cout << "\nIf the dealer gets busted, the player wins. ";
-        cout << "\nIf both are not busted, ";
-        cout << "the winner is determined by comparing values;";
-        cout << " the player wins ";
-        cout << "if the player's value is greater, and the ";
-        cout << "dealer wins if the dealer's value is greater.";
-        cout << " If tied, the bet is returned to the player.";
-        cout << "\n\n\tIf the first two cards has the value ";
-        cout << "21 by having an ace and ";
-        cout << "a 10-valued card (10 or J or Q or K), ";
-        cout << "it's called the \"Blackjack\" and ";
-        cout << "wins every hand except another blackjack (if ";
-        cout << "both get blackjacks, it's a tie).\n\n\n";
-        cout << "# Card representation.\n\n";
-        cout << "The ranks: A (ace), 2, 3, 4, 5, 6, 7, 8, 9, ";
-        cout << "10, J, Q, K.\n";
-        cout << "The suits: c (club), s (spade), h (heart), ";
-        cout << "d (diamond).\n\n";
-        cout << "Then, for example, A(s) stands for the spade ";
-        cout << "ace, 10(d) stands for the diamond 10, ";
-        cout << "and Q(h) stands for the heart queen.\n\n\n";
-        cout << "# Player inputs.\n\n";
-        cout << "\tThe player can give inputs using keyboards ";
-        cout << "at the prompt, and only the first character ";
-        cout << "(excluding white spaces) of a line, followed ";
-        cout << "by Enter, will be regarded as a valid input. ";
-        cout << "Possible input characters are: n (new round),";
-        cout << " r (rules), h (hit), s (stand), q (quit), ";
-        cout << "and 1~5 (size of the bet, number of decks).\n";
-        cout << "===================================" << endl;
-        cout << endl;
+        file.rdbuf()->pubsetbuf(&buffer[0], buffer.size());
+        file.open(output.c_str());
+        out.rdbuf(file.rdbuf());
     }
 
-    // A function that extracts a first character from a c-string
-    // (returns '0' if none exists).
-    // temp: character array, size: size of temp.
-    static char firstChar(char *temp, int size)
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    long long nRound = 0;
+    for (size_t i = 0; i < sessions.size(); i++)
+        nRound += replaySession(sessions[i], out, history.get(), rules);
+    out.flush();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cerr << sessions.size() << " session(s), " << nRound << " round(s) in "
+         << elapsed.count() << " s" << endl;
+    if (metrics)
     {
-        int i = 0;
-        // skipping white spaces.
-        while (i < size && temp[i] != '\0' && (temp[i] == ' ' || temp[i] == '\t' || temp[i] == '\n'))
-            i++;
-        // If there is no character in temp, return '0'.
-        if (temp[i] == '\0' || i >= size)
-            return '0';
+        metrics.reset();
+        Metrics::writeSummary(cerr);
+    }
+    return 0;
+}
+
+// Print aggregates of a hand history (see history.h):
+// --history-stats FILE [--threads N]
+// (the win rate and EV by the dealer's up card, and the EV by the total
+// of the player's first two cards).
+int historyStats(int argc, char *argv[])
+{
+    int nThread = 0;
+    if (argc == 5 && strcmp(argv[3], "--threads") == 0)
+        nThread = atoi(argv[4]);
+    else if (argc != 3)
+    {
+        cerr << "usage: " << argv[0] << " --history-stats FILE "
+             << "[--threads N]\n";
+        return 1;
+    }
+    HistoryReader reader(argv[2]);
+    if (!reader.good())
+    {
+        cerr << "*** Bad hand history: " << argv[2] << "\n";
+        return 1;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    HistorySummary sum = reader.summarize(nThread);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    const double chip = CHIP_UNITS; // Gains are in units.
+    cout << "Rounds: " << sum.rounds << ", net chips: " << sum.net / chip
+         << ", EV per round: "
+         << (sum.rounds ? sum.net / chip / sum.rounds : 0.0) << endl;
+    cout.setf(ios::fixed);
+    cout.precision(4);
+    cout << "Up card\tRounds\tWin rate\tEV" << endl;
+    for (int up = 1; up <= N_POINTS; up++)
+    {
+        long long n = sum.byUpCard[up];
+        cout << (up == 1 ? "A" : to_string(up)) << '\t' << n << '\t'
+             << (n ? (double)sum.winsByUpCard[up] / n : 0.0) << '\t'
+             << (n ? sum.netByUpCard[up] / chip / n : 0.0) << endl;
+    }
+    cout << "Total\tRounds\tEV" << endl;
+    for (int total = 4; total <= 21; total++)
+    {
+        long long n = sum.byTotal[total];
+        cout << total << '\t' << n << '\t'
+             << (n ? sum.netByTotal[total] / chip / n : 0.0) << endl;
+    }
+    const char *moveNames[] = {"stand", "hit", "double", "split",
+                               "surrender"};
+    cout << "Decisions:";
+    for (int m = 0; m < 5; m++)
+        cout << (m ? ", " : " ") << moveNames[m] << ' ' << sum.byMove[m];
+    cout << endl;
+    cout.precision(3);
+    cerr << reader.size() << " record(s) in " << elapsed.count() << " s ("
+         << reader.size() / elapsed.count() / 1e6 << "M records/s)" << endl;
+    return 0;
+}
+
+#ifdef BLACKJACK_HAVE_SERVER
+// Server stopped by SIGINT and SIGTERM.
+static GameServer *activeServer = 0;
+
+void stopServer(int)
+{
+    if (activeServer)
+        activeServer->stop();
+}
+
+// Resident memory of this process in KB (from /proc/self/status).
+long residentKb()
+{
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line))
+        if (line.compare(0, 6, "VmRSS:") == 0)
+            return atol(line.c_str() + 6);
+    return 0;
+}
+
+// Serve games over the network until interrupted:
+// --serve [--port N | --unix PATH] [--workers N] [--seed N] [--stats S]
+//     [--shoe-threads N] [--metrics FILE [--metrics-every S]]
+// (every S seconds, the sessions and the memory used are printed; with
+// --shoe-threads, N threads shuffle the shoes of all games ahead of time,
+// see ShoeSupply).
+int serve(int argc, char *argv[])
+{
+    int port = 7777, nWorker = 0, stats = 0, nShoeThread = 0;
+    double metricsEvery = 10;
+    string unixPath, metricsFile;
+    uint64_t seed = time(NULL);
+    for (int i = 2; i < argc; i++)
+    {
+        string opt = argv[i];
+        if (opt == "--port" && i + 1 < argc)
+            port = atoi(argv[++i]);
+        else if (opt == "--unix" && i + 1 < argc)
+            unixPath = argv[++i];
+        else if (opt == "--workers" && i + 1 < argc)
+            nWorker = atoi(argv[++i]);
+        else if (opt == "--seed" && i + 1 < argc)
+            seed = strtoull(argv[++i], 0, 10);
+        else if (opt == "--stats" && i + 1 < argc)
+            stats = atoi(argv[++i]);
+        else if (opt == "--shoe-threads" && i + 1 < argc)
+            nShoeThread = atoi(argv[++i]);
+        else if (opt == "--metrics" && i + 1 < argc)
+            metricsFile = argv[++i];
+        else if (opt == "--metrics-every" && i + 1 < argc)
+            metricsEvery = atof(argv[++i]);
         else
-            return temp[i];
+        {
+            cerr << "usage: " << argv[0] << " --serve [--port N | --unix PATH]"
+                 << " [--workers N] [--seed N] [--stats S] [--shoe-threads N]"
+                 << " [--metrics FILE [--metrics-every S]]\n";
+            return 1;
+        }
     }
+    unique_ptr<MetricsExporter> metrics;
+    if (!openMetrics(metricsFile, metricsEvery, metrics))
+        return 1;
 
-    // Show hands of both players
-    // (if hideFirst==true, the first card will not be shown).
-    void showHands(bool hideFirst = false)
+    // Every session needs a descriptor.
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+        limit.rlim_cur < limit.rlim_max)
     {
-        cout << "\nDealer has:\t ";
-        dealerHand.print(hideFirst);
-        cout << "You have:\t ";
-        playerHand.print();
-        cout << endl;
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
     }
 
-    // Chips changing hands.
-    // (amount > 0: dealer to player; < 0, player to dealer).
-    void takeChips(int amount)
+    // Shoes shuffled in the background (created first, so that it
+    // outlives the server dealing from it).
+    unique_ptr<ShoeSupply> supply;
+    if (nShoeThread > 0)
+        supply.reset(new ShoeSupply(seed, nShoeThread));
+    GameServer server(nWorker, seed);
+    server.setShoeSupply(supply.get());
+    bool ok = unixPath.empty() ? server.listenTcp(port)
+                               : server.listenUnix(unixPath);
+    if (!ok)
     {
-        nPlayerChip += amount;
-        nDealerChip -= amount;
+        cerr << "*** Cannot listen: " << strerror(errno) << "\n";
+        return 1;
     }
-};
+    activeServer = &server;
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+    signal(SIGPIPE, SIG_IGN);
+    server.start();
+    cerr << "Serving on "
+         << (unixPath.empty() ? "port " + to_string(port) : unixPath)
+         << endl;
+
+    int elapsed = 0;
+    while (server.running())
+    {
+        this_thread::sleep_for(chrono::milliseconds(100));
+        if (stats > 0 && ++elapsed % (stats * 10) == 0)
+            cerr << "sessions: " << server.sessions() << " open, "
+                 << server.accepted() << " accepted, "
+                 << server.linesHandled() << " lines, RSS "
+                 << residentKb() << " KB"
+                 << (supply ? ", " + to_string(supply->shoes()) + " shoes (" +
+                                  to_string(supply->stalls()) + " waited)"
+                            : "")
+                 << endl;
+    }
+    server.wait();
+    activeServer = 0;
+    if (metrics)
+    {
+        metrics.reset();
+        Metrics::writeSummary(cerr);
+    }
+    return 0;
+}
+#endif
 
 // Main function (driver).
-int main()
+// With --simulate, rounds are played headlessly (see simulate()),
+// --dealer-odds prints the dealer's probabilities (see dealerOdds()),
+// --strategy prints the optimal strategy (see strategy()),
+// --house-edge prints the exact expected return (see houseEdge()),
+// --replay replays recorded sessions (see replay()),
+// --history-stats summarizes a hand history (see historyStats()),
+// --merge merges the results of shards of a run (see mergeResults()),
+// and --serve hosts games over the network (see serve()).
+// Otherwise the game is played on the console (see interactive()).
+int main(int argc, char *argv[])
 {
-    Game g;
     try
     {
-        g.play();
+        if (argc > 1 && strcmp(argv[1], "--simulate") == 0)
+            return simulate(argc, argv);
+        if (argc > 1 && strcmp(argv[1], "--dealer-odds") == 0)
+            return dealerOdds(argc, argv);
+        if (argc > 1 && strcmp(argv[1], "--strategy") == 0)
+            return strategy(argc, argv);
+        if (argc > 1 && strcmp(argv[1], "--house-edge") == 0)
+            return houseEdge(argc, argv);
+        if (argc > 1 && strcmp(argv[1], "--replay") == 0)
+            return replay(argc, argv);
+        if (argc > 1 && strcmp(argv[1], "--history-stats") == 0)
+            return historyStats(argc, argv);
+        if (argc > 1 && strcmp(argv[1], "--merge") == 0)
+            return mergeResults(argc, argv);
+#ifdef BLACKJACK_HAVE_SERVER
+        if (argc > 1 && strcmp(argv[1], "--serve") == 0)
+            return serve(argc, argv);
+#endif
+        return interactive(argc, argv);
     }
     catch (BadSuit e)
     {
@@ -722,6 +1135,21 @@ int main()
     {
         cerr << "*** Bad number of decks is given.\n";
         exit(1);
+    }
+    catch (BadPenetration e)
+    {
+        cerr << "*** Bad penetration is given.\n";
+        exit(1);
+    }
+    catch (BadCheckpoint e)
+    {
+        cerr << "*** The checkpoint holds another run or cannot be read.\n";
+        exit(1);
+    }
+    catch (BadShard e)
+    {
+        cerr << "*** Bad shard is given.\n";
+        exit(1);
     };
     return 0;
 }
@@ -0,0 +1,146 @@
+#include "alloc_count.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+// Count of heap allocations.
+static atomic<long long> nAlloc(0);
+
+long long allocationCount()
+{
+    return nAlloc;
+}
+
+// Allocate counting the allocation (0 if out of memory).
+static void *countedAlloc(size_t size)
+{
+    nAlloc++;
+    return malloc(size ? size : 1);
+}
+
+void *operator new(size_t size)
+{
+    void *p = countedAlloc(size);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    void *p = countedAlloc(size);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+
+void *operator new(size_t size, const nothrow_t &) noexcept
+{
+    return countedAlloc(size);
+}
+
+void *operator new[](size_t size, const nothrow_t &) noexcept
+{
+    return countedAlloc(size);
+}
+
+// Over-aligned types (such as the cache-line aligned results) go through
+// the forms taking the alignment.
+static void *countedAlignedAlloc(size_t size, align_val_t align)
+{
+    nAlloc++;
+    // aligned_alloc() wants a size that is a multiple of the alignment.
+    size_t a = (size_t)align;
+    size_t bytes = size ? (size + a - 1) / a * a : a;
+    return aligned_alloc(a, bytes);
+}
+
+void *operator new(size_t size, align_val_t align)
+{
+    void *p = countedAlignedAlloc(size, align);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size, align_val_t align)
+{
+    void *p = countedAlignedAlloc(size, align);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+
+void *operator new(size_t size, align_val_t align, const nothrow_t &) noexcept
+{
+    return countedAlignedAlloc(size, align);
+}
+
+void *operator new[](size_t size, align_val_t align,
+                     const nothrow_t &) noexcept
+{
+    return countedAlignedAlloc(size, align);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, const nothrow_t &) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, const nothrow_t &) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, align_val_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, align_val_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t, align_val_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t, align_val_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, align_val_t, const nothrow_t &) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, align_val_t, const nothrow_t &) noexcept
+{
+    free(p);
+}
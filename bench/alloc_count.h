@@ -0,0 +1,10 @@
+#ifndef BLACKJACK_ALLOC_COUNT_H
+#define BLACKJACK_ALLOC_COUNT_H
+
+// Number of heap allocations so far. Every form of operator new and
+// operator delete (array, sized, nothrow and aligned) is replaced in
+// alloc_count.cpp, away from the code measured, so that the compiler
+// never sees an allocation and its release mismatched.
+long long allocationCount();
+
+#endif // BLACKJACK_ALLOC_COUNT_H
@@ -0,0 +1,689 @@
+// Benchmarks of the hot paths of the card engine.
+// Every benchmark reports the time per operation and the heap allocations
+// per operation. Results can be saved and later compared with a baseline
+// to catch regressions. It also checks that rounds never allocate, and a
+// few results of known rounds, and fails otherwise (--checks runs only
+// the checks):
+//   blackjack_bench [--min-time S] [--save FILE] [--baseline FILE]
+//                   [--tolerance PCT] [--checks]
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "alloc_count.h"
+#include "game.h"
+#include "hand_batch.h"
+#include "history.h"
+#include "session.h"
+#include "shoe_supply.h"
+#include "simulator.h"
+#include "strategy.h"
+#include "vector_env.h"
+
+using namespace std;
+
+// Sink for results, so that benchmarked work is not optimized away.
+static volatile long long sink;
+
+// Result of a benchmark.
+struct BenchResult
+{
+    string name;        // Name of the benchmark.
+    double nsPerOp;     // Nanoseconds per operation.
+    double allocsPerOp; // Heap allocations per operation.
+};
+
+static double minTime = 0.2; // Minimum seconds of a measurement.
+
+// Run body(n), which does n operations and returns a checksum, with
+// increasing n until it takes at least minTime seconds.
+template <class Body>
+BenchResult measure(const string &name, Body body)
+{
+    long long n = 1;
+    while (true)
+    {
+        long long allocBefore = allocationCount();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        sink = sink + body(n);
+        chrono::duration<double> elapsed =
+            chrono::steady_clock::now() - start;
+        long long allocs = allocationCount() - allocBefore;
+        if (elapsed.count() >= minTime || n >= (1LL << 40))
+        {
+            BenchResult res;
+            res.name = name;
+            res.nsPerOp = elapsed.count() * 1e9 / n;
+            res.allocsPerOp = (double)allocs / n;
+            return res;
+        }
+        // Aim at the minimum time from this measurement.
+        double scale = elapsed.count() > 0 ? minTime / elapsed.count() : 100;
+        n = (long long)(n * min(max(scale * 1.2, 2.0), 100.0));
+    }
+}
+
+// Play scripted rounds through the stages of the game, with the output
+// suppressed: every round bets 1 chip, stands and goes on.
+// Returns the number of rounds played (the game ends early if the player
+// or the dealer runs out of chips).
+static long long scriptedRounds(long long n, uint64_t seed)
+{
+    NullBuffer null;
+    ostream out(&null);
+    Game g(out);
+    g.start(seed);
+    g.input("1");
+    for (long long i = 0; i < n && !g.finished(); i++)
+    {
+        g.input("n");
+        g.input("1");
+        g.input("s");
+    }
+    g.input("q");
+    return g.roundsPlayed();
+}
+
+static vector<BenchResult> runAll()
+{
+    vector<BenchResult> results;
+
+    results.push_back(measure("Decks::create(1)", [](long long n) {
+        Decks decks(1);
+        for (long long i = 0; i < n; i++)
+            decks.create(1);
+        return (long long)decks.remaining();
+    }));
+    results.push_back(measure("Decks::create(8)", [](long long n) {
+        Decks decks(8);
+        for (long long i = 0; i < n; i++)
+            decks.create(8);
+        return (long long)decks.remaining();
+    }));
+    results.push_back(measure("Decks::shuffle", [](long long n) {
+        Decks decks(8);
+        long long sum = 0;
+        for (long long i = 0; i < n; i++)
+        {
+            decks.shuffle();
+            sum += decks.deal().getCode();
+        }
+        return sum;
+    }));
+    results.push_back(measure("Decks::deal", [](long long n) {
+        Decks decks(8);
+        decks.seed(1);
+        long long sum = 0;
+        for (long long i = 0; i < n; i++)
+            sum += decks.deal().getCode();
+        return sum;
+    }));
+    results.push_back(measure("Decks::deal (shoe supply)", [](long long n) {
+        ShoeSupply supply(1);
+        Decks decks(8);
+        decks.setSupply(&supply);
+        long long sum = 0;
+        for (long long i = 0; i < n; i++)
+            sum += decks.deal().getCode();
+        return sum;
+    }));
+    results.push_back(measure("Hand::addCard+getValue+blackjack",
+                              [](long long n) {
+        Hand hand;
+        Card cards[3] = {Card(1, 's'), Card(13, 'h'), Card(5, 'd')};
+        long long sum = 0;
+        for (long long i = 0; i < n; i++)
+        {
+            if (i % 3 == 0)
+                hand.removeAllCards();
+            hand.addCard(cards[i % 3]);
+            sum += hand.getValue() + hand.blackjack();
+        }
+        return sum;
+    }));
+
+    // Hands of a batch; each operation adds a card to one hand and takes
+    // its value (every hand starts over after 4 cards).
+    const long long BATCH = 4096;
+    vector<uint8_t> codes(BATCH), vals(BATCH);
+    for (long long i = 0; i < BATCH; i++)
+        codes[i] = Card(1 + i % 13, SUIT_CHARS[i % 4]).getCode();
+    results.push_back(measure("Hand add+value (4096 hands)",
+                              [&](long long n) {
+        vector<Hand> hands(BATCH);
+        long long sum = 0;
+        for (long long done = 0; done < n; done += BATCH)
+        {
+            bool reset = done / BATCH % 4 == 0;
+            for (long long i = 0; i < BATCH; i++)
+            {
+                if (reset)
+                    hands[i].removeAllCards();
+                hands[i].addCard(Card::fromCode(codes[i]));
+                sum += hands[i].getValue();
+            }
+        }
+        return sum;
+    }));
+    results.push_back(measure("HandBatch add+value (4096 hands)",
+                              [&](long long n) {
+        HandBatch batch(BATCH);
+        long long sum = 0;
+        for (long long done = 0; done < n; done += BATCH)
+        {
+            if (done / BATCH % 4 == 0)
+                batch.removeAllCards();
+            batch.addCards(codes.data());
+            batch.values(vals.data());
+            sum += vals[done % BATCH];
+        }
+        return sum;
+    }));
+
+    StrategyTable table;
+    StrategyGenerator(6, 0).generate(table);
+    results.push_back(measure("playRound (6 decks, basic)", [&](long long n) {
+        Decks decks(ShoeConfig(6));
+        decks.seed(1);
+        PlayerHands player;
+        Hand dealer;
+        long long sum = 0;
+        for (long long i = 0; i < n; i++)
+            sum += playRound(decks, player, dealer, table);
+        return sum;
+    }));
+    // Doubles and splits (up to 4 hands) with the hands held inline:
+    // after the first rounds, no round allocates.
+    typedef FixedRules<false, 3, 2, true, false, true, 4, true> Casino;
+    results.push_back(measure("playRound (6 decks, basic, splits)",
+                              [&](long long n) {
+        Decks decks(ShoeConfig(6));
+        decks.seed(1);
+        PlayerHands player;
+        Hand dealer;
+        long long sum = 0;
+        for (long long i = 0; i < n; i++)
+            sum += playRound(decks, player, dealer, table, Casino());
+        return sum;
+    }));
+    results.push_back(measure("Simulator::run (6 decks, basic)",
+                              [&](long long n) {
+        Simulator sim(ShoeConfig(6), 0, 1);
+        return sim.run(n, table).net;
+    }));
+    // Each operation is one seat's round at a full table (compare with
+    // Simulator::run, where each round has its own dealer).
+    results.push_back(measure("Simulator::runTable (7 seats, basic)",
+                              [&](long long n) {
+        Simulator sim(ShoeConfig(6), 0, 1);
+        vector<StrategyTable> seats(7, table);
+        vector<SimulationResult> res = sim.runTable((n + 6) / 7, seats);
+        long long net = 0;
+        for (size_t s = 0; s < res.size(); s++)
+            net += res[s].net;
+        return net;
+    }));
+    // The same rules, compiled in or read from flags at run time.
+    RuleConfig vegas;
+    vegas.hitSoft17 = true;
+    vegas.blackjackNum = 3;
+    vegas.blackjackDen = 2;
+    vegas.peek = true;
+    results.push_back(measure("Simulator::run (H17 3:2 peek, fixed)",
+                              [&](long long n) {
+        Simulator sim(ShoeConfig(6), 0, 1);
+        return sim.run(n, table, 0, FixedRules<true, 3, 2, true, false>())
+            .net;
+    }));
+    results.push_back(measure("Simulator::run (H17 3:2 peek, runtime)",
+                              [&](long long n) {
+        Simulator sim(ShoeConfig(6), 0, 1);
+        return sim.run(n, table, 0, vegas).net;
+    }));
+    // Recording overhead only: the records are discarded by the system.
+    results.push_back(measure("Simulator::run with history",
+                              [&](long long n) {
+        Simulator sim(ShoeConfig(6), 0, 1);
+        HistoryWriter history("/dev/null");
+        return sim.run(n, table, &history).net;
+    }));
+    // Each operation is a full round through the stages of Game.
+    results.push_back(measure("Game scripted round", [](long long n) {
+        long long played = 0;
+        while (played < n)
+            played += scriptedRounds(min(n - played, 1000LL), played);
+        return played;
+    }));
+    // Each operation steps one table of the vectorized environment,
+    // playing like the dealer with a bet of 1 chip.
+    for (int nThread = 1; nThread <= 2; nThread++)
+    {
+        bj_env_config config;
+        bj_env_default_config(&config);
+        config.n_thread = nThread;
+        bj_env *env = bj_env_create(&config);
+        int n = bj_env_size(env);
+        vector<int32_t> actions(n, 1), obs(n * BJ_OBS_SIZE);
+        vector<float> rewards(n);
+        vector<uint8_t> dones(n);
+        bj_env_reset(env, obs.data());
+        string name = "bj_env_step (1024 tables, " + to_string(nThread) +
+                      " thread" + (nThread == 1 ? ")" : "s)");
+        results.push_back(measure(name, [&](long long ops) {
+            long long sum = 0;
+            for (long long k = 0; k < ops; k += n)
+            {
+                for (int i = 0; i < n; i++)
+                {
+                    const int32_t *o = &obs[i * BJ_OBS_SIZE];
+                    actions[i] = o[BJ_OBS_PHASE] != BJ_PHASE_PLAY ? 1
+                                 : o[BJ_OBS_VALUE] < 17 ? BJ_HIT
+                                                        : BJ_STAND;
+                }
+                bj_env_step(env, actions.data(), obs.data(), rewards.data(),
+                            dones.data());
+                sum += dones[0];
+            }
+            return sum;
+        }));
+        bj_env_destroy(env);
+    }
+    return results;
+}
+
+static const long long CHECKED_ROUNDS = 100000; // Rounds of the checks.
+
+// Heap allocations of body(n) for many rounds, once warmed up.
+template <class Body>
+static long long allocationsIn(Body body)
+{
+    body(1000);
+    long long before = allocationCount();
+    body(CHECKED_ROUNDS);
+    return allocationCount() - before;
+}
+
+// Check that simulated and played rounds never allocate once warmed up
+// (the hands are held inline, and the shoes and buffers are reused).
+// Returns false (with a message) otherwise.
+static bool checkAllocationFree()
+{
+    RuleConfig rules;
+    rules.peek = rules.surrender = rules.doubleDown = true;
+    rules.doubleAfterSplit = rules.insurance = true;
+    rules.splitHands = 4;
+    StrategyTable table;
+    StrategyGenerator(6, 0, rules).generate(table);
+    Decks decks(ShoeConfig(6));
+    PlayerHands player;
+    Hand dealer;
+    long long rounds = 0;
+    long long simulated = allocationsIn([&](long long n) {
+        for (long long i = 0; i < n; i++)
+            rounds += playRound(decks, player, dealer, table, rules) != 0;
+    });
+
+    // Enough chips for the player never to go broke by standing.
+    RuleConfig gameRules = rules;
+    gameRules.playerChips = gameRules.dealerChips = 1000000;
+    NullBuffer null;
+    ostream out(&null);
+    Game game(out, gameRules);
+    game.start(1);
+    game.input("8");
+    int roundsBefore = 0;
+    long long played = allocationsIn([&](long long n) {
+        // One bet per pass: a new round, a bet of 1, no insurance (or an
+        // invalid move), and stand. Inputs out of turn are asked again.
+        roundsBefore = game.roundsPlayed();
+        while (game.roundsPlayed() - roundsBefore < n && !game.finished())
+        {
+            game.input("n");
+            game.input("1");
+            game.input("n");
+            game.input("s");
+        }
+    });
+    long long gameRounds = game.roundsPlayed() - roundsBefore;
+
+    bj_env_config config;
+    bj_env_default_config(&config);
+    bj_env *env = bj_env_create(&config);
+    int nEnv = bj_env_size(env);
+    vector<int32_t> actions(nEnv, 1), obs(nEnv * BJ_OBS_SIZE);
+    vector<float> rewards(nEnv);
+    vector<uint8_t> dones(nEnv);
+    long long stepped = allocationsIn([&](long long n) {
+        for (long long k = 0; k < n; k += nEnv)
+            bj_env_step(env, actions.data(), obs.data(), rewards.data(),
+                        dones.data());
+    });
+    bj_env_destroy(env);
+
+    cout << "Allocations in " << CHECKED_ROUNDS << " rounds: playRound "
+         << simulated << ", Game " << played << ", bj_env_step " << stepped
+         << endl;
+    if (gameRounds != CHECKED_ROUNDS)
+    {
+        cout << "*** The game played " << gameRounds << " rounds." << endl;
+        return false;
+    }
+    if (simulated == 0 && played == 0 && stepped == 0)
+        return true;
+    cout << "*** Rounds allocate memory." << endl;
+    return false;
+}
+
+// Shoe dealing given cards in order (see playRound()), for the checks.
+struct FixedShoe
+{
+    vector<Card> cards; // The cards, in the order dealt.
+    int current;        // Cards dealt.
+
+    FixedShoe(const vector<Card> &cards1) : cards(cards1), current(0)
+    {
+    }
+
+    bool needsShuffle() const
+    {
+        return false;
+    }
+
+    void shuffle()
+    {
+    }
+
+    int position() const
+    {
+        return current;
+    }
+
+    Card deal()
+    {
+        return cards[current++ % cards.size()];
+    }
+};
+
+// Check that a round is counted by the dealer's face-up card (the second
+// card dealt to the dealer) in the results. Returns false (with a
+// message) otherwise.
+static bool checkBreakdown()
+{
+    // Dealer: 5 (hidden) and 9 (face-up); player: 10 and 8, standing;
+    // the dealer busts with a king.
+    FixedShoe shoe({Card(5, 'c'), Card(10, 's'), Card(9, 'h'),
+                    Card(8, 'd'), Card(13, 'c')});
+    PlayerHands player;
+    Hand dealer;
+    SimulationResult res;
+    int units = playRound(shoe, player, dealer, MimicDealerPolicy());
+    res.add(player, dealer, units);
+    if (res.byUpCard[9][DEALER_BUST] == 1 &&
+        res.byUpCard[5][DEALER_BUST] == 0 &&
+        res.byTotal[18][DEALER_BUST] == 1)
+        return true;
+    cout << "*** Hands are not counted by the dealer's face-up card."
+         << endl;
+    return false;
+}
+
+// Check that a batch of busted hands (10, 9 and 5, by SIMD steps and one
+// by one) has the values of Hand. Returns false (with a message)
+// otherwise.
+static bool checkBustedBatch()
+{
+    const size_t N = 40; // A SIMD step and a few hands more.
+    HandBatch batch(N);
+    Hand hand;
+    const int ranks[3] = {10, 9, 5};
+    vector<uint8_t> codes(N), values(N);
+    for (int c = 0; c < 3; c++)
+    {
+        Card card(ranks[c], 'h');
+        hand.addCard(card);
+        fill(codes.begin(), codes.end(), card.getCode());
+        batch.addCards(codes.data());
+    }
+    batch.values(values.data());
+    for (size_t i = 0; i < N; i++)
+        if (values[i] != hand.getValue() ||
+            batch.getValue(i) != hand.getValue())
+        {
+            cout << "*** HandBatch values 10, 9, 5 as " << (int)values[i]
+                 << ", Hand as " << hand.getValue() << "." << endl;
+            return false;
+        }
+    return true;
+}
+
+// Check that every kernel set of HandBatch supported here (scalar, SSE2
+// and AVX2) gives the results of Hand, for hands of random cards (up to
+// 12, busted ones included) added by random batches. Returns false (with
+// a message) otherwise.
+static bool checkBatchKernels()
+{
+    const char *names[3] = {"scalar", "sse2", "avx2"};
+    const size_t N = 1000; // SIMD steps and a tail.
+    bool ok = true;
+    for (int k = 0; k < 3 && ok; k++)
+    {
+        if (!HandBatch::useKernels(names[k]))
+            continue;
+        Random rng(k + 1);
+        HandBatch batch(N);
+        vector<Hand> hands(N);
+        vector<uint8_t> codes(N), values(N), softs(N), busts(N), bjs(N);
+        for (int trial = 0; trial < 100 && ok; trial++)
+        {
+            batch.removeAllCards();
+            for (size_t i = 0; i < N; i++)
+                hands[i].removeAllCards();
+            for (int step = 0; step < 12 && ok; step++)
+            {
+                // No card for about a hand in 4.
+                for (size_t i = 0; i < N; i++)
+                {
+                    codes[i] = 0;
+                    if (rng.below(4) == 0)
+                        continue;
+                    Card card(1 + rng.below(13), SUIT_CHARS[rng.below(4)]);
+                    codes[i] = card.getCode();
+                    hands[i].addCard(card);
+                }
+                batch.addCards(codes.data());
+                batch.values(values.data());
+                batch.softs(softs.data());
+                batch.busts(busts.data());
+                batch.blackjacks(bjs.data());
+                for (size_t i = 0; i < N && ok; i++)
+                {
+                    const Hand &h = hands[i];
+                    ok = values[i] == h.getValue() &&
+                         softs[i] == h.isSoft() &&
+                         busts[i] == h.busted() &&
+                         bjs[i] == h.blackjack() &&
+                         batch.getValue(i) == h.getValue() &&
+                         batch.isSoft(i) == h.isSoft() &&
+                         batch.busted(i) == h.busted() &&
+                         batch.blackjack(i) == h.blackjack() &&
+                         batch.handSize(i) == h.size();
+                }
+            }
+        }
+        if (!ok)
+            cout << "*** The " << names[k]
+                 << " kernels of HandBatch differ from Hand." << endl;
+    }
+    HandBatch::useKernels(0);
+    return ok;
+}
+
+// Policy playing given decisions in order, for the checks.
+struct ScriptPolicy
+{
+    const char *moves; // The decisions, in order.
+    mutable int next;  // Decisions played.
+
+    ScriptPolicy(const char *moves1) : moves(moves1), next(0)
+    {
+    }
+
+    char decide(const Hand &, const Card &, int) const
+    {
+        return moves[next++];
+    }
+
+    bool insure(const Hand &) const
+    {
+        return false;
+    }
+};
+
+// Check that the decisions of recorded rounds read back from a hand
+// history file. Returns false (with a message) otherwise.
+static bool checkHistory()
+{
+    RuleConfig rules;
+    rules.surrender = rules.doubleDown = rules.doubleAfterSplit = true;
+    rules.splitHands = 4;
+    // A pair of 8s against a 7, split: 8 and 3 doubled with a 9, then 8
+    // and 2 hit with a 5 and stood. Then 10 and 6 against a 10,
+    // surrendered.
+    FixedShoe split({Card(10, 'c'), Card(8, 's'), Card(7, 'h'),
+                     Card(8, 'd'), Card(3, 'c'), Card(9, 'c'), Card(2, 'c'),
+                     Card(5, 'c')});
+    FixedShoe surrender({Card(9, 'c'), Card(10, 's'), Card(10, 'h'),
+                         Card(6, 'd')});
+    char path[] = "/tmp/blackjack_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return false;
+    close(fd);
+    {
+        HistoryWriter writer(path);
+        PlayerHands player;
+        Hand dealer;
+        HandRecord records[2];
+        records[0].begin(0, 0, 1);
+        playRound(split, player, dealer, ScriptPolicy("pdhs"), rules,
+                  &records[0]);
+        records[1].begin(0, 1, 1);
+        playRound(surrender, player, dealer, ScriptPolicy("u"), rules,
+                  &records[1]);
+        writer.write(records, 2);
+    }
+    HistoryReader reader(path);
+    string moves;
+    HistorySummary sum;
+    if (reader.good())
+    {
+        for (size_t i = 0; i < reader.size(); i++)
+            for (int d = 0; d < reader.records()[i].nDecision; d++)
+                moves += reader.records()[i].decision(d);
+        sum = reader.summarize(1);
+    }
+    unlink(path);
+    if (moves == "pdhsu" && sum.byMove[0] == 1 && sum.byMove[1] == 1 &&
+        sum.byMove[2] == 1 && sum.byMove[3] == 1 && sum.byMove[4] == 1)
+        return true;
+    cout << "*** Recorded decisions read back as \"" << moves << "\"."
+         << endl;
+    return false;
+}
+
+// Read saved results (lines of: name<TAB>ns/op<TAB>allocs/op).
+static map<string, double> readBaseline(const string &file)
+{
+    map<string, double> base;
+    ifstream in(file.c_str());
+    string line;
+    while (getline(in, line))
+    {
+        size_t tab = line.find('\t');
+        if (tab != string::npos)
+            base[line.substr(0, tab)] = atof(line.c_str() + tab + 1);
+    }
+    return base;
+}
+
+int main(int argc, char *argv[])
+{
+    string save, baseline;
+    double tolerance = 10; // Allowed slowdown in percent.
+    bool checksOnly = false;
+    for (int i = 1; i < argc; i++)
+    {
+        string opt = argv[i];
+        if (opt == "--min-time" && i + 1 < argc)
+            minTime = atof(argv[++i]);
+        else if (opt == "--save" && i + 1 < argc)
+            save = argv[++i];
+        else if (opt == "--baseline" && i + 1 < argc)
+            baseline = argv[++i];
+        else if (opt == "--tolerance" && i + 1 < argc)
+            tolerance = atof(argv[++i]);
+        else if (opt == "--checks")
+            checksOnly = true;
+        else
+        {
+            cerr << "usage: " << argv[0] << " [--min-time S] [--save FILE] "
+                 << "[--baseline FILE] [--tolerance PCT] [--checks]\n";
+            return 1;
+        }
+    }
+
+    vector<BenchResult> results;
+    if (!checksOnly)
+        results = runAll();
+    map<string, double> base;
+    if (!baseline.empty())
+        base = readBaseline(baseline);
+
+    bool regression = false;
+    cout.setf(ios::fixed);
+    cout.precision(2);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult &r = results[i];
+        cout << r.name << ": " << r.nsPerOp << " ns/op, "
+             << 1e9 / r.nsPerOp << " ops/s, " << r.allocsPerOp
+             << " allocs/op";
+        map<string, double>::const_iterator it = base.find(r.name);
+        if (it != base.end() && it->second > 0)
+        {
+            double change = (r.nsPerOp / it->second - 1) * 100;
+            cout << " (" << (change >= 0 ? "+" : "") << change << "%)";
+            if (change > tolerance)
+            {
+                cout << " REGRESSION";
+                regression = true;
+            }
+        }
+        cout << endl;
+    }
+
+    bool allocationFree = checkAllocationFree();
+    bool checked = checkBreakdown();
+    checked = checkHistory() && checked;
+    checked = checkBustedBatch() && checked;
+    checked = checkBatchKernels() && checked;
+
+    if (!save.empty())
+    {
+        ofstream out(save.c_str());
+        for (size_t i = 0; i < results.size(); i++)
+            out << results[i].name << '\t' << results[i].nsPerOp << '\t'
+                << results[i].allocsPerOp << '\n';
+    }
+    return regression || !allocationFree || !checked ? 1 : 0;
+}
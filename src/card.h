@@ -0,0 +1,116 @@
+#ifndef BLACKJACK_CARD_H
+#define BLACKJACK_CARD_H
+
+#include <cstdint>
+#include <iostream>
+
+// classes for error exceptions.
+struct BadSuit
+{
+};
+struct BadNumberDecks
+{
+};
+struct BadPenetration
+{
+};
+
+// Static tables for the cards.
+// Names of the ranks (index: 1~13).
+const char *const RANK_NAMES[14] = {"", "A", "2", "3", "4", "5", "6", "7",
+                                    "8", "9", "10", "J", "Q", "K"};
+// Blackjack points of the ranks (face cards count as 10, aces as 1).
+const int RANK_POINTS[14] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 10, 10, 10};
+// Number of distinct points of the cards (1: ace, ..., 10: 10, J, Q, K).
+const int N_POINTS = 10;
+// Characters of the suits (index: 0~3).
+const char SUIT_CHARS[4] = {'c', 's', 'h', 'd'};
+
+// Class that represents a card. It needs a value (rank) and a suit.
+// A card is packed into a single byte: the rank (1~13) in the low 4 bits
+// and the suit index (0~3, see SUIT_CHARS) in the next 2 bits.
+class Card
+{
+public:
+    // Constructor.
+    // num should be in the range of 1<= num <=13
+    // (1: Ace, 11:J, 12:Q, 13:K),
+    // suits: 'c' (club), 's' (spade), 'h' (heart), 'd' (diamond).
+    Card(int num1 = 1, char suit1 = 's')
+    {
+        // Assigning the rank of the card using a number.
+        int num;
+        if (num1 < 1)
+            num = 1;
+        else if (num1 > 13)
+            num = 13;
+        else
+            num = num1;
+        // Assigning the suit of the card.
+        int suit;
+        if (suit1 == 'c' || suit1 == 'C')
+            suit = 0;
+        else if (suit1 == 's' || suit1 == 'S')
+            suit = 1;
+        else if (suit1 == 'h' || suit1 == 'H')
+            suit = 2;
+        else if (suit1 == 'd' || suit1 == 'D')
+            suit = 3;
+        else
+            throw BadSuit(); // Error exception for bad input.
+        bits = (uint8_t)(suit << SUIT_SHIFT | num);
+    }
+
+    // Create a card from its packed byte (see getCode()).
+    static Card fromCode(uint8_t code)
+    {
+        Card c;
+        c.bits = code;
+        return c;
+    }
+
+    // Get the packed byte of the card.
+    uint8_t getCode() const
+    {
+        return bits;
+    }
+
+    // Get the value of the card (1~13).
+    int getValue() const
+    {
+        return bits & RANK_MASK;
+    }
+
+    // Get the blackjack points of the card (1~10, an ace counts as 1).
+    int getPoints() const
+    {
+        return RANK_POINTS[bits & RANK_MASK];
+    }
+
+    // Get the rank of the card (A, 2,..., 10, J, Q, K) as strings.
+    const char *getRank() const
+    {
+        return RANK_NAMES[bits & RANK_MASK];
+    }
+
+    // Get the suit of the given card.
+    char getSuit() const
+    {
+        return SUIT_CHARS[bits >> SUIT_SHIFT];
+    }
+
+    static const int SUIT_SHIFT = 4;   // Position of the suit bits.
+    static const int RANK_MASK = 0x0f; // Mask of the rank bits.
+
+private:
+    uint8_t bits; // The rank and the suit of the card.
+};
+static_assert(sizeof(Card) == 1, "a card should fit in one byte");
+
+// outstream operator overloading for the Card class.
+inline std::ostream &operator<<(std::ostream &s, const Card &c)
+{
+    return s << c.getRank() << "(" << c.getSuit() << ')';
+}
+
+#endif // BLACKJACK_CARD_H
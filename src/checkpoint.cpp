@@ -0,0 +1,270 @@
+#include "checkpoint.h"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace std;
+
+// Write and read values of fixed size (native byte order).
+template <class T>
+static void put(FILE *fp, const T &value, bool &ok)
+{
+    ok = ok && fwrite(&value, sizeof(T), 1, fp) == 1;
+}
+
+template <class T>
+static void get(FILE *fp, T &value, bool &ok)
+{
+    ok = ok && fread(&value, sizeof(T), 1, fp) == 1;
+}
+
+bool Checkpoint::sameRun(const Checkpoint &other) const
+{
+    return tag == other.tag && seed == other.seed &&
+           nRound == other.nRound && nBlock == other.nBlock &&
+           shoe.nDeck == other.shoe.nDeck &&
+           shoe.penetration == other.shoe.penetration &&
+           shoe.continuous == other.shoe.continuous;
+}
+
+bool Checkpoint::inProgress(long long b) const
+{
+    for (size_t i = 0; i < partial.size(); i++)
+        if (partial[i].block == b)
+            return true;
+    return false;
+}
+
+bool Checkpoint::save(const string &file) const
+{
+    string temp = file + ".tmp";
+    FILE *fp = fopen(temp.c_str(), "wb");
+    if (!fp)
+        return false;
+    bool ok = true;
+    put(fp, CHECKPOINT_MAGIC, ok);
+    put(fp, CHECKPOINT_VERSION, ok);
+    uint32_t tagSize = tag.size();
+    put(fp, tagSize, ok);
+    ok = ok && fwrite(tag.data(), 1, tagSize, fp) == tagSize;
+    put(fp, seed, ok);
+    put(fp, nRound, ok);
+    put(fp, nBlock, ok);
+    put(fp, shoe.nDeck, ok);
+    put(fp, shoe.penetration, ok);
+    put(fp, shoe.continuous, ok);
+    put(fp, total, ok);
+    // The finished blocks, 8 per byte.
+    vector<uint8_t> bits((nBlock + 7) / 8, 0);
+    for (long long b = 0; b < nBlock; b++)
+        if (done[b])
+            bits[b / 8] |= 1 << (b % 8);
+    ok = ok && fwrite(bits.data(), 1, bits.size(), fp) == bits.size();
+    uint32_t nPartial = partial.size();
+    put(fp, nPartial, ok);
+    for (size_t i = 0; i < partial.size(); i++)
+    {
+        const BlockState &state = partial[i];
+        uint32_t nCard = state.decks.cards.size();
+        put(fp, state.block, ok);
+        put(fp, state.round, ok);
+        put(fp, nCard, ok);
+        ok = ok && fwrite(state.decks.cards.data(), 1, nCard, fp) == nCard;
+        put(fp, state.decks.current, ok);
+        put(fp, state.decks.rng, ok);
+    }
+    ok = fclose(fp) == 0 && ok;
+    if (ok && rename(temp.c_str(), file.c_str()) == 0)
+        return true;
+    remove(temp.c_str());
+    return false;
+}
+
+bool Checkpoint::load(const string &file)
+{
+    FILE *fp = fopen(file.c_str(), "rb");
+    if (!fp && errno == ENOENT)
+        return false;
+    if (!fp)
+        throw BadCheckpoint();
+    bool ok = true;
+    uint32_t magic = 0, version = 0, tagSize = 0;
+    get(fp, magic, ok);
+    get(fp, version, ok);
+    get(fp, tagSize, ok);
+    ok = ok && magic == CHECKPOINT_MAGIC && version == CHECKPOINT_VERSION &&
+         tagSize < (1 << 16);
+    if (ok)
+    {
+        tag.resize(tagSize);
+        ok = fread(&tag[0], 1, tagSize, fp) == tagSize;
+    }
+    get(fp, seed, ok);
+    get(fp, nRound, ok);
+    get(fp, nBlock, ok);
+    get(fp, shoe.nDeck, ok);
+    get(fp, shoe.penetration, ok);
+    get(fp, shoe.continuous, ok);
+    get(fp, total, ok);
+    ok = ok && nBlock >= 0 && nBlock < (1LL << 40) && shoe.nDeck >= 1;
+    if (ok)
+    {
+        vector<uint8_t> bits((nBlock + 7) / 8);
+        ok = fread(bits.data(), 1, bits.size(), fp) == bits.size();
+        done.assign(nBlock, false);
+        for (long long b = 0; ok && b < nBlock; b++)
+            done[b] = (bits[b / 8] >> (b % 8)) & 1;
+    }
+    uint32_t nPartial = 0;
+    get(fp, nPartial, ok);
+    ok = ok && nPartial <= nBlock;
+    partial.assign(ok ? nPartial : 0, BlockState());
+    for (size_t i = 0; ok && i < partial.size(); i++)
+    {
+        BlockState &state = partial[i];
+        uint32_t nCard = 0;
+        get(fp, state.block, ok);
+        get(fp, state.round, ok);
+        get(fp, nCard, ok);
+        ok = ok && nCard == (uint32_t)shoe.nDeck * 52 && state.block >= 0 &&
+             state.block < nBlock;
+        if (ok)
+        {
+            state.decks.cards.resize(nCard);
+            ok = fread(state.decks.cards.data(), 1, nCard, fp) == nCard;
+        }
+        get(fp, state.decks.current, ok);
+        get(fp, state.decks.rng, ok);
+    }
+    fclose(fp);
+    // The progress of the run is kept rather than started over.
+    if (!ok)
+        throw BadCheckpoint();
+    return true;
+}
+
+Checkpointer::Checkpointer(const string &file1, double interval1,
+                           const Checkpoint &start1, int nWorker)
+    : file(file1), interval(interval1), origin(start1), done(start1.done),
+      slots(nWorker), requested(0), stopping(false), nSaved(0)
+{
+}
+
+Checkpointer::~Checkpointer()
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    answer.notify_all();
+    if (thread.joinable())
+        thread.join();
+}
+
+void Checkpointer::start()
+{
+    thread = std::thread(&Checkpointer::run, this);
+}
+
+void Checkpointer::publish(int w, const SimulationResult &result,
+                           vector<long long> &finished, long long block,
+                           long long round, const Decks *decks)
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        Slot &slot = slots[w];
+        slot.epoch = requested.load(memory_order_relaxed);
+        slot.result = result;
+        for (size_t i = 0; i < finished.size(); i++)
+            done[finished[i]] = true;
+        slot.busy = block >= 0;
+        slot.retired = block < 0;
+        if (slot.busy)
+        {
+            slot.current.block = block;
+            slot.current.round = round;
+            decks->snapshot(slot.current.decks);
+        }
+    }
+    finished.clear();
+    answer.notify_all();
+}
+
+bool Checkpointer::finish()
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    answer.notify_all();
+    if (thread.joinable())
+        thread.join();
+    Checkpoint out;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        merge(out);
+    }
+    if (!out.save(file))
+        return false;
+    nSaved++;
+    return true;
+}
+
+void Checkpointer::run()
+{
+    unique_lock<std::mutex> lock(mutex);
+    while (!stopping)
+    {
+        wake.wait_for(lock, chrono::duration<double>(interval));
+        if (stopping)
+            break;
+        // Ask the workers, and wait for all of them to answer.
+        int epoch = ++requested;
+        answer.wait(lock, [&]() {
+            if (stopping)
+                return true;
+            for (size_t w = 0; w < slots.size(); w++)
+                if (!slots[w].retired && slots[w].epoch != epoch)
+                    return false;
+            return true;
+        });
+        if (stopping)
+            break;
+        Checkpoint out;
+        merge(out);
+        // Write without holding the workers up.
+        lock.unlock();
+        bool ok = out.save(file);
+        lock.lock();
+        if (ok)
+            nSaved++;
+    }
+}
+
+void Checkpointer::merge(Checkpoint &out) const
+{
+    out.tag = origin.tag;
+    out.seed = origin.seed;
+    out.nRound = origin.nRound;
+    out.nBlock = origin.nBlock;
+    out.shoe = origin.shoe;
+    out.total = origin.total;
+    out.done = done;
+    out.partial.clear();
+    for (size_t w = 0; w < slots.size(); w++)
+    {
+        out.total.add(slots[w].result);
+        if (slots[w].busy)
+            out.partial.push_back(slots[w].current);
+    }
+    // Blocks in progress at the start that no worker has reported yet
+    // (taken since the last publication, or not taken yet).
+    for (size_t i = 0; i < origin.partial.size(); i++)
+    {
+        long long b = origin.partial[i].block;
+        if (!out.done[b] && !out.inProgress(b))
+            out.partial.push_back(origin.partial[i]);
+    }
+}
@@ -0,0 +1,193 @@
+#ifndef BLACKJACK_CHECKPOINT_H
+#define BLACKJACK_CHECKPOINT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "decks.h"
+#include "simulation_result.h"
+
+// Error exception for a checkpoint of another run, or a file that is not
+// a checkpoint.
+struct BadCheckpoint
+{
+};
+
+// State of a block of rounds in progress (see Simulator): the rounds of
+// the block already played, and the shoe to play the next one with.
+struct BlockState
+{
+    long long block;       // Index of the block.
+    long long round;       // Rounds of the block already played.
+    Decks::Snapshot decks; // The shoe before the next round.
+};
+
+// Complete state of a simulation run (see Simulator::run()), saved in a
+// compact binary file so that an interrupted run can resume bit-exactly.
+// total counts every round played: the finished blocks, and the first
+// rounds of the blocks in progress. A resumed run plays the blocks in
+// progress from their saved shoes, then the blocks not started.
+//
+// File format (native byte order): CHECKPOINT_MAGIC, the version, the
+// tag, the settings of the run, total, the finished blocks as a bitmap,
+// and the blocks in progress with their shoes.
+struct Checkpoint
+{
+    std::string tag;   // Description of the rules and the policy.
+    uint64_t seed;     // Master seed.
+    long long nRound;  // Rounds of the whole run.
+    long long nBlock;  // Blocks of the whole run.
+    ShoeConfig shoe;   // Configuration of every shoe.
+    SimulationResult total;          // Rounds played so far.
+    std::vector<bool> done;          // Finished blocks.
+    std::vector<BlockState> partial; // Blocks in progress.
+
+    Checkpoint() : seed(0), nRound(0), nBlock(0)
+    {
+    }
+
+    // Returns true if other is a checkpoint of the same run.
+    bool sameRun(const Checkpoint &other) const;
+
+    // Returns true if block b is in progress.
+    bool inProgress(long long b) const;
+
+    // Write to file, through a temporary file renamed over it, so that a
+    // crash never leaves a broken checkpoint. Returns false on failure.
+    bool save(const std::string &file) const;
+
+    // Read from file. Returns false if there is no file, and throws
+    // BadCheckpoint if the file cannot be read as a checkpoint.
+    bool load(const std::string &file);
+};
+
+const uint32_t CHECKPOINT_MAGIC = 0x4b434a42; // "BJCK" (little-endian).
+const uint32_t CHECKPOINT_VERSION = 2;
+
+// Class that hands out the blocks left in a run (or in its shard, the
+// blocks first to last - 1): the blocks in progress of a checkpoint first
+// (with their saved state), then the blocks not started, in order. It can
+// be shared by the worker threads.
+class BlockQueue
+{
+public:
+    // Constructor. resume: checkpoint to resume from, or 0.
+    BlockQueue(long long first, long long last,
+               const Checkpoint *resume1 = 0)
+        : nBlock(last), resume(resume1), nextPartial(0), nextBlock(first)
+    {
+    }
+
+    // Take the next block (b) and its saved state (0 if not started).
+    // Returns false if no block is left.
+    bool next(long long &b, const BlockState *&state)
+    {
+        state = 0;
+        if (resume)
+        {
+            size_t i = nextPartial++;
+            if (i < resume->partial.size())
+            {
+                state = &resume->partial[i];
+                b = state->block;
+                return true;
+            }
+        }
+        while ((b = nextBlock++) < nBlock)
+            if (!resume || (!resume->done[b] && !resume->inProgress(b)))
+                return true;
+        return false;
+    }
+
+private:
+    long long nBlock;                // End of the blocks.
+    const Checkpoint *resume;        // Checkpoint resumed from, or 0.
+    std::atomic<size_t> nextPartial; // Next block in progress.
+    std::atomic<long long> nextBlock; // Next block to check.
+};
+
+// Class that saves checkpoints of a run in the background.
+// Every interval, its thread asks the workers for their state. Each
+// worker copies its state into its own slot between two rounds (see
+// publish()) and goes on, and the thread merges the slots with the
+// checkpoint resumed from, then writes the file, so that no worker ever
+// waits for the disk.
+class Checkpointer
+{
+public:
+    // Constructor. start: the state the run starts from (with the
+    // settings of the run); nWorker: number of worker threads.
+    Checkpointer(const std::string &file1, double interval1,
+                 const Checkpoint &start1, int nWorker);
+
+    // Destructor. Stops the thread.
+    ~Checkpointer();
+
+    // Start the thread.
+    void start();
+
+    // Returns true if worker w should publish its state. Called by the
+    // worker between rounds; costs a relaxed atomic load.
+    bool pending(int w) const
+    {
+        return requested.load(std::memory_order_relaxed) != slots[w].epoch;
+    }
+
+    // Publish the state of worker w: its rounds so far, the blocks it
+    // finished since its last publication (finished is cleared), and its
+    // block in progress (block < 0 if none: the worker is done).
+    void publish(int w, const SimulationResult &result,
+                 std::vector<long long> &finished, long long block,
+                 long long round, const Decks *decks);
+
+    // Stop the thread and write the final state, once the workers are
+    // done. Returns false if the file could not be written.
+    bool finish();
+
+    // Number of checkpoints written.
+    int saved() const
+    {
+        return nSaved;
+    }
+
+private:
+    // State published by a worker.
+    struct Slot
+    {
+        int epoch;               // Last request answered.
+        bool retired;            // true once the worker is done.
+        SimulationResult result; // Rounds played by the worker.
+        bool busy;               // true if a block is in progress.
+        BlockState current;      // The block in progress.
+
+        Slot() : epoch(0), retired(false), busy(false)
+        {
+        }
+    };
+
+    // Loop of the thread.
+    void run();
+
+    // Merge the slots into a checkpoint (with the mutex held).
+    void merge(Checkpoint &out) const;
+
+    std::string file;         // Checkpoint file.
+    double interval;          // Seconds between checkpoints.
+    const Checkpoint &origin; // State the run started from.
+    std::vector<bool> done;   // Finished blocks so far.
+    std::vector<Slot> slots;  // State of every worker.
+    std::atomic<int> requested; // Last request (an increasing epoch).
+    bool stopping;              // true once finish() is called.
+    int nSaved;                 // Checkpoints written.
+    std::mutex mutex;               // Guards everything above.
+    std::condition_variable wake;   // Wakes the thread up early.
+    std::condition_variable answer; // Signals a published state.
+    std::thread thread;             // The thread.
+};
+
+#endif // BLACKJACK_CHECKPOINT_H
@@ -0,0 +1,82 @@
+#include "dealer_odds.h"
+
+using namespace std;
+
+DealerOdds DealerProbabilities::compute(const int counts[N_POINTS + 1],
+                                        int upCard)
+{
+    int work[N_POINTS + 1];
+    int total = 0;
+    for (int i = 1; i <= N_POINTS; i++)
+    {
+        // Counts should fit in the keys of the cache.
+        if (counts[i] < 0 || counts[i] > MAX_COUNT)
+            throw BadNumberDecks();
+        work[i] = counts[i];
+        total += counts[i];
+    }
+    return fromState(work, total, upCard, upCard == 1, true);
+}
+
+DealerOdds DealerProbabilities::compute(int nDeck, int upCard)
+{
+    int counts[N_POINTS + 1];
+    fullShoe(nDeck, counts);
+    counts[upCard]--;
+    return compute(counts, upCard);
+}
+
+void DealerProbabilities::fullShoe(int nDeck, int counts[N_POINTS + 1])
+{
+    if (nDeck < 1)
+        throw BadNumberDecks();
+    counts[0] = 0;
+    for (int i = 1; i < N_POINTS; i++)
+        counts[i] = 4 * nDeck;
+    counts[N_POINTS] = 16 * nDeck;
+}
+
+DealerOdds DealerProbabilities::fromState(int counts[N_POINTS + 1],
+                                          int total, int hard, bool ace,
+                                          bool oneCard)
+{
+    DealerOdds odds;
+    Key key = makeKey(counts, hard, ace, oneCard);
+    unordered_map<Key, DealerOdds, KeyHash>::const_iterator it =
+        cache.find(key);
+    if (it != cache.end())
+        return it->second;
+
+    for (int card = 1; card <= N_POINTS; card++)
+    {
+        if (counts[card] == 0)
+            continue;
+        double p = (double)counts[card] / total;
+        int newHard = hard + card;
+        bool newAce = ace || card == 1;
+        // Ace is counted as 11 if doing so does not make the hand
+        // bust (see Hand::getValue()).
+        bool soft = newAce && newHard < 12;
+        int value = soft ? newHard + 10 : newHard;
+        if (oneCard && value == 21)
+            odds.p[DEALER_GOT_BJ] += p;
+        else if (value > 21)
+            odds.p[DEALER_BUSTS] += p;
+        else if (value >= 17 && !(hitSoft17 && value == 17 && soft))
+            odds.p[DEALER_17 + value - 17] += p;
+        else
+        {
+            counts[card]--;
+            DealerOdds sub =
+                fromState(counts, total - 1, newHard, newAce, false);
+            counts[card]++;
+            for (int i = 0; i < N_DEALER_RESULT; i++)
+                odds.p[i] += p * sub.p[i];
+        }
+    }
+
+    if (memoryUsed() + ENTRY_BYTES > memoryBudget)
+        cache.clear();
+    cache[key] = odds;
+    return odds;
+}
@@ -0,0 +1,141 @@
+#ifndef BLACKJACK_DEALER_ODDS_H
+#define BLACKJACK_DEALER_ODDS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+#include "card.h"
+#include "random.h"
+
+// Final results of the dealer's hand.
+enum DealerResult
+{
+    DEALER_17,        // The dealer stands with 17.
+    DEALER_18,        // The dealer stands with 18.
+    DEALER_19,        // The dealer stands with 19.
+    DEALER_20,        // The dealer stands with 20.
+    DEALER_21,        // The dealer stands with 21 (not the blackjack).
+    DEALER_BUSTS,     // The dealer got busted.
+    DEALER_GOT_BJ,    // The dealer got the blackjack.
+    N_DEALER_RESULT   // Number of results.
+};
+
+// Probabilities of the dealer's final results.
+// If the given cards run out before the dealer stands, the missing
+// probability is the chance of running out of cards.
+struct DealerOdds
+{
+    double p[N_DEALER_RESULT];
+
+    DealerOdds()
+    {
+        for (int i = 0; i < N_DEALER_RESULT; i++)
+            p[i] = 0;
+    }
+};
+
+// Class that computes the exact probabilities of the dealer's final
+// results (S17 or H17 rule, as in dealerPlay()) for a face-up card and the
+// composition of the cards not dealt yet (see Decks::rankCounts()),
+// where the hidden card is drawn from those cards as well.
+// Every state (composition and dealer's hand) is memoized, so repeated
+// queries are table lookups. The cache is cleared when it would exceed
+// the memory budget. An instance should be used by one thread at a time.
+class DealerProbabilities
+{
+public:
+    // Constructor. memoryBudget: maximum bytes used by the cache;
+    // hitSoft17: the dealer hits a soft 17 (H17 rule).
+    DealerProbabilities(size_t memoryBudget1 = DEFAULT_BUDGET,
+                        bool hitSoft171 = false)
+        : cache(), memoryBudget(memoryBudget1), hitSoft17(hitSoft171)
+    {
+    }
+
+    // Compute the probabilities for a face-up card (points 1~10) and the
+    // cards not dealt yet counted by points (counts[1]~counts[10]).
+    // Each count should be at most MAX_COUNT (up to 15 full decks);
+    // throws BadNumberDecks otherwise.
+    DealerOdds compute(const int counts[N_POINTS + 1], int upCard);
+
+    // Compute the probabilities for a face-up card (points 1~10) dealt
+    // from a full shoe of nDeck decks.
+    DealerOdds compute(int nDeck, int upCard);
+
+    // Count the cards of a full shoe of nDeck decks by points.
+    static void fullShoe(int nDeck, int counts[N_POINTS + 1]);
+
+    // Number of states in the cache.
+    size_t cacheSize() const
+    {
+        return cache.size();
+    }
+
+    // Approximate bytes used by the cache.
+    size_t memoryUsed() const
+    {
+        return cache.size() * ENTRY_BYTES +
+               cache.bucket_count() * sizeof(void *);
+    }
+
+    // Remove all states from the cache.
+    void clear()
+    {
+        cache.clear();
+    }
+
+    static const size_t DEFAULT_BUDGET = 64 << 20; // 64 MB.
+    static const int MAX_COUNT = 255; // Most cards of the same points.
+
+private:
+    // Key of a state: the counts of the cards by points and the dealer's
+    // hand (hard total, ace, and whether only one card is held).
+    struct Key
+    {
+        uint64_t low;  // counts[1]~counts[8], one byte each.
+        uint64_t high; // counts[9], counts[10], and the hand.
+
+        bool operator==(const Key &other) const
+        {
+            return low == other.low && high == other.high;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key &k) const
+        {
+            uint64_t state = k.low ^ (k.high * 0x9E3779B97F4A7C15ULL);
+            return splitmix64(state);
+        }
+    };
+
+    // Approximate bytes of one entry of the cache (with its node).
+    static const size_t ENTRY_BYTES =
+        sizeof(Key) + sizeof(DealerOdds) + 2 * sizeof(void *);
+
+    static Key makeKey(const int counts[N_POINTS + 1], int hard, bool ace,
+                       bool oneCard)
+    {
+        Key k;
+        k.low = 0;
+        for (int i = 1; i <= 8; i++)
+            k.low |= (uint64_t)counts[i] << (8 * (i - 1));
+        k.high = (uint64_t)counts[9] | (uint64_t)counts[10] << 8 |
+                 (uint64_t)hard << 16 | (uint64_t)ace << 24 |
+                 (uint64_t)oneCard << 25;
+        return k;
+    }
+
+    // Probabilities for the dealer's hand (hard total, ace, one card)
+    // and the cards left (counts, total).
+    DealerOdds fromState(int counts[N_POINTS + 1], int total, int hard,
+                         bool ace, bool oneCard);
+
+    std::unordered_map<Key, DealerOdds, KeyHash> cache; // Memoized states.
+    size_t memoryBudget;                           // Maximum cache bytes.
+    bool hitSoft17;                                // H17 rule.
+};
+
+#endif // BLACKJACK_DEALER_ODDS_H
@@ -0,0 +1,309 @@
+#ifndef BLACKJACK_DECKS_H
+#define BLACKJACK_DECKS_H
+
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "card.h"
+#include "metrics.h"
+#include "random.h"
+#include "shoe_supply.h"
+
+const double DEFAULT_PENETRATION = 0.75; // Fraction of the cards dealt
+// before the cut card comes out.
+
+// Configuration of a shoe: the number of decks, the penetration (the
+// fraction of the cards dealt before the cut card comes out), and
+// whether a continuous shuffling machine is used (all cards are
+// returned to the shoe after every round).
+struct ShoeConfig
+{
+    int nDeck;          // Number of decks (1 or more).
+    double penetration; // Position of the cut card (0 < penetration <= 1).
+    bool continuous;    // true for a continuous shuffling machine.
+
+    ShoeConfig(int nDeck1 = 1, double penetration1 = DEFAULT_PENETRATION,
+               bool continuous1 = false)
+        : nDeck(nDeck1), penetration(penetration1), continuous(continuous1)
+    {
+    }
+};
+
+// Class that represents the decks of cards for the game of blackjack.
+// Any number of decks can be used, and a cut card is placed at the
+// given penetration: once it comes out, the shoe should be shuffled
+// before the next round (see needsShuffle()).
+// Each instance owns its own random generator, so that several decks can
+// be shuffled independently (and reproducibly) in different threads.
+// Shuffling is lazy: shuffle() only collects all cards back, and each
+// deal() does one step of the Fisher-Yates shuffle, picking a random
+// card among the ones not dealt yet. With a ShoeSupply (see setSupply()),
+// shuffle() takes a shoe already shuffled instead, and deal() takes its
+// cards in order.
+class Decks
+{
+public:
+    // Constructor. The number of decks should be given (default=1).
+    Decks(int nDeck = 1)
+        : cards(), current(0), cutCard(0), penetration(DEFAULT_PENETRATION),
+          continuous(false), rng(), supply(0), shuffled(false)
+    {
+        create(nDeck); // create all cards.
+    }
+
+    // Constructor from the configuration of a shoe.
+    Decks(const ShoeConfig &config)
+        : cards(), current(0), cutCard(0), penetration(DEFAULT_PENETRATION),
+          continuous(config.continuous), rng(), supply(0), shuffled(false)
+    {
+        setPenetration(config.penetration);
+        create(config.nDeck);
+    }
+
+    // Create all cards of given number of decks.
+    void create(int nDeck)
+    {
+        if (nDeck < 1)
+            throw BadNumberDecks();
+        cards.resize(nDeck * 52); // size of the array resized.
+        int index = 0;
+        for (int i = 0; i < nDeck; i++)
+            // Creating and storing cards for nDeck decks.
+            for (int n = 1; n <= 13; n++)
+            {
+                cards[index++] = Card(n, 'c').getCode();
+                cards[index++] = Card(n, 's').getCode();
+                cards[index++] = Card(n, 'h').getCode();
+                cards[index++] = Card(n, 'd').getCode();
+            }
+        current = 0;
+        shuffled = false;
+        placeCutCard();
+    }
+
+    // Set the penetration (0 < pen <= 1) and move the cut card.
+    void setPenetration(double pen)
+    {
+        if (!(pen > 0 && pen <= 1))
+            throw BadPenetration();
+        penetration = pen;
+        placeCutCard();
+    }
+
+    // Use (or stop using) a continuous shuffling machine.
+    void setContinuous(bool csm)
+    {
+        continuous = csm;
+    }
+
+    // Returns true if the shoe should be shuffled before the next round
+    // (the cut card came out, or a continuous shuffling machine is used).
+    bool needsShuffle() const
+    {
+        return continuous || current >= cutCard;
+    }
+
+    // Return the number of decks in the shoe.
+    int getNumberDecks() const
+    {
+        return cards.size() / 52;
+    }
+
+    // Return the number of cards dealt since the last shuffle.
+    int position() const
+    {
+        return current;
+    }
+
+    // Return the position of the cut card (see needsShuffle()).
+    int cutCardPosition() const
+    {
+        return cutCard;
+    }
+
+    // Return the number of cards not dealt yet.
+    int remaining() const
+    {
+        return cards.size() - current;
+    }
+
+    // Count the cards not dealt yet by their points
+    // (counts[1]: aces, counts[2]~counts[9], counts[10]: 10, J, Q, K).
+    void rankCounts(int counts[N_POINTS + 1]) const
+    {
+        for (int i = 0; i <= N_POINTS; i++)
+            counts[i] = 0;
+        for (int i = current; i < (int)cards.size(); i++)
+            counts[Card::fromCode(cards[i]).getPoints()]++;
+    }
+
+    // Set the seed of the random generator used for shuffling.
+    void seed(uint64_t s)
+    {
+        rng.seed(s);
+    }
+
+    // Take the shoes from supply1 (0: shuffle them here), which should
+    // outlive the decks. The shoes then come in the order of the supply
+    // whatever the seed (see ShoeSupply).
+    void setSupply(ShoeSupply *supply1)
+    {
+        supply = supply1;
+    }
+
+    // State of the shoe: the order of the cards, the number dealt, and
+    // the random generator (the cut card and the shuffling machine come
+    // from the configuration).
+    struct Snapshot
+    {
+        std::vector<uint8_t> cards; // Packed cards (see Card::getCode()).
+        int current;                // Cards dealt since the last shuffle.
+        uint64_t rng[4];            // State of the random generator.
+    };
+
+    // Copy the state into s (reusing its memory), or restore it, so that
+    // dealing resumes exactly where it stopped.
+    void snapshot(Snapshot &s) const
+    {
+        s.cards.assign(cards.begin(), cards.end());
+        s.current = current;
+        rng.getState(s.rng);
+    }
+
+    void restore(const Snapshot &s)
+    {
+        if (s.cards.empty() || s.cards.size() % 52 != 0 || s.current < 0 ||
+            s.current > (int)s.cards.size())
+            throw BadNumberDecks();
+        cards = s.cards;
+        current = s.current;
+        shuffled = false;
+        rng.setState(s.rng);
+        placeCutCard();
+    }
+
+    // Shuffle all cards in the deck by setting current as 0
+    // (the cards are randomly picked when they are dealt), or exchange
+    // them for a shuffled shoe of the supply.
+    void shuffle()
+    {
+        METRIC_COUNT(shuffles);
+        current = 0;
+        shuffled = supply && supply->exchange(cards);
+    }
+
+    // Swap a random card not dealt yet into the position pointed by
+    // current, deal it, and add 1 to current.
+    Card deal()
+    {
+        METRIC_COUNT(deals);
+        // If all cards are dealt, shuffle cards again.
+        if (current == (int)cards.size())
+            shuffle();
+        if (!shuffled)
+        {
+            int pick = current + rng.below(cards.size() - current);
+            std::swap(cards[current], cards[pick]);
+        }
+        return Card::fromCode(cards[current++]);
+    }
+
+    // Print all cards to out in their current order (only the cards dealt
+    // since the last shuffle are in a shuffled order).
+    void print(std::ostream &out) const
+    {
+        for (int i = 0; i < (int)cards.size(); i++)
+            out << Card::fromCode(cards[i]) << '\n';
+    }
+
+private:
+    // Place the cut card at the penetration (at least one card is dealt).
+    void placeCutCard()
+    {
+        cutCard = (int)(cards.size() * penetration + 0.5);
+        if (cutCard < 1)
+            cutCard = 1;
+    }
+
+    std::vector<uint8_t> cards; // Array for all cards (packed, see Card).
+    int current;           // The pointer for the current card.
+    int cutCard;           // Position of the cut card.
+    double penetration;    // Fraction of the cards dealt before the cut.
+    bool continuous;       // true for a continuous shuffling machine.
+    Random rng;            // Random generator for shuffling.
+    ShoeSupply *supply;    // Supply of shuffled shoes, or 0.
+    bool shuffled;         // true if the cards come from the supply.
+};
+
+// Class that deals the same cards of a shoe to several players, so that
+// they play the very same rounds (see Simulator::runCompare()). The cards
+// are drawn from a Decks once, when first dealt, and kept (packed, see
+// Card::getCode()); seek() goes back to any position of the shoe. It has
+// the members of Decks that the round engine uses (see playRound()), but
+// the caller decides when a new shoe starts (see newShoe()). Every shoe
+// depends only on its seed, not on how many of its cards were dealt.
+class ShoeCursor
+{
+public:
+    // Constructor. source should outlive the cursor.
+    ShoeCursor(Decks &source1)
+        : source(&source1), cards(source1.getNumberDecks() * 52),
+          filled(0), current(0)
+    {
+    }
+
+    // Start a new shoe from its first card: the source is put back in the
+    // initial order and shuffled with the given seed.
+    void newShoe(uint64_t seed)
+    {
+        source->create(source->getNumberDecks());
+        source->seed(seed);
+        filled = 0;
+        current = 0;
+    }
+
+    // Deal the next card from the given position.
+    void seek(int position1)
+    {
+        current = position1;
+    }
+
+    bool needsShuffle() const
+    {
+        return false;
+    }
+
+    void shuffle()
+    {
+    }
+
+    // Return the number of cards dealt since the start of the shoe.
+    int position() const
+    {
+        return current;
+    }
+
+    // Deal the next card. After the last card, the source is shuffled
+    // again (see Decks::deal()) and its cards follow the ones of the shoe.
+    Card deal()
+    {
+        int i = current++;
+        while (filled <= i)
+        {
+            if (filled == (int)cards.size())
+                cards.resize(cards.size() + 52);
+            cards[filled++] = source->deal().getCode();
+        }
+        return Card::fromCode(cards[i]);
+    }
+
+private:
+    Decks *source;              // Decks the cards are drawn from.
+    std::vector<uint8_t> cards; // Cards drawn since the start of the shoe.
+    int filled;                 // Number of cards drawn.
+    int current;                // Cards dealt.
+};
+
+#endif // BLACKJACK_DECKS_H
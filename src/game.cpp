@@ -0,0 +1,718 @@
+#include "game.h"
+
+#include <iostream>
+#include <string>
+
+#include "metrics.h"
+#include "rules.h"
+
+using namespace std;
+
+void Game::play(istream &in, uint64_t seed)
+{
+    start(seed);
+    string line;
+    while (!finished())
+    {
+        if (!getline(in, line))
+            line.clear();
+        input(line.c_str());
+    }
+}
+
+void Game::start(uint64_t seed)
+{
+    // Setting the random seed.
+    myDecks.seed(seed);
+    if (history)
+    {
+        HandRecord seedRecord = HandRecord::seedRecord(0, seed);
+        history->write(&seedRecord, 1);
+    }
+    beginGame(); // (stage1)
+}
+
+void Game::input(const char *line)
+{
+    // extract the first char.
+    char c = firstChar(line, MAX_CHARACTER);
+    switch (stage)
+    {
+    case ASK_DECKS:
+        chooseDecks(c);
+        break;
+    case ASK_START:
+        chooseStart(c);
+        break;
+    case ASK_BET:
+        chooseBet(c);
+        break;
+    case ASK_INSURANCE:
+        chooseInsurance(c);
+        break;
+    case ASK_MOVE:
+        chooseMove(c);
+        break;
+    case ASK_NEXT:
+        chooseNext(c);
+        break;
+    default: // The game is over.
+        break;
+    }
+}
+
+void Game::beginGame()
+{
+    out << "###########################" << '\n';
+    out << "#  The Game of Blackjack  #" << '\n';
+    out << "###########################" << '\n';
+    out << '\n';
+    askDecks();
+}
+
+void Game::askDecks()
+{
+    out << "Choose the number of decks to use ";
+    out << "[1/2/4/6/8] (default: 1):  ";
+    stage = ASK_DECKS;
+}
+
+void Game::chooseDecks(char input)
+{
+    // extract a number from the first char.
+    int nDeck = input - '0';
+    // default value is 1 when no input.
+    if (nDeck == 0)
+        nDeck = 1;
+    // (will be repeated until a right input is given).
+    if (nDeck != 1 && nDeck != 2 && nDeck != 4 && nDeck != 6 && nDeck != 8)
+    {
+        askDecks();
+        return;
+    }
+    out << '\n';
+
+    myDecks.create(nDeck); // Creating the decks of cards.
+    out << nDeck << " deck" << (nDeck == 1 ? "" : "s");
+    out << " (" << 52 * nDeck << " cards) ";
+    out << (nDeck == 1 ? "has" : "have");
+    out << " been created and shuffled." << '\n';
+    out << "You are given " << rules.playerChips;
+    out << " chips now, and you can bet";
+    out << " upto " << rules.maxBet;
+    out << " chips for each round.\n"
+        << '\n';
+    askStart();
+}
+
+void Game::askStart()
+{
+    out << "Type n for a new round, r for rules, ";
+    out << "and q to quit [n/r/q] (default: n): ";
+    stage = ASK_START;
+}
+
+void Game::chooseStart(char input)
+{
+    if (input == '0')
+        input = 'n';
+    if (input == 'r')
+        displayRules();
+    // (will be repeated until a right input is given).
+    if (input != 'n' && input != 'q')
+    {
+        askStart();
+        return;
+    }
+    out << '\n';
+    if (input == 'n')
+        beginRound(); // (stage2)
+    else
+        endGame(); // (stage5)
+}
+
+void Game::beginRound()
+{
+    METRIC_STAGE(STAGE_BEGIN_ROUND);
+    out << "===================================" << '\n';
+    out << "* Starting a New Round (your chips: ";
+    out << nPlayerChip << ").\n"
+        << '\n';
+    askBet(false);
+}
+
+void Game::askBet(bool insufficient)
+{
+    // insufficient: (remaining chips) < nBet for the last input.
+    if (insufficient)
+    {
+        out << "You only have " << nPlayerChip;
+        out << " chip(s)." << '\n';
+    };
+    out << "How many chips do you want to bet? ";
+    out << "[1-" << rules.maxBet << "] (default: 1): ";
+    stage = ASK_BET;
+}
+
+void Game::chooseBet(char input)
+{
+    METRIC_STAGE(STAGE_DEAL);
+    // extract a number from the first char.
+    nBet = input - '0';
+    if (nBet == 0)
+        nBet = 1; // Default is 1.
+    // Check if chips are sufficient.
+    bool insufficient = nBet > nPlayerChip || nBet > nDealerChip;
+    // (will be repeated until a right input is given).
+    if (nBet < 1 || nBet > rules.maxBet || insufficient)
+    {
+        askBet(insufficient);
+        return;
+    }
+    nRound++;
+    record.begin(0, nRound - 1, nBet);
+
+    out << "You bet " << nBet << " chip";
+    out << (nBet == 1 ? "." : "s.") << '\n';
+
+    dealerHand.removeAllCards(); // return all cards
+    playerHands.reset();         // return all cards
+    // Shuffle the cards once the cut card came out.
+    if (myDecks.needsShuffle())
+        myDecks.shuffle();
+    record.position = (uint16_t)myDecks.position();
+
+    // Dealing two cards to each player.
+    Hand &playerHand = playerHands[0];
+    dealerHand.addCard(myDecks.deal());
+    playerHand.addCard(myDecks.deal());
+    dealerHand.addCard(myDecks.deal());
+    playerHand.addCard(myDecks.deal());
+    insured = false;
+    if (canInsure())
+    {
+        // The insurance is offered before the dealer checks the cards.
+        showHands(true);
+        askInsurance();
+        return;
+    }
+    inRound(); // (stage3)
+}
+
+void Game::askInsurance()
+{
+    out << "The dealer shows an ace. Type y to take insurance for half ";
+    out << "of the bet, n to decline [y/n] (default: n): ";
+    stage = ASK_INSURANCE;
+}
+
+void Game::chooseInsurance(char input)
+{
+    // Default is n (no insurance).
+    if (input == '0')
+        input = 'n';
+    // (will be repeated until a right input is given).
+    if (input != 'y' && input != 'n')
+    {
+        askInsurance();
+        return;
+    }
+    insured = input == 'y';
+    inRound(); // (stage3)
+}
+
+bool Game::affords(int units) const
+{
+    int stake = insured ? nBet * CHIP_UNITS / 2 : 0;
+    for (int i = 0; i < playerHands.size(); i++)
+        stake += nBet * playerHands.bet(i) * CHIP_UNITS;
+    return stake + units <= nPlayerChip * CHIP_UNITS &&
+           stake + units <= nDealerChip * CHIP_UNITS;
+}
+
+void Game::inRound()
+{
+    METRIC_STAGE(STAGE_IN_ROUND);
+    Hand &playerHand = playerHands.active();
+    if (!playerHands.isSplit())
+    {
+        // Check for the blackjack.
+        // Then stop the round automatically.
+        if (playerHand.blackjack())
+        {
+            out << "You got the blackjack!" << '\n';
+            finishHand('j');
+            return;
+        };
+
+        // With the peek rule, the dealer's blackjack ends the round at
+        // once.
+        if (rules.peek && dealerHand.blackjack())
+        {
+            finishHand('k');
+            return;
+        }
+    }
+    // A split hand gets its second card when its turn comes.
+    if (playerHand.size() == 1)
+        playerHand.addCard(myDecks.deal());
+
+    // Check for the player busting
+    // (if busted, stop the hand).
+    if (playerHand.busted())
+    {
+        finishHand('b');
+        return;
+    }
+    // A doubled hand takes one card, and so do split aces (unless they
+    // are split again).
+    int current = playerHands.activeIndex();
+    if (playerHands.doubled(current) ||
+        (playerHands.splitAces(current) && !canSplit()))
+    {
+        finishHand('s');
+        return;
+    }
+
+    // Show hands (with dealer's first card hidden).
+    showHands(true);
+    askMove();
+}
+
+void Game::askMove()
+{
+    if (playerHands.splitAces(playerHands.activeIndex()))
+    {
+        // Split aces can only be split again or stand.
+        out << "Type p to split again, s for Stand, r for ";
+        out << "rules, q to quit [p/s/r/q] (default: s): ";
+        stage = ASK_MOVE;
+        return;
+    }
+    out << "Type h for Hit, s for Stand, ";
+    if (canDouble())
+        out << "d to double, ";
+    if (canSplit())
+        out << "p to split, ";
+    if (canSurrender())
+        out << "u to surrender, ";
+    out << "r for ";
+    out << "rules, q to quit [h/s/";
+    if (canDouble())
+        out << "d/";
+    if (canSplit())
+        out << "p/";
+    if (canSurrender())
+        out << "u/";
+    out << "r/q] ";
+    out << "(default: h): ";
+    stage = ASK_MOVE;
+}
+
+void Game::chooseMove(char input)
+{
+    bool splitAces = playerHands.splitAces(playerHands.activeIndex());
+    // Default is h(Hit), or s(Stand) for split aces.
+    if (input == '0')
+        input = splitAces ? 's' : 'h';
+    if (input == 'r')
+        displayRules(); // for rules.
+    // (will be repeated until a right input is given).
+    if ((input != 'h' || splitAces) && input != 's' && input != 'q' &&
+        (input != 'u' || !canSurrender()) &&
+        (input != 'd' || !canDouble()) && (input != 'p' || !canSplit()))
+    {
+        askMove();
+        return;
+    }
+    record.decide(input);
+
+    Hand &playerHand = playerHands.active();
+    // Add a card for "Hit", and go on with the round.
+    if (input == 'h')
+    {
+        playerHand.addCard(myDecks.deal());
+        inRound();
+    }
+    // Double the bet for exactly one more card.
+    else if (input == 'd')
+    {
+        playerHands.doubleDown();
+        out << "You doubled the bet." << '\n';
+        playerHand.addCard(myDecks.deal());
+        inRound();
+    }
+    // Split the pair into two hands, and play on the first one.
+    else if (input == 'p')
+    {
+        playerHands.split();
+        out << "You split the pair (" << playerHands.size();
+        out << " hands)." << '\n';
+        playerHand.addCard(myDecks.deal());
+        inRound();
+    }
+    // There are three cases for ending a hand:
+    // (1) player busting (see inRound()),
+    // (2) player stands (input == 's') or surrenders (input == 'u'),
+    // (3) player forces to quit while playing.
+    else
+        finishHand(input);
+}
+
+void Game::finishHand(char in)
+{
+    playerHands.finish(in);
+    // Quitting ends the round with all hands.
+    if (in != 'q' && playerHands.next())
+        inRound();
+    else
+        endRound(); // (stage4)
+}
+
+void Game::endRound()
+{
+    METRIC_STAGE(STAGE_END_ROUND);
+    bool stood = false, quit = false;
+    for (int i = 0; i < playerHands.size(); i++)
+    {
+        stood = stood || playerHands.way(i) == 's';
+        quit = quit || playerHands.way(i) == 'q';
+    }
+    // If the player stands, the dealer plays the hand (S17 rule, or H17).
+    if (stood && !quit)
+        dealerPlay(dealerHand, myDecks, rules);
+    // Units gained by the player, rounded down to chips at the end.
+    int units = 0;
+    if (insured)
+        units += quit ? -nBet * CHIP_UNITS / 2
+                      : insuranceUnits(dealerHand) * nBet;
+    for (int i = 0; i < playerHands.size(); i++)
+    {
+        Outcome result = quit ? PLAYER_QUIT
+                              : settle(playerHands.way(i), playerHands[i],
+                                       dealerHand);
+        playerHands.setOutcome(i, result);
+        units += payoffUnits(result, rules) * nBet * playerHands.bet(i);
+    }
+    int chips = unitsToChips(units); // chips gained by the player.
+    if (history)
+    {
+        record.end(playerHands[0], dealerHand, playerHands.outcome(0),
+                   chips * CHIP_UNITS);
+        history->write(&record, 1);
+    }
+
+    if (quit)
+    { // if the player quits the game.
+        out << "\nYou lost " << -chips << " chips.";
+        out << '\n';
+        takeChips(chips);
+        endGame(); // (stage5)
+        return;
+    }
+    if (!playerHands.isSplit() && playerHands.outcome(0) == PLAYER_BUST)
+    { // if the player is busted, only the player's hand is shown.
+        out << "\nYou have:\t ";
+        playerHands[0].print(out);
+    }
+    else
+        showHands(); // Show cards.
+
+    for (int i = 0; i < playerHands.size(); i++)
+    {
+        if (playerHands.isSplit())
+            out << "Hand " << i + 1 << ": ";
+        int bet = nBet * playerHands.bet(i);
+        Outcome result = playerHands.outcome(i);
+        showResult(result, bet, payoff(result, bet, rules));
+    }
+    if (insured && dealerHand.blackjack())
+        out << "The insurance paid " << nBet << " chips." << '\n';
+    else if (insured)
+        out << "You lost the insurance (half of the bet)." << '\n';
+    takeChips(chips);
+
+    out << "\n* End of the Round (your chips: ";
+    out << nPlayerChip << ")." << '\n';
+    out << "===================================" << '\n';
+
+    // If all chips are used up, the game ends.
+    if (nPlayerChip <= 0 || nDealerChip <= 0)
+        endGame(); // (stage5)
+    else
+        askNext();
+}
+
+void Game::showResult(Outcome result, int bet, int chips)
+{
+    switch (result)
+    {
+    case PLAYER_BUST:
+        out << "You got busted, and lost ";
+        out << bet << " chips." << '\n';
+        break;
+    case BLACKJACK_TIE:
+    case PUSH:
+        out << "It is tied, and the bet is ";
+        out << "returned." << '\n';
+        break;
+    case PLAYER_BLACKJACK:
+        out << "You won, and gained ";
+        out << chips << " chips." << '\n';
+        break;
+    case PLAYER_SURRENDER:
+        out << "You surrendered, and lost ";
+        out << -chips << " chips." << '\n';
+        break;
+    case DEALER_BUST:
+        out << "Dealer got busted, and you ";
+        out << "gained " << bet;
+        out << " chips." << '\n';
+        break;
+    case DEALER_WIN:
+        if (dealerHand.blackjack())
+        {
+            out << "Dealer got the ";
+            out << "blackjack!\n";
+        }
+        out << "Dealer won, and you lost ";
+        out << bet << " chips." << '\n';
+        break;
+    case PLAYER_WIN:
+        out << "You won, and you gained ";
+        out << bet << " chips." << '\n';
+        break;
+    default: // DEALER_BLACKJACK
+        out << "Dealer got the ";
+        out << "blackjack! ";
+        out << "You lost " << bet;
+        out << " chips." << '\n';
+        break;
+    }
+}
+
+void Game::askNext()
+{
+    out << "\nType n for a new round, r for rules";
+    out << ", q to quit [n/r/q] (default: n): ";
+    stage = ASK_NEXT;
+}
+
+void Game::chooseNext(char input)
+{
+    // Default is n(new round).
+    if (input == '0')
+        input = 'n';
+    if (input == 'r')
+        displayRules(); // Rules.
+    // (will be repeated until a right input is given).
+    if (input != 'n' && input != 'q')
+        askNext();
+    else if (input == 'n')
+        beginRound(); // (stage2)
+    else
+        endGame(); // (stage5)
+}
+
+void Game::endGame()
+{
+    out << "\nYour remaining chips: " << nPlayerChip;
+    out << " (you ";
+    int diff = nPlayerChip - rules.playerChips;
+    if (diff > 0)
+        out << "gained " << diff << " chips).";
+    else if (diff < 0)
+        out << "lost " << -diff << " chips).";
+    else
+        out << "have the same number of chips as started).";
+    out << '\n'
+        << '\n';
+    out << "###########################" << '\n';
+    out << "#     End of the Game     #" << '\n';
+    out << "###########################" << '\n';
+    stage = FINISHED;
+}
+
+void Game::displayRules()
+{
+    out << '\n';
+    out << "===================================" << '\n';
+    out << "# How to play the game of Blackjack. " << '\n';
+    out << "\n\tThere are two players: a dealer, ";
+    out << "played by a computer, ";
+    out << "and a player, played by you. ";
+    out << "\nThe game will be played as many ";
+    out << "rounds as the player can or wants, ";
+    out << "and the winner is determined ";
+    out << "each round. \nAt the beginning of the game, ";
+    out << "the player chooses ";
+    out << "how many decks are used for all rounds, ";
+    out << "where each deck ";
+    out << "consists of 52 cards, 13 for each suit ";
+    out << "(Club, Spade, Heart, and Diamond); ";
+    out << "here the number of decks can be 1, 2, 4, 6 or 8. ";
+    out << "\nThe cards are shuffled once the cut card, placed ";
+    out << "after " << (int)(DEFAULT_PENETRATION * 100);
+    out << "% of the cards, comes out. ";
+    out << "\nYou, the player, start with " << rules.playerChips;
+    out << " chips and ";
+    out << "can bet at least 1 chip each round. ";
+    out << "\nThe maximum number of chips a player can bet ";
+    out << "at each round is set at " << rules.maxBet;
+    out << " chips here. \nThe dealer is assumed to have ";
+    out << rules.dealerChips << " chips in the beginning. ";
+    out << "\nIf either the player or the dealer loses all ";
+    out << "chips, the game ends.\n\n";
+    out << "\tAt each round, the objective of the player ";
+    out << "is to win the bet by creating a card total ";
+    out << "that is higher than the value of ";
+    out << "the dealer's hand, but not exceeding 21 ";
+    out << "(called, \"busting\"). ";
+    out << "\nThe value of a hand is determined by summing ";
+    out << "over values of all ";
+    out << "cards in a hand: 2~10 have the same values ";
+    out << "as the face values, ";
+    out << "while J, Q, and K (face cards) are counted ";
+    out << "as 10 and an ace, A, ";
+    out << "can be counted as 1 or 11. The suits of the ";
+    out << "cards don't have any meaning.\n\n";
+    out << "\tOnce the amount of the bet is chosen for ";
+    out << "each round, ";
+    out << "two cards are dealt at the beginning of the ";
+    out << "round: both cards of the player are revealed,";
+    out << " while only one card is revealed for the ";
+    out << "dealer. ";
+    out << "\nThe player has two options: Hit or Stand.\n";
+    out << "\n(1) Hit: Take another card from the dealer.";
+    out << "\nIf the player's hand ";
+    out << "is not busted by exceeding 21, ";
+    out << "the player has another chance ";
+    out << "to choose to hit or stand,\n\n";
+    out << "(2) Stand: Take no more card. ";
+    out << "\nThen, the player's value is ";
+    out << "determined by summing over all cards in ";
+    out << "the hand (An ace, A, can be either 1 or 11, ";
+    out << "whichever is better).\n\n";
+    out << "\tIf the player gets busted by exceeding 21, ";
+    out << "the dealer wins. If the player choose to ";
+    out << "stand at a value 21 or lower, ";
+    out << "the dealer should hit until the value is ";
+    out << "17 or greater (the ace, A, is counted as 11 ";
+    out << "as long as the sum is less than 21, ";
+    if (rules.hitSoft17)
+    {
+        out << "but the dealer hits a soft 17, which is ";
+        out << "called \"H17\" rule). ";
+    }
+    else
+    {
+        out << "even when the sum becomes 17, which is ";
+        out << "called \"S17\" rule). ";
+    }
+    out << "\nIf the dealer gets busted, the player wins. ";
+    out << "\nIf both are not busted, ";
+    out << "the winner is determined by comparing values;";
+    out << " the player wins ";
+    out << "if the player's value is greater, and the ";
+    out << "dealer wins if the dealer's value is greater.";
+    out << " If tied, the bet is returned to the player.";
+    out << "\n\n\tIf the first two cards has the value ";
+    out << "21 by having an ace and ";
+    out << "a 10-valued card (10 or J or Q or K), ";
+    out << "it's called the \"Blackjack\" and ";
+    out << "wins every hand except another blackjack (if ";
+    out << "both get blackjacks, it's a tie).";
+    if (rules.blackjackNum != rules.blackjackDen)
+        out << " A blackjack pays " << rules.blackjackNum << ':'
+            << rules.blackjackDen << " (rounded down to whole chips).";
+    if (rules.peek)
+        out << "\nThe dealer checks for a blackjack before you move, "
+            << "and a dealer's blackjack ends the round at once.";
+    if (rules.surrender)
+        out << "\nWith the first two cards, you can also surrender "
+            << "(u) and lose half of the bet (rounded up).";
+    if (rules.doubleDown)
+        out << "\nWith the first two cards"
+            << (rules.doubleAfterSplit ? " (of a split hand too)" : "")
+            << ", you can double down (d): double the bet and take "
+            << "exactly one more card.";
+    if (rules.splitHands > 1)
+        out << "\nA pair (two cards of the same value) can be split (p) "
+            << "into two hands with a bet each, up to "
+            << rules.splitHands << " hands; split aces take one card "
+            << "each" << (rules.resplitAces ? " unless split again." : ".")
+            << " A split hand of 21 is not a blackjack.";
+    if (rules.insurance)
+        out << "\nWhen the dealer shows an ace, you can take insurance "
+            << "for half of the bet (y), which pays 2:1 if the dealer "
+            << "has the blackjack.";
+    out << "\n\n\n";
+    out << "# Card representation.\n\n";
+    out << "The ranks: A (ace), 2, 3, 4, 5, 6, 7, 8, 9, ";
+    out << "10, J, Q, K.\n";
+    out << "The suits: c (club), s (spade), h (heart), ";
+    out << "d (diamond).\n\n";
+    out << "Then, for example, A(s) stands for the spade ";
+    out << "ace, 10(d) stands for the diamond 10, ";
+    out << "and Q(h) stands for the heart queen.\n\n\n";
+    out << "# Player inputs.\n\n";
+    out << "\tThe player can give inputs using keyboards ";
+    out << "at the prompt, and only the first character ";
+    out << "(excluding white spaces) of a line, followed ";
+    out << "by Enter, will be regarded as a valid input. ";
+    out << "Possible input characters are: n (new round),";
+    out << " r (rules), h (hit), s (stand), ";
+    if (rules.doubleDown)
+        out << "d (double), ";
+    if (rules.splitHands > 1)
+        out << "p (split), ";
+    if (rules.surrender)
+        out << "u (surrender), ";
+    if (rules.insurance)
+        out << "y/n (insurance), ";
+    out << "q (quit), ";
+    out << "and 1~8 (size of the bet, number of decks).\n";
+    out << "===================================" << '\n';
+    out << '\n';
+}
+
+char Game::firstChar(const char *temp, int size)
+{
+    int i = 0;
+    // skipping white spaces.
+    while (i < size && temp[i] != '\0' &&
+           (temp[i] == ' ' || temp[i] == '\t' || temp[i] == '\n'))
+        i++;
+    // If there is no character in temp, return '0'.
+    if (temp[i] == '\0' || i >= size)
+        return '0';
+    else
+        return temp[i];
+}
+
+void Game::showHands(bool hideFirst)
+{
+    out << "\nDealer has:\t ";
+    dealerHand.print(out, hideFirst);
+    if (!playerHands.isSplit())
+    {
+        out << "You have:\t ";
+        playerHands[0].print(out);
+    }
+    else
+        for (int i = 0; i < playerHands.size(); i++)
+        {
+            out << "Hand " << i + 1;
+            if (hideFirst && i == playerHands.activeIndex())
+                out << " (playing)";
+            out << ":\t ";
+            playerHands[i].print(out);
+        }
+    out << '\n';
+}
+
+void Game::takeChips(int amount)
+{
+    nPlayerChip += amount;
+    nDealerChip -= amount;
+}
@@ -0,0 +1,211 @@
+#ifndef BLACKJACK_GAME_H
+#define BLACKJACK_GAME_H
+
+#include <cstdint>
+#include <iostream>
+
+#include "decks.h"
+#include "hand.h"
+#include "history.h"
+#include "player_hands.h"
+#include "rules.h"
+
+// Some global constants.
+const int MAX_CHARACTER = 100; // Maximum number of characters in a line
+// to be used for standard input.
+
+// Class that represents the game (displaying texts using an output stream,
+// and managing the flow of the game using 5 stages).
+// The game is a state machine driven by the player's input lines: start()
+// writes the texts up to the first prompt, and input() handles one line
+// and writes the texts up to the next prompt, until finished().
+// Only the first character (excluding white spaces) of an input line is
+// assumed to be the only user input to reduce confusions.
+// The rules and the limits of chips come from a RuleConfig (the original
+// game's rules by default).
+class Game
+{
+
+private:
+    // Prompts of the game, waiting for an input line.
+    enum Stage
+    {
+        ASK_DECKS,     // Number of decks (stage 1).
+        ASK_START,     // New round, rules or quit (stage 1).
+        ASK_BET,       // Amount of the bet (stage 2).
+        ASK_INSURANCE, // Insurance or not (stage 3).
+        ASK_MOVE,      // Hit, stand, rules or quit (stage 3).
+        ASK_NEXT,      // New round, rules or quit (stage 4).
+        FINISHED       // The game is over (stage 5).
+    };
+
+    std::ostream &out;            // Stream for all texts of the game.
+    RuleConfig rules;             // Rules and limits of the game.
+    Decks myDecks;                // All cards for the game.
+    PlayerHands playerHands;      // Hands of the player (after splits).
+    Hand dealerHand;              // Hand of the dealer.
+    int nPlayerChip, nDealerChip; // Numbers of chips for players.
+    int nBet;                     // Bet of the current round.
+    bool insured;                 // true if the player took insurance.
+    int nRound;                   // Number of rounds played.
+    Stage stage;                  // Prompt waiting for an input.
+    HistoryWriter *history;       // Hand history (none if null).
+    HandRecord record;            // Record of the current round.
+
+public:
+    // Constructor. Texts are written to out1.
+    Game(std::ostream &out1 = std::cout,
+         const RuleConfig &rules1 = RuleConfig())
+        : out(out1), rules(rules1), myDecks(), playerHands(), dealerHand()
+    {
+        nPlayerChip = rules.playerChips;
+        nDealerChip = rules.dealerChips;
+        nBet = 0;
+        insured = false;
+        nRound = 0;
+        stage = FINISHED;
+        history = 0;
+    }
+
+    // Record every round in a hand history (before start()).
+    void setHistory(HistoryWriter *history1)
+    {
+        history = history1;
+    }
+
+    // Take the shoes from a supply shuffling them in the background (see
+    // Decks::setSupply()).
+    void setShoeSupply(ShoeSupply *supply)
+    {
+        myDecks.setSupply(supply);
+    }
+
+    // Manage the flow of the game, reading input lines from in
+    // (an empty line is assumed after the end of in).
+    void play(std::istream &in, uint64_t seed);
+
+    // Start the game with the seed for shuffling (stage 1).
+    void start(uint64_t seed);
+
+    // Handle an input line given at the current prompt.
+    void input(const char *line);
+
+    // Returns true if the game is over.
+    bool finished() const
+    {
+        return stage == FINISHED;
+    }
+
+    // Return the number of rounds played.
+    int roundsPlayed() const
+    {
+        return nRound;
+    }
+
+    // A function that extracts a first character from a c-string
+    // (returns '0' if none exists).
+    // temp: character array, size: size of temp.
+    static char firstChar(const char *temp, int size);
+
+private:
+    // Beginning of the game (stage 1).
+    void beginGame();
+
+    // Handle the number of decks (stage 1).
+    void chooseDecks(char input);
+
+    // Handle the input at the beginning of the game (n, r, q).
+    // (n: next round, r: rule, q: quit.)
+    void chooseStart(char input);
+
+    // Beginning of a round (stage 2).
+    void beginRound();
+
+    // Handle the amount of bet (1-5).
+    void chooseBet(char input);
+
+    // Returns true if the player may take insurance.
+    bool canInsure() const
+    {
+        return rules.insurance && dealerHand.getCard(1).getPoints() == 1 &&
+               affords(nBet * CHIP_UNITS / 2);
+    }
+
+    // Handle the answer to insurance (y, n).
+    void chooseInsurance(char input);
+
+    // Middle of a round (stage 3): ends the hand being played on the
+    // blackjack or busting, or asks the player to move.
+    void inRound();
+
+    // Returns true if the player may surrender, double or split the hand
+    // being played now.
+    bool canSurrender() const
+    {
+        return rules.surrender && !playerHands.isSplit() &&
+               playerHands.active().size() == 2;
+    }
+
+    bool canDouble() const
+    {
+        return rules.doubleDown && playerHands.active().size() == 2 &&
+               (!playerHands.isSplit() || rules.doubleAfterSplit) &&
+               !playerHands.splitAces(playerHands.activeIndex()) &&
+               affords(nBet * CHIP_UNITS);
+    }
+
+    bool canSplit() const
+    {
+        return playerHands.canSplit(rules.splitHands, rules.resplitAces) &&
+               affords(nBet * CHIP_UNITS);
+    }
+
+    // Returns true if both players have the chips for the bets of the
+    // round and units more (see CHIP_UNITS).
+    bool affords(int units) const;
+
+    // Handle the move of the player (h, s, d, p, u, r, q).
+    // (h: hit, s: stand, d: double, p: split, u: surrender, r: rules,
+    // q: quit).
+    void chooseMove(char input);
+
+    // End the hand being played, and play the next one or end the round
+    // (in: b (busted), q (quit), j (blackjack), s (stand), u (surrender),
+    // k (the dealer peeked at a blackjack)).
+    void finishHand(char in);
+
+    // End of a round (stage 4).
+    void endRound();
+
+    // Show the result of a hand with a bet of chips (chips: the chips
+    // gained for the hand).
+    void showResult(Outcome result, int bet, int chips);
+
+    // Handle the input at the end of a round (n, r, q).
+    void chooseNext(char input);
+
+    // End of the game (Stage 5)
+    void endGame();
+
+    // Prompts waiting for an input line.
+    void askDecks();
+    void askStart();
+    void askBet(bool insufficient);
+    void askInsurance();
+    void askMove();
+    void askNext();
+
+    // Display rules.
+    void displayRules();
+
+    // Show hands of both players
+    // (if hideFirst==true, the first card will not be shown, and the hand
+    // being played is marked if the player split).
+    void showHands(bool hideFirst = false);
+
+    // Chips changing hands.
+    // (amount > 0: dealer to player; < 0, player to dealer).
+    void takeChips(int amount);
+};
+
+#endif // BLACKJACK_GAME_H
@@ -0,0 +1,117 @@
+#ifndef BLACKJACK_HAND_H
+#define BLACKJACK_HAND_H
+
+#include <cstdint>
+#include <iostream>
+
+#include "card.h"
+#include "hand_state.h"
+
+// Class that represents a hand of a player or a dealer.
+// The hand is a state machine (see hand_state.h): every card added moves
+// it to its next state with a table lookup, and the value, soft-ness,
+// busting, blackjack and dealer's checks read the tables of the state.
+// The cards are held inline (a hand never allocates): every card counts
+// at least 1, so a hand holds at most 21 cards without busting (aces of
+// several decks), and one more busts it.
+class Hand
+{
+public:
+    static const int MAX_CARDS = 22; // Most cards of a hand.
+
+    // Constructor.
+    Hand() : state(HAND_EMPTY), nCard(0) {}
+
+    // Add a card to the hand (at most MAX_CARDS).
+    void addCard(Card card)
+    {
+        cardsAtHand[nCard] = card;
+        // Face cards (J, Q, K) give 10 (see HAND_NEXT).
+        state = HAND_NEXT[state][card.getValue()];
+        nCard++;
+    }
+
+    // Compute the value of the hand for the blackjack.
+    // This function will be used to find out the value of the player's
+    // hand, for example, after the player decides to stand
+    // (22 once busted).
+    int getValue() const
+    {
+        // Ace is always counted as 11 if doing so dose not
+        // make the hand bust.
+        return HAND_INFO[state].value;
+    }
+
+    // Returns true if an ace is counted as 11 in the value of the hand.
+    bool isSoft() const
+    {
+        return HAND_INFO[state].flags & HAND_SOFT;
+    }
+
+    // Returns true if the value of the hand exceeds 21.
+    bool busted() const
+    {
+        return state == HAND_BUST;
+    }
+
+    // Returns true if the dealer should hit the hand (below 17, or a
+    // soft 17 if hitSoft17 is true, H17 rule).
+    bool dealerHits(bool hitSoft17) const
+    {
+        return HAND_INFO[state].flags &
+               (hitSoft17 ? HAND_HIT_H17 : HAND_HIT_S17);
+    }
+
+    // Return the state of the hand (see hand_state.h).
+    int getState() const
+    {
+        return state;
+    }
+
+    // Return the number of cards of the hand.
+    int size() const
+    {
+        return nCard;
+    }
+
+    // Return the i-th card of the hand (0 <= i < size()).
+    Card getCard(int i) const
+    {
+        return cardsAtHand[i];
+    }
+
+    // Returns true if the hand is "blackjack"
+    // (getting the value 21 with 2 cards).
+    bool blackjack() const
+    {
+        return state == HAND_BLACKJACK;
+    }
+
+    // Remove all cards of the hand.
+    void removeAllCards()
+    {
+        state = HAND_EMPTY;
+        nCard = 0;
+    }
+
+    // print the cards in the hand to out.
+    // (if hideFirst==true, the first card will not be shown).
+    void print(std::ostream &out, bool hideFirst = false) const
+    {
+        if (nCard == 0)
+            out << "No card." << '\n';
+        for (int i = 0; i < nCard; i++)
+            if (i == 0 && hideFirst)
+                out << "?(?) ";
+            else
+                out << cardsAtHand[i] << ' ';
+        out << '\n';
+    }
+
+private:
+    Card cardsAtHand[MAX_CARDS]; // Array of cards in a hand (1 byte each).
+    uint8_t state;               // State of the hand (see HAND_NEXT).
+    uint8_t nCard;               // Number of cards in the hand.
+};
+
+#endif // BLACKJACK_HAND_H
@@ -0,0 +1,247 @@
+#include "hand_batch.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "hand_batch_kernels.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BLACKJACK_HAVE_SSE2
+#endif
+
+using namespace std;
+
+static void addCardsScalar(uint8_t *hard, uint8_t *ace, uint8_t *nCard,
+                           const uint8_t *codes, size_t n)
+{
+    scalarAddCards(hard, ace, nCard, codes, 0, n);
+}
+
+static void valuesScalar(const uint8_t *hard, const uint8_t *ace,
+                         const uint8_t *, uint8_t *out, size_t n)
+{
+    scalarValues(hard, ace, out, 0, n);
+}
+
+static void softsScalar(const uint8_t *hard, const uint8_t *ace,
+                        const uint8_t *, uint8_t *out, size_t n)
+{
+    scalarSofts(hard, ace, out, 0, n);
+}
+
+static void bustsScalar(const uint8_t *hard, const uint8_t *,
+                        const uint8_t *, uint8_t *out, size_t n)
+{
+    scalarBusts(hard, out, 0, n);
+}
+
+static void blackjacksScalar(const uint8_t *hard, const uint8_t *ace,
+                             const uint8_t *nCard, uint8_t *out, size_t n)
+{
+    scalarBlackjacks(hard, ace, nCard, out, 0, n);
+}
+
+static const BatchKernels SCALAR_KERNELS = {
+    "scalar", addCardsScalar, valuesScalar, softsScalar, bustsScalar,
+    blackjacksScalar};
+
+#ifdef BLACKJACK_HAVE_SSE2
+// SSE2 kernels: 16 hands per step (the same steps as the AVX2 kernels).
+
+static void addCardsSse2(uint8_t *hard, uint8_t *ace, uint8_t *nCard,
+                         const uint8_t *codes, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i rankMask = _mm_set1_epi8(Card::RANK_MASK);
+    const __m128i ten = _mm_set1_epi8(10);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i c = _mm_loadu_si128((const __m128i *)(codes + i));
+        // Points: the rank, with face cards counting as 10.
+        __m128i points = _mm_min_epu8(_mm_and_si128(c, rankMask), ten);
+        __m128i isAce = _mm_and_si128(_mm_cmpeq_epi8(points, one), one);
+        __m128i hasCard = _mm_andnot_si128(_mm_cmpeq_epi8(c, zero), one);
+        __m128i *h = (__m128i *)(hard + i);
+        __m128i *a = (__m128i *)(ace + i);
+        __m128i *k = (__m128i *)(nCard + i);
+        _mm_storeu_si128(h, _mm_add_epi8(_mm_loadu_si128(h), points));
+        _mm_storeu_si128(a, _mm_or_si128(_mm_loadu_si128(a), isAce));
+        _mm_storeu_si128(k, _mm_add_epi8(_mm_loadu_si128(k), hasCard));
+    }
+    scalarAddCards(hard, ace, nCard, codes, i, n);
+}
+
+// Mask of the soft hands (an ace, and a hard total below 12).
+static inline __m128i softMask(__m128i h, __m128i a)
+{
+    __m128i below12 = _mm_cmpeq_epi8(_mm_min_epu8(h, _mm_set1_epi8(11)), h);
+    return _mm_and_si128(below12, _mm_cmpeq_epi8(a, _mm_set1_epi8(1)));
+}
+
+static void valuesSse2(const uint8_t *hard, const uint8_t *ace,
+                       const uint8_t *, uint8_t *out, size_t n)
+{
+    const __m128i ten = _mm_set1_epi8(10);
+    const __m128i bust = _mm_set1_epi8(22);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i h = _mm_loadu_si128((const __m128i *)(hard + i));
+        __m128i a = _mm_loadu_si128((const __m128i *)(ace + i));
+        __m128i v = _mm_add_epi8(h, _mm_and_si128(softMask(h, a), ten));
+        // (A soft value is at most 21, so only busted hands are cut.)
+        _mm_storeu_si128((__m128i *)(out + i), _mm_min_epu8(v, bust));
+    }
+    scalarValues(hard, ace, out, i, n);
+}
+
+static void softsSse2(const uint8_t *hard, const uint8_t *ace,
+                      const uint8_t *, uint8_t *out, size_t n)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i h = _mm_loadu_si128((const __m128i *)(hard + i));
+        __m128i a = _mm_loadu_si128((const __m128i *)(ace + i));
+        _mm_storeu_si128((__m128i *)(out + i),
+                         _mm_and_si128(softMask(h, a), one));
+    }
+    scalarSofts(hard, ace, out, i, n);
+}
+
+static void bustsSse2(const uint8_t *hard, const uint8_t *,
+                      const uint8_t *, uint8_t *out, size_t n)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i limit = _mm_set1_epi8(21);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i h = _mm_loadu_si128((const __m128i *)(hard + i));
+        __m128i notBusted = _mm_cmpeq_epi8(_mm_min_epu8(h, limit), h);
+        _mm_storeu_si128((__m128i *)(out + i),
+                         _mm_andnot_si128(notBusted, one));
+    }
+    scalarBusts(hard, out, i, n);
+}
+
+static void blackjacksSse2(const uint8_t *hard, const uint8_t *ace,
+                           const uint8_t *nCard, uint8_t *out, size_t n)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i two = _mm_set1_epi8(2);
+    const __m128i eleven = _mm_set1_epi8(11);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i h = _mm_loadu_si128((const __m128i *)(hard + i));
+        __m128i a = _mm_loadu_si128((const __m128i *)(ace + i));
+        __m128i k = _mm_loadu_si128((const __m128i *)(nCard + i));
+        __m128i bj = _mm_and_si128(_mm_cmpeq_epi8(k, two),
+                                   _mm_cmpeq_epi8(h, eleven));
+        _mm_storeu_si128((__m128i *)(out + i),
+                         _mm_and_si128(bj, _mm_and_si128(a, one)));
+    }
+    scalarBlackjacks(hard, ace, nCard, out, i, n);
+}
+
+static const BatchKernels SSE2_KERNELS = {
+    "sse2", addCardsSse2, valuesSse2, softsSse2, bustsSse2, blackjacksSse2};
+#endif
+
+// Pick the best kernels supported by the processor.
+static const BatchKernels &pickKernels()
+{
+#ifdef BLACKJACK_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        return AVX2_KERNELS;
+#endif
+#ifdef BLACKJACK_HAVE_SSE2
+    return SSE2_KERNELS;
+#else
+    return SCALAR_KERNELS;
+#endif
+}
+
+// Kernels chosen with HandBatch::useKernels(), if any.
+static const BatchKernels *chosen = 0;
+
+// Kernels used by all batches (picked once, unless chosen).
+static const BatchKernels &kernels()
+{
+    static const BatchKernels &k = getenv("BLACKJACK_SCALAR")
+                                       ? SCALAR_KERNELS
+                                       : pickKernels();
+    return chosen ? *chosen : k;
+}
+
+void HandBatch::removeAllCards()
+{
+    fill(hardTotal.begin(), hardTotal.end(), 0);
+    fill(ace.begin(), ace.end(), 0);
+    fill(nCard.begin(), nCard.end(), 0);
+}
+
+void HandBatch::addCards(const uint8_t *codes)
+{
+    kernels().addCards(hardTotal.data(), ace.data(), nCard.data(), codes,
+                       size());
+}
+
+void HandBatch::values(uint8_t *out) const
+{
+    kernels().values(hardTotal.data(), ace.data(), nCard.data(), out,
+                     size());
+}
+
+void HandBatch::softs(uint8_t *out) const
+{
+    kernels().softs(hardTotal.data(), ace.data(), nCard.data(), out,
+                    size());
+}
+
+void HandBatch::busts(uint8_t *out) const
+{
+    kernels().busts(hardTotal.data(), ace.data(), nCard.data(), out,
+                    size());
+}
+
+void HandBatch::blackjacks(uint8_t *out) const
+{
+    kernels().blackjacks(hardTotal.data(), ace.data(), nCard.data(), out,
+                         size());
+}
+
+const char *HandBatch::kernelName()
+{
+    return kernels().name;
+}
+
+bool HandBatch::useKernels(const char *name)
+{
+    if (!name)
+    {
+        chosen = 0;
+        return true;
+    }
+    const BatchKernels *supported[3] = {&SCALAR_KERNELS, 0, 0};
+#ifdef BLACKJACK_HAVE_SSE2
+    supported[1] = &SSE2_KERNELS;
+#endif
+#ifdef BLACKJACK_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        supported[2] = &AVX2_KERNELS;
+#endif
+    for (int k = 0; k < 3; k++)
+        if (supported[k] && strcmp(supported[k]->name, name) == 0)
+        {
+            chosen = supported[k];
+            return true;
+        }
+    return false;
+}
@@ -0,0 +1,105 @@
+#ifndef BLACKJACK_HAND_BATCH_H
+#define BLACKJACK_HAND_BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "card.h"
+
+// Class that represents many independent hands, evaluated all at once.
+// The hands are stored as structure-of-arrays (one byte per hand for the
+// hard total, the ace flag and the number of cards), so that adding cards
+// and the value, soft, bust and blackjack checks run over the whole batch
+// with SIMD kernels (AVX2 or SSE2, picked at run time, with a scalar
+// fallback; the environment variable BLACKJACK_SCALAR forces the scalar
+// kernels). Results are the same as the ones of Hand for every hand.
+class HandBatch
+{
+public:
+    // Constructor. Makes n hands without cards.
+    HandBatch(size_t n = 0) : hardTotal(n), ace(n), nCard(n) {}
+
+    // Return the number of hands.
+    size_t size() const
+    {
+        return nCard.size();
+    }
+
+    // Change the number of hands (new hands have no cards).
+    void resize(size_t n)
+    {
+        hardTotal.resize(n);
+        ace.resize(n);
+        nCard.resize(n);
+    }
+
+    // Remove all cards of every hand.
+    void removeAllCards();
+
+    // Add one card to every hand: codes[i] is the packed card for the i-th
+    // hand (see Card::getCode()), or 0 to add no card to it.
+    void addCards(const uint8_t *codes);
+
+    // Add a card to the i-th hand.
+    void addCard(size_t i, Card card)
+    {
+        int points = card.getPoints();
+        hardTotal[i] += points;
+        ace[i] |= points == 1;
+        nCard[i]++;
+    }
+
+    // Write a result for every hand to out (size() bytes):
+    // the values (see Hand::getValue()), and 1 or 0 for the soft hands,
+    // the busted hands and the blackjacks.
+    void values(uint8_t *out) const;
+    void softs(uint8_t *out) const;
+    void busts(uint8_t *out) const;
+    void blackjacks(uint8_t *out) const;
+
+    // Results for the i-th hand.
+    int getValue(size_t i) const
+    {
+        if (busted(i))
+            return 22;
+        return isSoft(i) ? hardTotal[i] + 10 : hardTotal[i];
+    }
+
+    bool isSoft(size_t i) const
+    {
+        return ace[i] && hardTotal[i] < 12;
+    }
+
+    bool busted(size_t i) const
+    {
+        return hardTotal[i] > 21;
+    }
+
+    bool blackjack(size_t i) const
+    {
+        return nCard[i] == 2 && ace[i] && hardTotal[i] == 11;
+    }
+
+    // Return the number of cards of the i-th hand.
+    int handSize(size_t i) const
+    {
+        return nCard[i];
+    }
+
+    // Return the name of the kernels used ("avx2", "sse2" or "scalar").
+    static const char *kernelName();
+
+    // Use the kernels of the given name for all batches from now on (0:
+    // the ones picked at start), for comparing them. Returns false if the
+    // processor does not support them. Not to be called while batches
+    // are evaluated in other threads.
+    static bool useKernels(const char *name);
+
+private:
+    std::vector<uint8_t> hardTotal; // Sum of the points (aces count as 1).
+    std::vector<uint8_t> ace;       // 1 if an ace exists in the hand.
+    std::vector<uint8_t> nCard;     // Number of cards in the hand.
+};
+
+#endif // BLACKJACK_HAND_BATCH_H
@@ -0,0 +1,113 @@
+#include "hand_batch_kernels.h"
+
+#include <immintrin.h>
+
+// AVX2 kernels of HandBatch: 32 hands per step.
+
+static void addCardsAvx2(uint8_t *hard, uint8_t *ace, uint8_t *nCard,
+                         const uint8_t *codes, size_t n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i rankMask = _mm256_set1_epi8(Card::RANK_MASK);
+    const __m256i ten = _mm256_set1_epi8(10);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(codes + i));
+        // Points: the rank, with face cards counting as 10.
+        __m256i points = _mm256_min_epu8(_mm256_and_si256(c, rankMask), ten);
+        __m256i isAce = _mm256_and_si256(_mm256_cmpeq_epi8(points, one), one);
+        __m256i hasCard = _mm256_andnot_si256(_mm256_cmpeq_epi8(c, zero), one);
+        __m256i *h = (__m256i *)(hard + i);
+        __m256i *a = (__m256i *)(ace + i);
+        __m256i *k = (__m256i *)(nCard + i);
+        _mm256_storeu_si256(h,
+                            _mm256_add_epi8(_mm256_loadu_si256(h), points));
+        _mm256_storeu_si256(a,
+                            _mm256_or_si256(_mm256_loadu_si256(a), isAce));
+        _mm256_storeu_si256(k,
+                            _mm256_add_epi8(_mm256_loadu_si256(k), hasCard));
+    }
+    scalarAddCards(hard, ace, nCard, codes, i, n);
+}
+
+// Mask of the soft hands (an ace, and a hard total below 12).
+static inline __m256i softMask(__m256i h, __m256i a)
+{
+    __m256i below12 = _mm256_cmpeq_epi8(
+        _mm256_min_epu8(h, _mm256_set1_epi8(11)), h);
+    return _mm256_and_si256(below12,
+                            _mm256_cmpeq_epi8(a, _mm256_set1_epi8(1)));
+}
+
+static void valuesAvx2(const uint8_t *hard, const uint8_t *ace,
+                       const uint8_t *, uint8_t *out, size_t n)
+{
+    const __m256i ten = _mm256_set1_epi8(10);
+    const __m256i bust = _mm256_set1_epi8(22);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i h = _mm256_loadu_si256((const __m256i *)(hard + i));
+        __m256i a = _mm256_loadu_si256((const __m256i *)(ace + i));
+        __m256i v = _mm256_add_epi8(h, _mm256_and_si256(softMask(h, a), ten));
+        // (A soft value is at most 21, so only busted hands are cut.)
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_min_epu8(v, bust));
+    }
+    scalarValues(hard, ace, out, i, n);
+}
+
+static void softsAvx2(const uint8_t *hard, const uint8_t *ace,
+                      const uint8_t *, uint8_t *out, size_t n)
+{
+    const __m256i one = _mm256_set1_epi8(1);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i h = _mm256_loadu_si256((const __m256i *)(hard + i));
+        __m256i a = _mm256_loadu_si256((const __m256i *)(ace + i));
+        _mm256_storeu_si256((__m256i *)(out + i),
+                            _mm256_and_si256(softMask(h, a), one));
+    }
+    scalarSofts(hard, ace, out, i, n);
+}
+
+static void bustsAvx2(const uint8_t *hard, const uint8_t *,
+                      const uint8_t *, uint8_t *out, size_t n)
+{
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i limit = _mm256_set1_epi8(21);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i h = _mm256_loadu_si256((const __m256i *)(hard + i));
+        __m256i notBusted = _mm256_cmpeq_epi8(_mm256_min_epu8(h, limit), h);
+        _mm256_storeu_si256((__m256i *)(out + i),
+                            _mm256_andnot_si256(notBusted, one));
+    }
+    scalarBusts(hard, out, i, n);
+}
+
+static void blackjacksAvx2(const uint8_t *hard, const uint8_t *ace,
+                           const uint8_t *nCard, uint8_t *out, size_t n)
+{
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi8(2);
+    const __m256i eleven = _mm256_set1_epi8(11);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i h = _mm256_loadu_si256((const __m256i *)(hard + i));
+        __m256i a = _mm256_loadu_si256((const __m256i *)(ace + i));
+        __m256i k = _mm256_loadu_si256((const __m256i *)(nCard + i));
+        __m256i bj = _mm256_and_si256(_mm256_cmpeq_epi8(k, two),
+                                      _mm256_cmpeq_epi8(h, eleven));
+        _mm256_storeu_si256((__m256i *)(out + i),
+                            _mm256_and_si256(bj, _mm256_and_si256(a, one)));
+    }
+    scalarBlackjacks(hard, ace, nCard, out, i, n);
+}
+
+extern const BatchKernels AVX2_KERNELS = {
+    "avx2", addCardsAvx2, valuesAvx2, softsAvx2, bustsAvx2, blackjacksAvx2};
@@ -0,0 +1,80 @@
+#ifndef BLACKJACK_HAND_BATCH_KERNELS_H
+#define BLACKJACK_HAND_BATCH_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "card.h"
+
+// Kernels of HandBatch (internal to hand_batch.cpp and
+// hand_batch_avx2.cpp). Every kernel handles n hands stored as
+// structure-of-arrays; the SIMD kernels finish the last hands with the
+// scalar versions below, so all kernels give the same results.
+
+// Kernels of one instruction set.
+struct BatchKernels
+{
+    const char *name;
+    void (*addCards)(uint8_t *hard, uint8_t *ace, uint8_t *nCard,
+                     const uint8_t *codes, size_t n);
+    // Kernels writing a result per hand (value, soft, bust, blackjack).
+    void (*values)(const uint8_t *hard, const uint8_t *ace,
+                   const uint8_t *nCard, uint8_t *out, size_t n);
+    void (*softs)(const uint8_t *hard, const uint8_t *ace,
+                  const uint8_t *nCard, uint8_t *out, size_t n);
+    void (*busts)(const uint8_t *hard, const uint8_t *ace,
+                  const uint8_t *nCard, uint8_t *out, size_t n);
+    void (*blackjacks)(const uint8_t *hard, const uint8_t *ace,
+                       const uint8_t *nCard, uint8_t *out, size_t n);
+};
+
+// Scalar kernels, from the i-th hand.
+inline void scalarAddCards(uint8_t *hard, uint8_t *ace, uint8_t *nCard,
+                           const uint8_t *codes, size_t i, size_t n)
+{
+    for (; i < n; i++)
+    {
+        int points = RANK_POINTS[codes[i] & Card::RANK_MASK];
+        hard[i] += points;
+        ace[i] |= points == 1;
+        nCard[i] += codes[i] != 0;
+    }
+}
+
+// Values are 22 once busted, as the ones of Hand::getValue().
+inline void scalarValues(const uint8_t *hard, const uint8_t *ace,
+                         uint8_t *out, size_t i, size_t n)
+{
+    for (; i < n; i++)
+        out[i] = hard[i] > 21 ? 22
+                              : hard[i] + (ace[i] && hard[i] < 12 ? 10 : 0);
+}
+
+inline void scalarSofts(const uint8_t *hard, const uint8_t *ace,
+                        uint8_t *out, size_t i, size_t n)
+{
+    for (; i < n; i++)
+        out[i] = ace[i] && hard[i] < 12;
+}
+
+inline void scalarBusts(const uint8_t *hard, uint8_t *out, size_t i,
+                        size_t n)
+{
+    for (; i < n; i++)
+        out[i] = hard[i] > 21;
+}
+
+inline void scalarBlackjacks(const uint8_t *hard, const uint8_t *ace,
+                             const uint8_t *nCard, uint8_t *out, size_t i,
+                             size_t n)
+{
+    for (; i < n; i++)
+        out[i] = nCard[i] == 2 && ace[i] && hard[i] == 11;
+}
+
+#if defined(BLACKJACK_HAVE_AVX2)
+// AVX2 kernels (hand_batch_avx2.cpp, compiled with AVX2 enabled).
+extern const BatchKernels AVX2_KERNELS;
+#endif
+
+#endif // BLACKJACK_HAND_BATCH_KERNELS_H
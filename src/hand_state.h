@@ -0,0 +1,114 @@
+#ifndef BLACKJACK_HAND_STATE_H
+#define BLACKJACK_HAND_STATE_H
+
+#include <array>
+#include <cstdint>
+
+// Compile-time state machine of a blackjack hand.
+// Everything about the value of a hand depends on a few dozen states: the
+// hard total (aces counted as 1) with or without an ace, a single 10
+// (which may still make a blackjack), the blackjack, and busting.
+// HAND_NEXT maps a state and the rank of a card (1~13, face cards
+// included) to the next state, and HAND_INFO gives the value and the
+// flags of every state, so that adding a card and every check on a hand
+// are table lookups, with no branching on the cards.
+
+// States: hard + 22 * ace for a hard total of 0~21 (0: no card), then the
+// special states below.
+const int HAND_EMPTY = 0;      // No card.
+const int HAND_ONE_TEN = 44;   // A single 10-valued card.
+const int HAND_BLACKJACK = 45; // An ace and a 10-valued card.
+const int HAND_BUST = 46;      // Busted (the value exceeds 21).
+const int N_HAND_STATES = 47;  // Number of states.
+
+// Flags of a state.
+const uint8_t HAND_SOFT = 1;    // An ace counts as 11 in the value.
+const uint8_t HAND_HIT_S17 = 2; // The dealer hits (S17 rule).
+const uint8_t HAND_HIT_H17 = 4; // The dealer hits (H17 rule).
+
+// Value and flags of a state.
+struct HandStateInfo
+{
+    uint8_t value; // Value of the hand (22 once busted).
+    uint8_t flags; // HAND_SOFT, HAND_HIT_S17 and HAND_HIT_H17.
+};
+
+// Hard total and ace of a state (other than HAND_BUST).
+constexpr int handStateHard(int state)
+{
+    return state == HAND_ONE_TEN     ? 10
+           : state == HAND_BLACKJACK ? 11
+                                     : state % 22;
+}
+
+constexpr bool handStateAce(int state)
+{
+    return state == HAND_BLACKJACK || (state >= 22 && state < 44);
+}
+
+// Next state from a state with a card of the given points (1~10).
+constexpr int nextHandState(int state, int points)
+{
+    if (state == HAND_BUST)
+        return HAND_BUST;
+    if (state == HAND_EMPTY && points == 10)
+        return HAND_ONE_TEN;
+    // (1 + 22: a single ace.)
+    if ((state == 1 + 22 && points == 10) ||
+        (state == HAND_ONE_TEN && points == 1))
+        return HAND_BLACKJACK;
+    int hard = handStateHard(state) + points;
+    bool ace = handStateAce(state) || points == 1;
+    return hard > 21 ? HAND_BUST : hard + 22 * ace;
+}
+
+// Value and flags of a state.
+constexpr HandStateInfo handStateInfo(int state)
+{
+    HandStateInfo info = {22, 0};
+    if (state == HAND_BUST)
+        return info;
+    int hard = handStateHard(state);
+    bool soft = handStateAce(state) && hard < 12;
+    int value = soft ? hard + 10 : hard;
+    info.value = (uint8_t)value;
+    info.flags = (soft ? HAND_SOFT : 0) | (value < 17 ? HAND_HIT_S17 : 0) |
+                 (value < 17 || (value == 17 && soft) ? HAND_HIT_H17 : 0);
+    return info;
+}
+
+// Build the tables below.
+constexpr std::array<std::array<uint8_t, 14>, N_HAND_STATES> makeHandNext()
+{
+    std::array<std::array<uint8_t, 14>, N_HAND_STATES> next{};
+    for (int state = 0; state < N_HAND_STATES; state++)
+        for (int rank = 1; rank <= 13; rank++)
+            next[state][rank] =
+                (uint8_t)nextHandState(state, rank > 10 ? 10 : rank);
+    return next;
+}
+
+constexpr std::array<HandStateInfo, N_HAND_STATES> makeHandInfo()
+{
+    std::array<HandStateInfo, N_HAND_STATES> info{};
+    for (int state = 0; state < N_HAND_STATES; state++)
+        info[state] = handStateInfo(state);
+    return info;
+}
+
+// The tables (HAND_NEXT[state][rank], HAND_INFO[state]).
+inline constexpr std::array<std::array<uint8_t, 14>, N_HAND_STATES>
+    HAND_NEXT = makeHandNext();
+inline constexpr std::array<HandStateInfo, N_HAND_STATES> HAND_INFO =
+    makeHandInfo();
+
+static_assert(HAND_NEXT[HAND_NEXT[HAND_EMPTY][1]][13] == HAND_BLACKJACK,
+              "an ace and a king make a blackjack");
+static_assert(HAND_INFO[HAND_NEXT[HAND_NEXT[HAND_EMPTY][1]][6]].flags ==
+                  (HAND_SOFT | HAND_HIT_H17),
+              "a soft 17 is hit only with H17");
+static_assert(HAND_NEXT[HAND_NEXT[HAND_NEXT[HAND_EMPTY][12]][5]][7] ==
+                  HAND_BUST,
+              "Q, 5 and 7 bust");
+
+#endif // BLACKJACK_HAND_STATE_H
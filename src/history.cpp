@@ -0,0 +1,160 @@
+#include "history.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+// Header of a hand history file (32 bytes, like a record).
+struct HistoryHeader
+{
+    uint32_t magic;      // HISTORY_MAGIC.
+    uint32_t version;    // HISTORY_VERSION.
+    uint32_t recordSize; // sizeof(HandRecord).
+    uint32_t reserved[5];
+};
+static_assert(sizeof(HistoryHeader) == 32, "the header should be 32 bytes");
+
+HistoryWriter::HistoryWriter(const string &file)
+    : fp(fopen(file.c_str(), "ab")), failed(false), mutex()
+{
+    if (!fp)
+        return;
+    fseek(fp, 0, SEEK_END);
+    if (ftell(fp) == 0)
+    {
+        HistoryHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = HISTORY_MAGIC;
+        header.version = HISTORY_VERSION;
+        header.recordSize = sizeof(HandRecord);
+        failed = fwrite(&header, sizeof(header), 1, fp) != 1;
+    }
+}
+
+HistoryWriter::~HistoryWriter()
+{
+    if (fp)
+        fclose(fp);
+}
+
+void HistoryWriter::write(const HandRecord *records, size_t n)
+{
+    if (!fp || n == 0)
+        return;
+    lock_guard<std::mutex> lock(mutex);
+    if (fwrite(records, sizeof(HandRecord), n, fp) != n)
+        failed = true;
+}
+
+void HistorySummary::add(const HistorySummary &other)
+{
+    rounds += other.rounds;
+    net += other.net;
+    for (int i = 0; i <= N_POINTS; i++)
+    {
+        byUpCard[i] += other.byUpCard[i];
+        winsByUpCard[i] += other.winsByUpCard[i];
+        netByUpCard[i] += other.netByUpCard[i];
+    }
+    for (int i = 0; i < 22; i++)
+    {
+        byTotal[i] += other.byTotal[i];
+        netByTotal[i] += other.netByTotal[i];
+    }
+    for (int i = 0; i < 5; i++)
+        byMove[i] += other.byMove[i];
+}
+
+HistoryReader::HistoryReader(const string &file)
+    : ok(false), map(0), mapSize(0), first(0), nRecord(0)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(HistoryHeader))
+    {
+        mapSize = st.st_size;
+        map = mmap(0, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+            map = 0;
+    }
+    close(fd);
+    if (!map)
+        return;
+
+    const HistoryHeader *header = (const HistoryHeader *)map;
+    size_t body = mapSize - sizeof(HistoryHeader);
+    if (header->magic != HISTORY_MAGIC ||
+        header->version != HISTORY_VERSION ||
+        header->recordSize != sizeof(HandRecord) ||
+        body % sizeof(HandRecord) != 0)
+        return;
+    // The records are only scanned in order.
+    madvise(map, mapSize, MADV_SEQUENTIAL);
+    first = (const HandRecord *)(header + 1);
+    nRecord = body / sizeof(HandRecord);
+    ok = true;
+}
+
+HistoryReader::~HistoryReader()
+{
+    if (map)
+        munmap(map, mapSize);
+}
+
+// Aggregate the round records in [begin, end).
+static void summarizeRange(const HandRecord *begin, const HandRecord *end,
+                           HistorySummary &summary)
+{
+    HistorySummary local;
+    for (const HandRecord *r = begin; r != end; r++)
+    {
+        if (r->isSeed())
+            continue;
+        int up = RANK_POINTS[r->dealerCard(1) & Card::RANK_MASK];
+        int first = RANK_POINTS[r->playerCard(0) & Card::RANK_MASK];
+        int second = RANK_POINTS[r->playerCard(1) & Card::RANK_MASK];
+        int total = first + second;
+        if ((first == 1 || second == 1) && total < 12)
+            total += 10; // Soft total.
+        local.rounds++;
+        local.net += r->delta;
+        local.byUpCard[up]++;
+        local.winsByUpCard[up] += r->delta > 0;
+        local.netByUpCard[up] += r->delta;
+        local.byTotal[total]++;
+        local.netByTotal[total] += r->delta;
+        int nKept = min((int)r->nDecision, RECORD_DECISIONS);
+        for (int i = 0; i < nKept; i++)
+            local.byMove[r->move(i)]++;
+    }
+    summary = local;
+}
+
+HistorySummary HistoryReader::summarize(int nThread) const
+{
+    if (nThread <= 0)
+        nThread = thread::hardware_concurrency();
+    if (nThread <= 0)
+        nThread = 1;
+    vector<HistorySummary> parts(nThread);
+    vector<thread> workers;
+    for (int t = 0; t < nThread; t++)
+        workers.push_back(thread(summarizeRange,
+                                 first + nRecord * t / nThread,
+                                 first + nRecord * (t + 1) / nThread,
+                                 ref(parts[t])));
+    HistorySummary total;
+    for (int t = 0; t < nThread; t++)
+    {
+        workers[t].join();
+        total.add(parts[t]);
+    }
+    return total;
+}
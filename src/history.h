@@ -0,0 +1,289 @@
+#ifndef BLACKJACK_HISTORY_H
+#define BLACKJACK_HISTORY_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "decks.h"
+#include "hand.h"
+#include "rules.h"
+
+// Binary hand history: an append-only file of fixed-width records.
+//
+// File format: a 32-byte header (HISTORY_MAGIC, the version and the size
+// of a record), followed by HandRecords in the native byte order.
+// A seed record (outcome == SEED_RECORD) gives the seed of a shoe, and
+// every following round record of that shoe refers to it by its number,
+// so any round can be reproduced from the file.
+
+const uint32_t HISTORY_MAGIC = 0x484a4242; // "BBJH" (little-endian).
+const uint32_t HISTORY_VERSION = 3;
+const int PLAYER_RECORD_CARDS = 7; // Cards kept of the player's hand.
+const int DEALER_RECORD_CARDS = 6; // Cards kept of the dealer's hand.
+const int RECORD_DECISIONS = 8;    // Decisions kept of the player.
+const char RECORD_MOVES[] = "shdpu"; // Decisions by code (see decide()).
+const uint8_t SEED_RECORD = 0xff;  // Outcome of a seed record.
+
+// Record of a round (or of the seed of a shoe), 32 bytes.
+// Cards are packed (see Card::getCode()); only the first cards of a hand
+// and the first decisions are kept (see PLAYER_RECORD_CARDS and
+// RECORD_DECISIONS), while the counts are exact.
+struct HandRecord
+{
+    uint32_t shoe;        // Number of the shoe (simulation block, or 0).
+    uint32_t round;       // Round number since the shoe was seeded.
+    uint16_t position;    // Cards dealt since the last shuffle.
+    int16_t delta;        // Units gained by the player (see CHIP_UNITS).
+    uint16_t decisions;   // Codes of the decisions, 2 bits each.
+    int8_t bet;           // Chips bet.
+    uint8_t outcome;      // Outcome of the round, or SEED_RECORD.
+    uint8_t nPlayerCard;  // Number of cards of the player.
+    uint8_t nDealerCard;  // Number of cards of the dealer.
+    uint8_t nDecision;    // Number of decisions of the player.
+    // Cards of the player, then cards of the dealer.
+    uint8_t cards[PLAYER_RECORD_CARDS + DEALER_RECORD_CARDS];
+
+    // Start the record of a round (the position is set once the shoe is
+    // shuffled, if needed).
+    void begin(uint32_t shoe1, uint32_t round1, int bet1)
+    {
+        shoe = shoe1;
+        round = round1;
+        position = 0;
+        bet = (int8_t)bet1;
+        nDecision = 0;
+        decisions = 0;
+    }
+
+    // Record a decision of the player ('h', 's', 'd', 'p' or 'u') as its
+    // code in RECORD_MOVES. A surrender is kept as a stand: it can only be
+    // the one decision of a round, which its outcome tells (see move()).
+    void decide(char in)
+    {
+        int code = in == 'h' ? 1 : in == 'd' ? 2 : in == 'p' ? 3 : 0;
+        if (nDecision < RECORD_DECISIONS)
+            decisions |= code << (2 * nDecision);
+        if (nDecision < UINT8_MAX)
+            nDecision++;
+    }
+
+    // Return the code in RECORD_MOVES of the i-th decision, which should
+    // be kept (i < nDecision and i < RECORD_DECISIONS).
+    int move(int i) const
+    {
+        if (outcome == PLAYER_SURRENDER)
+            return 4;
+        return (decisions >> (2 * i)) & 3;
+    }
+
+    // Return the i-th decision ('h', 's', 'd', 'p' or 'u'), or 0 if it
+    // is not kept.
+    char decision(int i) const
+    {
+        if (i >= nDecision || i >= RECORD_DECISIONS)
+            return 0;
+        return RECORD_MOVES[move(i)];
+    }
+
+    // Finish the record with the hands and the result of the round
+    // (player: the first hand, if split; result: its outcome; units: the
+    // units gained by the player in the round, see CHIP_UNITS).
+    void end(const Hand &player, const Hand &dealer, Outcome result,
+             int units)
+    {
+        outcome = (uint8_t)result;
+        delta = (int16_t)units;
+        nPlayerCard = (uint8_t)player.size();
+        nDealerCard = (uint8_t)dealer.size();
+        uint8_t *dealerCards = cards + PLAYER_RECORD_CARDS;
+        for (int i = 0; i < PLAYER_RECORD_CARDS; i++)
+            cards[i] = i < player.size() ? player.getCard(i).getCode() : 0;
+        for (int i = 0; i < DEALER_RECORD_CARDS; i++)
+            dealerCards[i] =
+                i < dealer.size() ? dealer.getCard(i).getCode() : 0;
+    }
+
+    // Return the packed i-th card of the player or of the dealer
+    // (0 if not kept).
+    uint8_t playerCard(int i) const
+    {
+        return cards[i];
+    }
+
+    uint8_t dealerCard(int i) const
+    {
+        return cards[PLAYER_RECORD_CARDS + i];
+    }
+
+    // Make a seed record of a shoe.
+    static HandRecord seedRecord(uint32_t shoe, uint64_t seed)
+    {
+        HandRecord r;
+        memset(&r, 0, sizeof(r));
+        r.shoe = shoe;
+        r.outcome = SEED_RECORD;
+        memcpy(r.cards, &seed, sizeof(seed));
+        return r;
+    }
+
+    // Returns true for a seed record.
+    bool isSeed() const
+    {
+        return outcome == SEED_RECORD;
+    }
+
+    // Return the seed of a seed record.
+    uint64_t seed() const
+    {
+        uint64_t s;
+        memcpy(&s, cards, sizeof(s));
+        return s;
+    }
+};
+static_assert(sizeof(HandRecord) == 32, "a hand record should be 32 bytes");
+
+// Class that appends records to a hand history file. It can be shared by
+// several threads (see HistoryBuffer).
+class HistoryWriter
+{
+public:
+    // Constructor. Opens the file for appending (writing the header of a
+    // new file); check good() for errors.
+    HistoryWriter(const std::string &file);
+
+    // Destructor. Closes the file.
+    ~HistoryWriter();
+
+    // Returns true if the file is open and no write failed.
+    bool good() const
+    {
+        return fp && !failed;
+    }
+
+    // Append records to the file.
+    void write(const HandRecord *records, size_t n);
+
+private:
+    HistoryWriter(const HistoryWriter &);
+    HistoryWriter &operator=(const HistoryWriter &);
+
+    FILE *fp;         // The file.
+    bool failed;      // true once a write failed.
+    std::mutex mutex; // Serializes writes of several threads.
+};
+
+// Class that collects records of one thread and writes them in chunks.
+class HistoryBuffer
+{
+public:
+    // Constructor. Records are written to writer1.
+    HistoryBuffer(HistoryWriter &writer1)
+        : writer(writer1), records(CHUNK), n(0)
+    {
+    }
+
+    // Destructor. Writes the remaining records.
+    ~HistoryBuffer()
+    {
+        flush();
+    }
+
+    // Return the next record to fill in.
+    HandRecord &next()
+    {
+        if (n == CHUNK)
+            flush();
+        return records[n++];
+    }
+
+    // Write all collected records.
+    void flush()
+    {
+        writer.write(records.data(), n);
+        n = 0;
+    }
+
+    static const size_t CHUNK = 4096; // Records written at once.
+
+private:
+    HistoryWriter &writer;
+    std::vector<HandRecord> records;
+    size_t n; // Number of records collected.
+};
+
+// Aggregates of the rounds of a hand history.
+struct HistorySummary
+{
+    // (Gains are in units, see CHIP_UNITS.)
+    long long rounds;                 // Number of rounds.
+    long long net;                    // Units gained by the player.
+    long long byUpCard[N_POINTS + 1]; // Rounds by the dealer's up card.
+    long long winsByUpCard[N_POINTS + 1]; // Rounds won by the up card.
+    long long netByUpCard[N_POINTS + 1];  // Units gained by the up card.
+    long long byTotal[22];    // Rounds by the player's first two cards.
+    long long netByTotal[22]; // Units gained by the first two cards.
+    long long byMove[5];      // Decisions kept by code (see RECORD_MOVES).
+
+    HistorySummary() : rounds(0), net(0)
+    {
+        for (int i = 0; i <= N_POINTS; i++)
+            byUpCard[i] = winsByUpCard[i] = netByUpCard[i] = 0;
+        for (int i = 0; i < 22; i++)
+            byTotal[i] = netByTotal[i] = 0;
+        for (int i = 0; i < 5; i++)
+            byMove[i] = 0;
+    }
+
+    // Merge the aggregates of other rounds.
+    void add(const HistorySummary &other);
+};
+
+// Class that maps a hand history file into memory for reading.
+class HistoryReader
+{
+public:
+    // Constructor. Maps the file; check good() for errors (a missing or
+    // bad header, or a size that is not a whole number of records).
+    HistoryReader(const std::string &file);
+
+    // Destructor. Unmaps the file.
+    ~HistoryReader();
+
+    // Returns true if the file is mapped.
+    bool good() const
+    {
+        return ok;
+    }
+
+    // Return the number of records (seed records included).
+    size_t size() const
+    {
+        return nRecord;
+    }
+
+    // Return the records.
+    const HandRecord *records() const
+    {
+        return first;
+    }
+
+    // Aggregate all round records, using nThread threads
+    // (0: all hardware threads).
+    HistorySummary summarize(int nThread = 0) const;
+
+private:
+    HistoryReader(const HistoryReader &);
+    HistoryReader &operator=(const HistoryReader &);
+
+    bool ok;                 // true if the file is mapped.
+    void *map;               // The mapped file.
+    size_t mapSize;          // Size of the mapping.
+    const HandRecord *first; // The first record.
+    size_t nRecord;          // Number of records.
+};
+
+#endif // BLACKJACK_HISTORY_H
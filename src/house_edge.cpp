@@ -0,0 +1,361 @@
+#include "house_edge.h"
+
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "dealer_odds.h"
+#include "simulator.h"
+
+using namespace std;
+
+// Walk of the player's hands against one face-up card (one thread).
+// Every value is the expected chips of a hand times the chance that the
+// dealer has no blackjack if the dealer peeks (those rounds end before
+// the player moves), so that the values of the moves of a hand can be
+// compared directly. The values are memoized by the composition of the
+// cards left; with the face-up card and the first cards fixed, it gives
+// the cards held.
+class HandWalk
+{
+public:
+    HandWalk(int nDeck, int up1, const RuleConfig &rules1,
+             const PolicyRef *policy1)
+        : up(up1), rules(rules1), policy(policy1),
+          dealer(DealerProbabilities::DEFAULT_BUDGET, rules1.hitSoft17),
+          peeks(rules1.peek && (up1 == 1 || up1 == N_POINTS)),
+          win(payoffUnits(PLAYER_WIN, rules1) / (double)CHIP_UNITS),
+          lose(payoffUnits(DEALER_WIN, rules1) / (double)CHIP_UNITS),
+          surrender(payoffUnits(PLAYER_SURRENDER, rules1) /
+                    (double)CHIP_UNITS),
+          blackjack(payoffUnits(PLAYER_BLACKJACK, rules1) /
+                    (double)CHIP_UNITS)
+    {
+        DealerProbabilities::fullShoe(nDeck, counts);
+        counts[up]--;
+        total = 52 * nDeck - 1;
+        for (int i = 0; i <= N_POINTS; i++)
+            held[i] = 0;
+    }
+
+    // Expected chips of the round with the first cards a and b (the
+    // chance of those cards is left to the caller).
+    double round(int a, int b)
+    {
+        take(a), held[a]++;
+        take(b), held[b]++;
+        double ev;
+        if (a + b == 11 && (a == 1 || b == 1))
+            // A tie against the dealer's blackjack.
+            ev = blackjack * (1 - dealerBlackjack());
+        else
+        {
+            // The dealer who peeks ends the round at once.
+            ev = peeks ? lose * dealerBlackjack() : 0;
+            double play = hand(a + b, a == 1 || b == 1, 2, 0);
+            if (a == b && rules.splitHands > 1)
+            {
+                bool yes = policy && decide(0, CAN_SPLIT) == 'p';
+                held[a]--;
+                double split = 2 * splitHand(a, 2);
+                held[a]++;
+                if (policy ? yes : split > play)
+                    play = split;
+            }
+            ev += play;
+        }
+        held[a]--, putBack(a);
+        held[b]--, putBack(b);
+        return ev;
+    }
+
+private:
+    // Key of a hand: the counts of the cards left (one byte each), the
+    // number of cards held and the points of the pair it was split from.
+    struct Key
+    {
+        uint64_t low;  // counts[1]~counts[8].
+        uint64_t high; // counts[9], counts[10], nCard and pair.
+
+        bool operator==(const Key &other) const
+        {
+            return low == other.low && high == other.high;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key &k) const
+        {
+            uint64_t state = k.low ^ (k.high * 0x9E3779B97F4A7C15ULL);
+            return splitmix64(state);
+        }
+    };
+
+    Key makeKey(int nCard, int pair) const
+    {
+        Key k;
+        k.low = 0;
+        for (int i = 1; i <= 8; i++)
+            k.low |= (uint64_t)counts[i] << (8 * (i - 1));
+        k.high = (uint64_t)counts[9] | (uint64_t)counts[10] << 8 |
+                 (uint64_t)nCard << 16 | (uint64_t)pair << 24;
+        return k;
+    }
+
+    void take(int c)
+    {
+        counts[c]--, total--;
+    }
+
+    void putBack(int c)
+    {
+        counts[c]++, total++;
+    }
+
+    // Chance that the hidden card makes a blackjack with the face-up card.
+    double dealerBlackjack() const
+    {
+        if (up != 1 && up != N_POINTS)
+            return 0;
+        return (double)counts[up == 1 ? N_POINTS : 1] / total;
+    }
+
+    // Weight of the rounds the player gets to play (see HandWalk).
+    double played() const
+    {
+        return peeks ? 1 - dealerBlackjack() : 1;
+    }
+
+    // Value of surrendering: half of the bet, or the whole bet against a
+    // dealer's blackjack that was not peeked at (late surrender).
+    double surrendered() const
+    {
+        double bj = dealerBlackjack();
+        return surrender * (1 - bj) + (peeks ? 0 : lose * bj);
+    }
+
+    // Value of standing with a value (the dealer's blackjack beats it).
+    double stand(int value)
+    {
+        DealerOdds odds = dealer.compute(counts, up);
+        double ev = odds.p[DEALER_BUSTS] * win;
+        if (!peeks)
+            ev += odds.p[DEALER_GOT_BJ] * lose;
+        for (int r = 17; r <= 21; r++)
+        {
+            if (value > r)
+                ev += odds.p[DEALER_17 + r - 17] * win;
+            else if (value < r)
+                ev += odds.p[DEALER_17 + r - 17] * lose;
+        }
+        return ev;
+    }
+
+    // Value of the hand held (hard total, ace, number of cards, points of
+    // the pair it was split from or 0), playing it on.
+    double hand(int hard, bool ace, int nCard, int pair)
+    {
+        Key k = makeKey(nCard, pair);
+        unordered_map<Key, double, KeyHash>::const_iterator it =
+            values.find(k);
+        if (it != values.end())
+            return it->second;
+
+        int value = (ace && hard < 12) ? hard + 10 : hard;
+        int moves = 0;
+        if (nCard == 2 && rules.doubleDown &&
+            (pair == 0 || rules.doubleAfterSplit))
+            moves |= CAN_DOUBLE;
+        if (nCard == 2 && pair == 0 && rules.surrender)
+            moves |= CAN_SURRENDER;
+        double ev;
+        if (policy)
+        {
+            // A move that is not allowed is a hit (see playHand()).
+            char in = decide(pair, moves);
+            if (in == 's')
+                ev = stand(value);
+            else if (in == 'd' && (moves & CAN_DOUBLE))
+                ev = doubled(hard, ace);
+            else if (in == 'u' && (moves & CAN_SURRENDER))
+                ev = surrendered();
+            else
+                ev = hit(hard, ace, nCard, pair);
+        }
+        else
+        {
+            ev = max(stand(value), hit(hard, ace, nCard, pair));
+            if (moves & CAN_DOUBLE)
+                ev = max(ev, doubled(hard, ace));
+            if (moves & CAN_SURRENDER)
+                ev = max(ev, surrendered());
+        }
+        values[k] = ev;
+        return ev;
+    }
+
+    // Value of taking one more card and playing on.
+    double hit(int hard, bool ace, int nCard, int pair)
+    {
+        double ev = 0;
+        for (int c = 1; c <= N_POINTS; c++)
+        {
+            if (counts[c] == 0)
+                continue;
+            double p = (double)counts[c] / total;
+            take(c), held[c]++;
+            if (hard + c > 21)
+                ev += p * lose * played();
+            else
+                ev += p * hand(hard + c, ace || c == 1, nCard + 1, pair);
+            held[c]--, putBack(c);
+        }
+        return ev;
+    }
+
+    // Value of doubling: one more card at twice the bet.
+    double doubled(int hard, bool ace)
+    {
+        double ev = 0;
+        for (int c = 1; c <= N_POINTS; c++)
+        {
+            if (counts[c] == 0)
+                continue;
+            double p = (double)counts[c] / total;
+            take(c);
+            int h = hard + c;
+            bool a = ace || c == 1;
+            ev += p * (h > 21 ? lose * played()
+                              : stand((a && h < 12) ? h + 10 : h));
+            putBack(c);
+        }
+        return 2 * ev;
+    }
+
+    // Value of one hand split from a pair of a (the pair is out of the
+    // cards left; held is the first card of this hand), with nHand hands
+    // after the split.
+    double splitHand(int a, int nHand)
+    {
+        bool resplit = nHand < rules.splitHands &&
+                       (a != 1 || rules.resplitAces);
+        double ev = 0;
+        for (int c = 1; c <= N_POINTS; c++)
+        {
+            if (counts[c] == 0)
+                continue;
+            double p = (double)counts[c] / total;
+            take(c), held[c]++;
+            double v;
+            if (a == 1)
+                v = stand(c == 1 ? 12 : 11 + c); // One card each.
+            else
+                v = hand(a + c, a == 1 || c == 1, 2, a);
+            if (c == a && resplit)
+            {
+                held[a]--;
+                double again = 2 * splitHand(a, nHand + 1);
+                held[a]++;
+                int moves = CAN_SPLIT;
+                if (rules.doubleAfterSplit && a != 1)
+                    moves |= CAN_DOUBLE;
+                if (policy ? decide(a, moves) == 'p' : again > v)
+                    v = again;
+            }
+            ev += p * v;
+            held[c]--, putBack(c);
+        }
+        return ev;
+    }
+
+    // Decision of the policy for the cards held (the card of the pair
+    // first, then by points).
+    char decide(int pair, int moves)
+    {
+        Hand player;
+        if (pair)
+            player.addCard(Card(pair, 's'));
+        for (int i = 1; i <= N_POINTS; i++)
+            for (int n = held[i] - (i == pair); n > 0; n--)
+                player.addCard(Card(i, 's'));
+        return policy->decide(player, Card(up, 'h'), moves);
+    }
+
+    int up;                   // Points of the face-up card.
+    const RuleConfig &rules;  // The rules.
+    const PolicyRef *policy;  // Policy, or 0 for the optimal strategy.
+    DealerProbabilities dealer; // Dealer's odds (memoized).
+    bool peeks;               // true if the dealer peeks with this card.
+    double win, lose;         // Chips won when the player wins or loses.
+    double surrender;         // Chips won by surrendering.
+    double blackjack;         // Chips won by the player's blackjack.
+    int counts[N_POINTS + 1]; // Cards left, by points.
+    int total;                // Number of cards left.
+    int held[N_POINTS + 1];   // Cards held by the hand, by points.
+    unordered_map<Key, double, KeyHash> values; // Memoized hands.
+};
+
+HouseEdgeCalculator::HouseEdgeCalculator(int nDeck1, int nThread1)
+    : nDeck(nDeck1), nThread(nThread1)
+{
+    int counts[N_POINTS + 1];
+    DealerProbabilities::fullShoe(nDeck, counts); // checks nDeck.
+    // The dealer's probabilities are computed in the worker threads, so
+    // the shoe is checked here for them.
+    if (counts[N_POINTS] > DealerProbabilities::MAX_COUNT)
+        throw BadNumberDecks();
+    if (nThread <= 0)
+        nThread = thread::hardware_concurrency();
+    if (nThread <= 0)
+        nThread = 1;
+}
+
+HouseEdge HouseEdgeCalculator::compute(const RuleConfig &rules,
+                                       const PolicyRef *policy) const
+{
+    HouseEdge result;
+    atomic<int> nextCard(1);
+    vector<thread> workers;
+    for (int t = 0; t < nThread && t < N_POINTS; t++)
+        workers.push_back(thread(&HouseEdgeCalculator::runCards, this,
+                                 ref(nextCard), cref(rules), policy,
+                                 ref(result)));
+    for (int t = 0; t < (int)workers.size(); t++)
+        workers[t].join();
+
+    for (int up = 1; up <= N_POINTS; up++)
+        result.ev += result.pUpCard[up] * result.evByUpCard[up];
+    return result;
+}
+
+void HouseEdgeCalculator::runCards(atomic<int> &nextCard,
+                                   const RuleConfig &rules,
+                                   const PolicyRef *policy,
+                                   HouseEdge &result) const
+{
+    int up;
+    while ((up = nextCard++) <= N_POINTS)
+    {
+        int counts[N_POINTS + 1];
+        DealerProbabilities::fullShoe(nDeck, counts);
+        int total = 52 * nDeck;
+        result.pUpCard[up] = (double)counts[up] / total;
+        counts[up]--, total--;
+
+        // Every first two cards, weighed by their chance.
+        HandWalk walk(nDeck, up, rules, policy);
+        double ev = 0;
+        for (int a = 1; a <= N_POINTS; a++)
+            for (int b = a; b <= N_POINTS; b++)
+            {
+                double p = (double)counts[a] / total *
+                           (counts[b] - (a == b)) / (total - 1);
+                if (p <= 0)
+                    continue;
+                ev += (a == b ? p : 2 * p) * walk.round(a, b);
+            }
+        result.evByUpCard[up] = ev;
+    }
+}
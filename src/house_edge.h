@@ -0,0 +1,60 @@
+#ifndef BLACKJACK_HOUSE_EDGE_H
+#define BLACKJACK_HOUSE_EDGE_H
+
+#include <atomic>
+
+#include "card.h"
+#include "rules.h"
+
+class PolicyRef;
+
+// Expected return of a round for a 1-chip bet, dealt from a full shoe.
+struct HouseEdge
+{
+    double ev;                       // Expected chips won by the player.
+    double pUpCard[N_POINTS + 1];    // Chance of each dealer's face-up card.
+    double evByUpCard[N_POINTS + 1]; // Expected chips by face-up card.
+
+    HouseEdge() : ev(0)
+    {
+        for (int up = 0; up <= N_POINTS; up++)
+            pUpCard[up] = evByUpCard[up] = 0;
+    }
+};
+
+// Class that computes the expected return of a rule set (see RuleConfig)
+// for a full shoe (see Decks::create()), by walking every draw of the
+// player and of the dealer instead of sampling rounds.
+// For every face-up card, every first two cards are played with the
+// optimal composition-dependent strategy, or with a given policy, and
+// the hands are settled as in Game::endRound() (see payoffUnits()). With
+// a peeking dealer, the draws are weighed by the chance that the hidden
+// card does not make a blackjack. The values of the hands are memoized by
+// the composition of the cards left, and face-up cards are handled in
+// parallel, each thread with its own caches.
+// Everything is exact except splits: a split hand is played on from the
+// shoe without the pair (the cards of the other hands are not removed),
+// and re-splits are valued for each hand on its own. Insurance is never
+// taken.
+class HouseEdgeCalculator
+{
+public:
+    // Constructor. nThread == 0 uses all hardware threads. Throws
+    // BadNumberDecks for a shoe too large for DealerProbabilities.
+    HouseEdgeCalculator(int nDeck1 = 1, int nThread1 = 0);
+
+    // Compute the expected return with the rules, played with the optimal
+    // strategy, or with policy if given.
+    HouseEdge compute(const RuleConfig &rules,
+                      const PolicyRef *policy = 0) const;
+
+private:
+    // Work of a single thread: handle face-up cards until none are left.
+    void runCards(std::atomic<int> &nextCard, const RuleConfig &rules,
+                  const PolicyRef *policy, HouseEdge &result) const;
+
+    int nDeck;   // Number of decks in the shoe.
+    int nThread; // Number of threads.
+};
+
+#endif // BLACKJACK_HOUSE_EDGE_H
@@ -0,0 +1,210 @@
+#include "metrics.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+
+using namespace std;
+
+// The shards of all threads, newest first. A shard is never freed, so that
+// the counts of finished threads still add up.
+static mutex registryMutex;
+static MetricShard *shards = 0;
+
+// Time and ticks at the start of the program, to convert ticks to time.
+struct TickOrigin
+{
+    chrono::steady_clock::time_point time;
+    uint64_t ticks;
+
+    TickOrigin() : time(chrono::steady_clock::now()), ticks(Metrics::ticks())
+    {
+    }
+};
+
+static TickOrigin origin;
+
+MetricShard::MetricShard() : shuffles(0), deals(0), next(0)
+{
+    for (int s = 0; s < N_METRIC_STAGE; s++)
+    {
+        calls[s].store(0, memory_order_relaxed);
+        ticks[s].store(0, memory_order_relaxed);
+        for (int i = 0; i < N_METRIC_BUCKET; i++)
+            buckets[s][i].store(0, memory_order_relaxed);
+    }
+}
+
+MetricShard *Metrics::newShard()
+{
+    MetricShard *shard = new MetricShard();
+    lock_guard<mutex> lock(registryMutex);
+    shard->next = shards;
+    shards = shard;
+    return shard;
+}
+
+MetricTotals Metrics::totals()
+{
+    MetricTotals out = MetricTotals();
+    {
+        lock_guard<mutex> lock(registryMutex);
+        for (MetricShard *shard = shards; shard; shard = shard->next)
+        {
+            for (int s = 0; s < N_METRIC_STAGE; s++)
+            {
+                out.calls[s] += shard->calls[s].load(memory_order_relaxed);
+                out.ticks[s] += shard->ticks[s].load(memory_order_relaxed);
+                for (int i = 0; i < N_METRIC_BUCKET; i++)
+                    out.buckets[s][i] +=
+                        shard->buckets[s][i].load(memory_order_relaxed);
+            }
+            out.shuffles += shard->shuffles.load(memory_order_relaxed);
+            out.deals += shard->deals.load(memory_order_relaxed);
+        }
+    }
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() -
+                                               origin.time)
+                    .count();
+    uint64_t ticks = Metrics::ticks() - origin.ticks;
+    for (int s = 0; s < N_METRIC_STAGE; s++)
+        for (int i = 0; i < N_METRIC_BUCKET; i++)
+            out.timed[s] += out.buckets[s][i];
+    out.nsPerTick = ticks > 0 && ns > 0 ? ns / ticks : 1.0;
+    return out;
+}
+
+// Upper bound of bucket i of the histograms, in ticks.
+static double bucketBound(int i)
+{
+    return (double)(1ULL << i);
+}
+
+void Metrics::writePrometheus(ostream &out)
+{
+    MetricTotals t = totals();
+    double seconds = t.nsPerTick * 1e-9;
+    out << "# HELP blackjack_stage_calls_total Calls of each stage of a "
+           "round.\n"
+        << "# TYPE blackjack_stage_calls_total counter\n";
+    for (int s = 0; s < N_METRIC_STAGE; s++)
+        out << "blackjack_stage_calls_total{stage=\"" << METRIC_STAGE_NAMES[s]
+            << "\"} " << t.calls[s] << "\n";
+    out << "# HELP blackjack_stage_latency_seconds Time spent in each stage "
+           "of a round (nested stages excluded), on 1 in "
+        << METRIC_SAMPLE_PERIOD << " outermost calls.\n"
+        << "# TYPE blackjack_stage_latency_seconds histogram\n";
+    out << setprecision(9);
+    for (int s = 0; s < N_METRIC_STAGE; s++)
+    {
+        string label = string("stage=\"") + METRIC_STAGE_NAMES[s] + "\"";
+        long long count = 0;
+        for (int i = 0; i < N_METRIC_BUCKET; i++)
+        {
+            // The bounds are rounded, so that they keep the same labels
+            // from one export to the next as the calibration moves.
+            count += t.buckets[s][i];
+            out << "blackjack_stage_latency_seconds_bucket{" << label
+                << ",le=\"" << setprecision(3) << bucketBound(i) * seconds
+                << setprecision(9) << "\"} " << count << "\n";
+        }
+        out << "blackjack_stage_latency_seconds_bucket{" << label
+            << ",le=\"+Inf\"} " << t.timed[s] << "\n"
+            << "blackjack_stage_latency_seconds_sum{" << label << "} "
+            << t.ticks[s] * seconds << "\n"
+            << "blackjack_stage_latency_seconds_count{" << label << "} "
+            << t.timed[s] << "\n";
+    }
+    out << "# HELP blackjack_shuffles_total Shuffles of the shoe.\n"
+        << "# TYPE blackjack_shuffles_total counter\n"
+        << "blackjack_shuffles_total " << t.shuffles << "\n"
+        << "# HELP blackjack_cards_dealt_total Cards dealt from the shoe.\n"
+        << "# TYPE blackjack_cards_dealt_total counter\n"
+        << "blackjack_cards_dealt_total " << t.deals << "\n";
+}
+
+bool Metrics::savePrometheus(const string &file)
+{
+    string temp = file + ".tmp";
+    {
+        ofstream out(temp.c_str());
+        if (!out)
+            return false;
+        writePrometheus(out);
+        if (!out.flush())
+        {
+            remove(temp.c_str());
+            return false;
+        }
+    }
+    if (rename(temp.c_str(), file.c_str()) == 0)
+        return true;
+    remove(temp.c_str());
+    return false;
+}
+
+// Latency (in ticks) below which a fraction q of the calls of stage s
+// fall, at the upper bound of its bucket.
+static double percentile(const MetricTotals &t, int s, double q)
+{
+    long long count = 0;
+    for (int i = 0; i < N_METRIC_BUCKET; i++)
+    {
+        count += t.buckets[s][i];
+        if (count >= q * t.timed[s])
+            return bucketBound(i);
+    }
+    return bucketBound(N_METRIC_BUCKET - 1);
+}
+
+void Metrics::writeSummary(ostream &out)
+{
+    MetricTotals t = totals();
+    out << "Stage        Calls        Mean ns   p50 ns    p99 ns\n";
+    for (int s = 0; s < N_METRIC_STAGE; s++)
+    {
+        double mean =
+            t.timed[s] == 0 ? 0.0 : (double)t.ticks[s] / t.timed[s];
+        out << setw(12) << left << METRIC_STAGE_NAMES[s] << right << " "
+            << setw(12) << t.calls[s] << fixed << setprecision(0) << " "
+            << setw(9) << mean * t.nsPerTick << " " << setw(9)
+            << (t.timed[s] ? percentile(t, s, 0.5) * t.nsPerTick : 0.0)
+            << " " << setw(9)
+            << (t.timed[s] ? percentile(t, s, 0.99) * t.nsPerTick : 0.0)
+            << "\n";
+        out.unsetf(ios::fixed);
+    }
+    out << "Shuffles: " << t.shuffles << ", cards dealt: " << t.deals << "\n";
+}
+
+MetricsExporter::MetricsExporter(const string &file1, double interval1)
+    : file(file1), interval(interval1), stopping(false)
+{
+    thread = std::thread(&MetricsExporter::run, this);
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+    Metrics::savePrometheus(file);
+}
+
+void MetricsExporter::run()
+{
+    unique_lock<std::mutex> lock(mutex);
+    while (!stopping)
+    {
+        wake.wait_for(lock, chrono::duration<double>(interval));
+        if (stopping)
+            break;
+        lock.unlock();
+        if (!Metrics::savePrometheus(file))
+            cerr << "*** Cannot write " << file << endl;
+        lock.lock();
+    }
+}
@@ -0,0 +1,236 @@
+#ifndef BLACKJACK_METRICS_H
+#define BLACKJACK_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Instrumentation of the stages of a round (see Game) and of the shoe:
+// calls and latency histograms of every stage, and counts of shuffles and
+// cards dealt. It is built only with BLACKJACK_METRICS defined (CMake
+// option BLACKJACK_METRICS); otherwise the macros below are empty and
+// nothing is measured.
+// Every thread counts into its own shard (aligned on cache lines, with
+// relaxed atomics that compile to plain increments), and the shards are
+// only summed when the metrics are read, so threads never contend.
+// Latencies are taken from the time-stamp counter (the steady clock where
+// there is none) on a sample of the calls (see StageTimer), and are
+// exclusive: the time spent in a nested stage is not counted in the stage
+// that called it.
+
+// Stages of a round.
+enum MetricStage
+{
+    STAGE_BEGIN_ROUND, // Game::beginRound(): start of a round.
+    STAGE_DEAL,        // Game::chooseBet(): bet, shuffle and first cards.
+    STAGE_IN_ROUND,    // Game::inRound(): a move of the player.
+    STAGE_END_ROUND,   // Game::endRound(): the dealer plays, settlement.
+    N_METRIC_STAGE     // Number of stages.
+};
+
+// Names of the stages (as the label of the exported metrics).
+const char *const METRIC_STAGE_NAMES[N_METRIC_STAGE] = {
+    "begin_round", "deal", "in_round", "end_round"};
+
+const int N_METRIC_BUCKET = 40; // Buckets of ticks: [2^(i-1), 2^i).
+const unsigned METRIC_SAMPLE_PERIOD = 64; // Calls per timed call.
+
+// Counts of one thread.
+struct alignas(64) MetricShard
+{
+    std::atomic<long long> calls[N_METRIC_STAGE];
+    // Sum of the latencies and histogram of the calls timed.
+    std::atomic<long long> ticks[N_METRIC_STAGE];
+    std::atomic<long long> buckets[N_METRIC_STAGE][N_METRIC_BUCKET];
+    std::atomic<long long> shuffles; // Calls of Decks::shuffle().
+    std::atomic<long long> deals;    // Calls of Decks::deal().
+    MetricShard *next;               // Next shard (see Metrics).
+
+    MetricShard();
+
+    // Add 1 to a counter of this thread.
+    static void bump(std::atomic<long long> &counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+    }
+
+    // Count a timed call of a stage that took some ticks.
+    void record(int stage, uint64_t spent)
+    {
+        int bucket = 0;
+        while (bucket < N_METRIC_BUCKET - 1 && (spent >> bucket) != 0)
+            bucket++;
+        ticks[stage].store(ticks[stage].load(std::memory_order_relaxed) +
+                               (long long)spent,
+                           std::memory_order_relaxed);
+        bump(buckets[stage][bucket]);
+    }
+};
+
+// Sums of all shards at one moment.
+struct MetricTotals
+{
+    long long calls[N_METRIC_STAGE];
+    long long timed[N_METRIC_STAGE]; // Calls timed.
+    long long ticks[N_METRIC_STAGE];
+    long long buckets[N_METRIC_STAGE][N_METRIC_BUCKET];
+    long long shuffles;
+    long long deals;
+    double nsPerTick; // Nanoseconds per tick of the counter.
+};
+
+// Registry of the shards of all threads.
+class Metrics
+{
+public:
+    // Return the shard of the calling thread (created on first use).
+    static MetricShard &local()
+    {
+        static thread_local MetricShard *shard = 0;
+        if (!shard)
+            shard = newShard();
+        return *shard;
+    }
+
+    // Current ticks of the time-stamp counter (or nanoseconds).
+    static uint64_t ticks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+#endif
+    }
+
+    // Returns true if the instrumentation is built in.
+    static bool enabled()
+    {
+#ifdef BLACKJACK_METRICS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Sum the shards of all threads.
+    static MetricTotals totals();
+
+    // Write the metrics in the Prometheus text format.
+    static void writePrometheus(std::ostream &out);
+
+    // Write them to file (through a temporary file renamed over it).
+    // Returns false on failure.
+    static bool savePrometheus(const std::string &file);
+
+    // Write a readable summary (calls, mean and percentiles by stage).
+    static void writeSummary(std::ostream &out);
+
+private:
+    // Create and register the shard of a thread.
+    static MetricShard *newShard();
+};
+
+// Timer of a stage for the scope of a call (see METRIC_STAGE).
+// Every call is counted, but only one outermost call in
+// METRIC_SAMPLE_PERIOD is timed (with the stages nested in it), since
+// reading the counter costs more than the shortest stages.
+class StageTimer
+{
+public:
+    StageTimer(int stage1)
+        : stage(stage1), parent(current()), spent(0)
+    {
+        if (parent)
+            sampled = parent->sampled;
+        else
+            sampled = ++outerCalls() % METRIC_SAMPLE_PERIOD == 0;
+        if (sampled)
+        {
+            uint64_t now = Metrics::ticks();
+            if (parent)
+                parent->spent += now - parent->begin; // The caller pauses.
+            begin = now;
+        }
+        current() = this;
+    }
+
+    ~StageTimer()
+    {
+        MetricShard &shard = Metrics::local();
+        MetricShard::bump(shard.calls[stage]);
+        current() = parent;
+        if (!sampled)
+            return;
+        uint64_t now = Metrics::ticks();
+        shard.record(stage, spent + now - begin);
+        if (parent)
+            parent->begin = now; // The caller resumes.
+    }
+
+private:
+    StageTimer(const StageTimer &);
+    StageTimer &operator=(const StageTimer &);
+
+    // Innermost timer of the calling thread.
+    static StageTimer *&current()
+    {
+        static thread_local StageTimer *timer = 0;
+        return timer;
+    }
+
+    // Outermost calls of the calling thread.
+    static unsigned &outerCalls()
+    {
+        static thread_local unsigned calls = 0;
+        return calls;
+    }
+
+    int stage;           // Stage timed.
+    StageTimer *parent;  // Timer of the calling stage, if any.
+    bool sampled;        // true if the call is timed.
+    uint64_t begin;      // Ticks when the stage last resumed.
+    uint64_t spent;      // Ticks spent in the stage so far.
+};
+
+// Class that writes the metrics to a file periodically in the background.
+class MetricsExporter
+{
+public:
+    // Constructor. Starts writing file every interval seconds.
+    MetricsExporter(const std::string &file1, double interval1);
+
+    // Destructor. Writes the file a last time and stops.
+    ~MetricsExporter();
+
+private:
+    // Loop of the thread.
+    void run();
+
+    std::string file;             // File written.
+    double interval;              // Seconds between writes.
+    bool stopping;                // true once stopping.
+    std::mutex mutex;             // Guards stopping.
+    std::condition_variable wake; // Wakes the thread up to stop.
+    std::thread thread;           // The thread.
+};
+
+#ifdef BLACKJACK_METRICS
+#define METRIC_STAGE(stage) StageTimer metricTimer(stage)
+#define METRIC_COUNT(counter) MetricShard::bump(Metrics::local().counter)
+#else
+#define METRIC_STAGE(stage) ((void)0)
+#define METRIC_COUNT(counter) ((void)0)
+#endif
+
+#endif // BLACKJACK_METRICS_H
@@ -0,0 +1,175 @@
+#ifndef BLACKJACK_PLAYER_HANDS_H
+#define BLACKJACK_PLAYER_HANDS_H
+
+#include "hand.h"
+#include "rules.h"
+
+// Class that represents the hands of the player in a round: the hand
+// dealt, and the hands split from it (re-splits included).
+// The tree of splits is kept flat in a fixed-capacity array, and the
+// hands are reused from round to round, so splitting never allocates.
+// Hands are played in the order they were created (the active hand is
+// played until it ends, then the next one); each keeps its own bet
+// (doubled or not), the way it ended and its outcome.
+class PlayerHands
+{
+public:
+    static const int MAX_HANDS = 4; // Most hands after splitting.
+
+    // Constructor. There is one empty hand.
+    PlayerHands() : nHand(1), current(0)
+    {
+        reset();
+    }
+
+    // Start a new round with one empty hand.
+    void reset()
+    {
+        hands[0].removeAllCards();
+        states[0] = State();
+        nHand = 1;
+        current = 0;
+    }
+
+    // Return the number of hands.
+    int size() const
+    {
+        return nHand;
+    }
+
+    // Returns true if the first hand was split.
+    bool isSplit() const
+    {
+        return nHand > 1;
+    }
+
+    // Return the i-th hand (0 <= i < size()).
+    Hand &operator[](int i)
+    {
+        return hands[i];
+    }
+
+    const Hand &operator[](int i) const
+    {
+        return hands[i];
+    }
+
+    // Return the hand being played and its number.
+    Hand &active()
+    {
+        return hands[current];
+    }
+
+    const Hand &active() const
+    {
+        return hands[current];
+    }
+
+    int activeIndex() const
+    {
+        return current;
+    }
+
+    // Move to the next hand. Returns false if no hand is left.
+    bool next()
+    {
+        if (current + 1 >= nHand)
+            return false;
+        current++;
+        return true;
+    }
+
+    // Returns true if the active hand is a pair that can be split, with
+    // at most maxHands hands (split aces again only if resplitAces).
+    bool canSplit(int maxHands, bool resplitAces) const
+    {
+        const Hand &hand = hands[current];
+        return nHand < maxHands && hand.size() == 2 &&
+               hand.getCard(0).getPoints() == hand.getCard(1).getPoints() &&
+               (resplitAces || !states[current].splitAces);
+    }
+
+    // Split the active hand (see canSplit()): its second card starts a
+    // new hand, played after the others. Both hands have one card.
+    void split()
+    {
+        Hand &hand = hands[current];
+        Card first = hand.getCard(0), second = hand.getCard(1);
+        hand.removeAllCards();
+        hand.addCard(first);
+        hands[nHand].removeAllCards();
+        hands[nHand].addCard(second);
+        states[nHand] = State();
+        states[current].splitAces = states[nHand].splitAces =
+            first.getPoints() == 1;
+        nHand++;
+    }
+
+    // Double the bet of the active hand.
+    void doubleDown()
+    {
+        states[current].doubled = true;
+    }
+
+    // Returns true if the i-th hand was doubled.
+    bool doubled(int i) const
+    {
+        return states[i].doubled;
+    }
+
+    // Returns true if the i-th hand comes from splitting aces.
+    bool splitAces(int i) const
+    {
+        return states[i].splitAces;
+    }
+
+    // Return the bet of the i-th hand in multiples of the initial bet.
+    int bet(int i) const
+    {
+        return states[i].doubled ? 2 : 1;
+    }
+
+    // End the active hand (in: see settle()).
+    void finish(char in)
+    {
+        states[current].way = in;
+    }
+
+    // Return the way the i-th hand ended.
+    char way(int i) const
+    {
+        return states[i].way;
+    }
+
+    // Set and return the outcome of the i-th hand.
+    void setOutcome(int i, Outcome result)
+    {
+        states[i].outcome = result;
+    }
+
+    Outcome outcome(int i) const
+    {
+        return states[i].outcome;
+    }
+
+private:
+    // State of a hand besides its cards.
+    struct State
+    {
+        bool doubled;    // true if the bet was doubled.
+        bool splitAces;  // true if the hand comes from splitting aces.
+        char way;        // The way the hand ended (see settle()).
+        Outcome outcome; // Outcome of the hand.
+
+        State() : doubled(false), splitAces(false), way('s'), outcome(PUSH)
+        {
+        }
+    };
+
+    Hand hands[MAX_HANDS];   // Hands of the player.
+    State states[MAX_HANDS]; // States of the hands.
+    int nHand;               // Number of hands.
+    int current;             // Number of the hand being played.
+};
+
+#endif // BLACKJACK_PLAYER_HANDS_H
@@ -0,0 +1,143 @@
+#ifndef BLACKJACK_PRECISION_STOP_H
+#define BLACKJACK_PRECISION_STOP_H
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+#include "simulation_result.h"
+
+// Class that stops a run once the expected chips per round are known to a
+// requested precision (the half-width of the confidence interval, see
+// SimulationResult::margin()).
+// Blocks of rounds finish in any order, but the run stops after the
+// shortest prefix of blocks (0, 1, 2, ...) meeting the precision, so that
+// the result for a given seed does not depend on the threads: a worker
+// keeps the results of its blocks aside until the prefix reaches them
+// (see confirmed()), and drops the ones past the stop.
+// The sums of every finished block go to a ring of slots, each published
+// with an atomic flag, and whichever worker finishes a block moves the
+// prefix over the slots ready (one worker at a time, through an atomic
+// flag that is never waited for). No worker waits for another, unless a
+// slow block holds the prefix RING blocks behind.
+class PrecisionStop
+{
+public:
+    static const int RING = 1024; // Blocks finished ahead of the prefix.
+
+    // Constructor. precision: the half-width wanted (in chips), z: the
+    // normal quantile of the interval (1.96 for 95%).
+    PrecisionStop(double precision1, double z1 = 1.96)
+        : precision(precision1), z(z1), frontier(0), stopAt(-1),
+          moving(false), rounds(0), net(0), sumSquares(0)
+    {
+        for (int i = 0; i < RING; i++)
+            slots[i].ready.store(false, std::memory_order_relaxed);
+    }
+
+    // Returns true if block b should be played, false once the run is
+    // stopped (b is then past the stop).
+    bool admit(long long b) const
+    {
+        while (b >= frontier.load(std::memory_order_acquire) + RING)
+        {
+            if (stopped())
+                return false;
+            std::this_thread::yield();
+        }
+        return !stopped();
+    }
+
+    // Returns true once the precision is reached.
+    bool stopped() const
+    {
+        return stopAt.load(std::memory_order_relaxed) >= 0;
+    }
+
+    // Returns true if the results of block b belong to the run: b is in
+    // the prefix (or the run ended without reaching the precision, with
+    // done set).
+    bool confirmed(long long b, bool done = false) const
+    {
+        long long last = stopAt.load(std::memory_order_acquire);
+        if (last >= 0)
+            return b <= last;
+        return done || b < frontier.load(std::memory_order_acquire);
+    }
+
+    // Report the results of finished block b.
+    void finished(long long b, const SimulationResult &block)
+    {
+        Slot &slot = slots[b % RING];
+        slot.rounds = block.rounds;
+        slot.net = block.net;
+        slot.sumSquares = block.sumSquares;
+        slot.ready.store(true, std::memory_order_release);
+        advance();
+    }
+
+    // Number of blocks in the prefix.
+    long long prefix() const
+    {
+        return frontier.load(std::memory_order_acquire);
+    }
+
+private:
+    // Sums of a finished block.
+    struct alignas(64) Slot
+    {
+        std::atomic<bool> ready;
+        long long rounds;
+        long long net;
+        long long sumSquares;
+    };
+
+    // Move the prefix over the blocks ready, checking the precision after
+    // each of them.
+    void advance()
+    {
+        while (!moving.exchange(true, std::memory_order_acquire))
+        {
+            long long f = frontier.load(std::memory_order_relaxed);
+            while (!stopped() &&
+                   slots[f % RING].ready.load(std::memory_order_acquire))
+            {
+                Slot &slot = slots[f % RING];
+                rounds += slot.rounds;
+                net += slot.net;
+                sumSquares += slot.sumSquares;
+                slot.ready.store(false, std::memory_order_relaxed);
+                if (reached())
+                    stopAt.store(f, std::memory_order_release);
+                frontier.store(++f, std::memory_order_release);
+            }
+            moving.store(false, std::memory_order_release);
+            // A block may have become ready after the check above.
+            if (stopped() ||
+                !slots[f % RING].ready.load(std::memory_order_acquire))
+                return;
+        }
+    }
+
+    // Returns true if the prefix meets the precision.
+    bool reached() const
+    {
+        if (rounds < 2)
+            return false;
+        double var = chipVariance(rounds, net, sumSquares);
+        return z * std::sqrt(var / rounds) <= precision;
+    }
+
+    double precision; // Half-width wanted.
+    double z;         // Normal quantile of the interval.
+    Slot slots[RING]; // Sums of the blocks finished ahead of the prefix.
+    alignas(64) std::atomic<long long> frontier; // Blocks in the prefix.
+    alignas(64) std::atomic<long long> stopAt;   // Last block, or -1.
+    alignas(64) std::atomic<bool> moving; // A worker moves the prefix.
+    // Sums of the prefix (owned by the worker moving it).
+    long long rounds;
+    long long net;
+    long long sumSquares;
+};
+
+#endif // BLACKJACK_PRECISION_STOP_H
@@ -0,0 +1,89 @@
+#ifndef BLACKJACK_RANDOM_H
+#define BLACKJACK_RANDOM_H
+
+#include <cstdint>
+
+// Step of the splitmix64 generator; used to expand seeds.
+inline uint64_t splitmix64(uint64_t &state)
+{
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Class that represents a fast random number generator (xoshiro256**).
+// Every instance has its own state, so no locking is needed when many
+// generators are used in different threads.
+class Random
+{
+public:
+    // Constructor. The same seed always gives the same numbers.
+    Random(uint64_t seed1 = 0)
+    {
+        seed(seed1);
+    }
+
+    // Reset the state from a seed (expanded by splitmix64).
+    void seed(uint64_t seed1)
+    {
+        for (int i = 0; i < 4; i++)
+            state[i] = splitmix64(seed1);
+    }
+
+    // Copy the state out, or restore a copied state (to resume the
+    // numbers exactly where they stopped).
+    void getState(uint64_t out[4]) const
+    {
+        for (int i = 0; i < 4; i++)
+            out[i] = state[i];
+    }
+
+    void setState(const uint64_t in[4])
+    {
+        for (int i = 0; i < 4; i++)
+            state[i] = in[i];
+    }
+
+    // Get the next 64 random bits.
+    uint64_t next()
+    {
+        uint64_t result = rotl(state[1] * 5, 7) * 9;
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    // Get an unbiased random number in the range of 0 <= x < n
+    // (Lemire's multiply-and-shift method with rejection).
+    uint32_t below(uint32_t n)
+    {
+        uint64_t m = (uint64_t)(uint32_t)(next() >> 32) * n;
+        uint32_t low = (uint32_t)m;
+        if (low < n)
+        {
+            uint32_t threshold = -n % n;
+            while (low < threshold)
+            {
+                m = (uint64_t)(uint32_t)(next() >> 32) * n;
+                low = (uint32_t)m;
+            }
+        }
+        return (uint32_t)(m >> 32);
+    }
+
+private:
+    static uint64_t rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t state[4]; // State of the generator.
+};
+
+#endif // BLACKJACK_RANDOM_H
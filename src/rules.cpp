@@ -0,0 +1,118 @@
+#include "rules.h"
+
+#include <cstdlib>
+#include <sstream>
+
+#include "player_hands.h"
+
+using namespace std;
+
+// Parse "yes" or "no".
+static bool parseFlag(const string &value, bool &flag)
+{
+    if (value != "yes" && value != "no")
+        return false;
+    flag = value == "yes";
+    return true;
+}
+
+// Parse a positive number within [low, high].
+static bool parseNumber(const string &value, int low, int high, int &number)
+{
+    char *end;
+    long n = strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || n < low || n > high)
+        return false;
+    number = (int)n;
+    return true;
+}
+
+bool RuleConfig::read(istream &in, string &error)
+{
+    string line;
+    for (int lineNo = 1; getline(in, line); lineNo++)
+    {
+        // Strip comments and white spaces, and skip empty lines.
+        string text;
+        for (size_t i = 0; i < line.size() && line[i] != '#'; i++)
+            if (line[i] != ' ' && line[i] != '\t' && line[i] != '\r')
+                text.push_back(line[i]);
+        if (text.empty())
+            continue;
+
+        size_t eq = text.find('=');
+        string key = text.substr(0, eq);
+        string value = eq == string::npos ? "" : text.substr(eq + 1);
+        bool ok;
+        if (key == "dealer")
+        {
+            ok = value == "s17" || value == "h17";
+            hitSoft17 = value == "h17";
+        }
+        else if (key == "blackjack")
+        {
+            size_t colon = value.find(':');
+            ok = colon != string::npos &&
+                 parseNumber(value.substr(0, colon), 1, 100, blackjackNum) &&
+                 parseNumber(value.substr(colon + 1), 1, 100, blackjackDen);
+            // Gains are counted in units (see CHIP_UNITS), so the payout
+            // of a 1-chip bet should be a whole number of units.
+            if (ok && CHIP_UNITS * blackjackNum % blackjackDen != 0)
+            {
+                error = "line " + to_string(lineNo) + ": blackjack pays " +
+                        value + ", not a multiple of 1/" +
+                        to_string(CHIP_UNITS) + " chip";
+                return false;
+            }
+        }
+        else if (key == "peek")
+            ok = parseFlag(value, peek);
+        else if (key == "surrender")
+            ok = parseFlag(value, surrender);
+        else if (key == "double")
+            ok = parseFlag(value, doubleDown);
+        else if (key == "double-after-split")
+            ok = parseFlag(value, doubleAfterSplit);
+        else if (key == "split-hands")
+            ok = parseNumber(value, 1, PlayerHands::MAX_HANDS, splitHands);
+        else if (key == "resplit-aces")
+            ok = parseFlag(value, resplitAces);
+        else if (key == "insurance")
+            ok = parseFlag(value, insurance);
+        else if (key == "max-bet")
+            ok = parseNumber(value, 1, 9, maxBet);
+        else if (key == "player-chips")
+            ok = parseNumber(value, 1, 1000000, playerChips);
+        else if (key == "dealer-chips")
+            ok = parseNumber(value, 1, 1000000, dealerChips);
+        else
+        {
+            error = "line " + to_string(lineNo) + ": unknown rule " + key;
+            return false;
+        }
+        if (!ok)
+        {
+            error = "line " + to_string(lineNo) + ": bad value for " + key;
+            return false;
+        }
+    }
+    return true;
+}
+
+string RuleConfig::describe() const
+{
+    ostringstream out;
+    out << (hitSoft17 ? "H17" : "S17") << ", blackjack pays " << blackjackNum
+        << ':' << blackjackDen << (peek ? ", peek" : ", no peek")
+        << (surrender ? ", surrender" : ", no surrender");
+    // Moves beyond the original game are listed only if allowed.
+    if (doubleDown)
+        out << (doubleAfterSplit ? ", double (after split too)"
+                                 : ", double");
+    if (splitHands > 1)
+        out << ", split to " << splitHands << " hands"
+            << (resplitAces ? " (aces too)" : "");
+    if (insurance)
+        out << ", insurance";
+    return out.str();
+}
@@ -0,0 +1,288 @@
+#ifndef BLACKJACK_RULES_H
+#define BLACKJACK_RULES_H
+
+#include <iostream>
+#include <string>
+
+#include "decks.h"
+#include "hand.h"
+
+// Possible results of a round, seen from the player's side.
+enum Outcome
+{
+    PLAYER_BUST,      // The player got busted.
+    PLAYER_QUIT,      // The player quit while playing.
+    PLAYER_BLACKJACK, // The player won with the blackjack.
+    BLACKJACK_TIE,    // Both got the blackjack.
+    DEALER_BUST,      // The dealer got busted.
+    DEALER_WIN,       // The dealer's value is greater.
+    PLAYER_WIN,       // The player's value is greater.
+    DEALER_BLACKJACK, // Tied values, but the dealer has the blackjack.
+    PUSH,             // Tied values, and the bet is returned.
+    PLAYER_SURRENDER, // The player surrendered half of the bet.
+    N_OUTCOME         // Number of outcomes.
+};
+
+// Moves allowed to a hand besides hitting and standing (flags of a mask).
+const int CAN_DOUBLE = 1;    // The hand can be doubled.
+const int CAN_SPLIT = 2;     // The hand is a pair that can be split.
+const int CAN_SURRENDER = 4; // The hand can be surrendered.
+
+// Results are counted in units of 1/CHIP_UNITS chip, so that payouts
+// such as 3:2 and 6:5 and half-bet surrenders stay integers.
+const int CHIP_UNITS = 10;
+
+// Rule sets of the round engine.
+// A rule set is a policy class with the member functions below; the round
+// engine (see playRound()) is a template over it. FixedRules decides all
+// rules at compile time, so every variant compiles to its own specialized
+// loop, while RuleConfig decides them at run time (from a rules file).
+
+// Rule set fixed at compile time:
+// H17: the dealer hits a soft 17 (otherwise stands on all 17s, S17),
+// BJ_NUM:BJ_DEN: the payout of a blackjack,
+// PEEK: the dealer checks for a blackjack before the player moves,
+// SURRENDER: the player can surrender the first two cards (late: the
+// dealer's blackjack still takes the whole bet),
+// DOUBLE: the player can double down on the first two cards,
+// MAX_HANDS: the most hands after splitting pairs (1: no split, up to
+// PlayerHands::MAX_HANDS), DAS: doubling after a split is allowed,
+// RSA: split aces can be split again (otherwise they get one card each),
+// INSURANCE: the player is offered insurance against the dealer's ace.
+template <bool H17, int BJ_NUM, int BJ_DEN, bool PEEK, bool SURRENDER,
+          bool DOUBLE = false, int MAX_HANDS = 1, bool DAS = false,
+          bool RSA = false, bool INSURANCE = false>
+struct FixedRules
+{
+    static_assert(CHIP_UNITS * BJ_NUM % BJ_DEN == 0,
+                  "a blackjack should pay a whole number of units");
+
+    // Returns true if the dealer hits the hand.
+    static bool dealerHits(const Hand &dealer)
+    {
+        return dealer.dealerHits(H17);
+    }
+
+    // Units gained for a blackjack with a bet of 1 chip.
+    static int blackjackUnits()
+    {
+        return CHIP_UNITS * BJ_NUM / BJ_DEN;
+    }
+
+    static bool dealerPeeks()
+    {
+        return PEEK;
+    }
+
+    static bool surrenderAllowed()
+    {
+        return SURRENDER;
+    }
+
+    static bool doubleAllowed()
+    {
+        return DOUBLE;
+    }
+
+    static int maxHands()
+    {
+        return MAX_HANDS;
+    }
+
+    static bool doubleAfterSplitAllowed()
+    {
+        return DAS;
+    }
+
+    static bool resplitAcesAllowed()
+    {
+        return RSA;
+    }
+
+    static bool insuranceOffered()
+    {
+        return INSURANCE;
+    }
+};
+
+// Rules of the original game: S17, a blackjack pays 1:1, no peek, no
+// surrender, no double, no split and no insurance.
+typedef FixedRules<false, 1, 1, false, false> StandardRules;
+
+// Rule set chosen at run time, with the limits of the interactive game.
+// The defaults are the ones of StandardRules.
+struct RuleConfig
+{
+    bool hitSoft17;   // true for H17, false for S17.
+    int blackjackNum; // Payout of a blackjack (blackjackNum:blackjackDen),
+    int blackjackDen; // a whole number of units (see CHIP_UNITS).
+    bool peek;        // The dealer checks for a blackjack.
+    bool surrender;   // Late surrender is allowed.
+    bool doubleDown;  // Doubling the first two cards is allowed.
+    int splitHands;   // Most hands after splitting pairs (1: no split).
+    bool doubleAfterSplit; // Doubling split hands is allowed.
+    bool resplitAces; // Split aces can be split again.
+    bool insurance;   // Insurance is offered against the dealer's ace.
+    int maxBet;       // Maximum number of chips for a bet (1-9).
+    int playerChips;  // Initial number of player's chips.
+    int dealerChips;  // Initial number of dealer's chips.
+
+    RuleConfig()
+        : hitSoft17(false), blackjackNum(1), blackjackDen(1), peek(false),
+          surrender(false), doubleDown(false), splitHands(1),
+          doubleAfterSplit(false), resplitAces(false), insurance(false),
+          maxBet(5), playerChips(100), dealerChips(10000)
+    {
+    }
+
+    // The same member functions as FixedRules.
+    bool dealerHits(const Hand &dealer) const
+    {
+        return dealer.dealerHits(hitSoft17);
+    }
+
+    int blackjackUnits() const
+    {
+        return CHIP_UNITS * blackjackNum / blackjackDen;
+    }
+
+    bool dealerPeeks() const
+    {
+        return peek;
+    }
+
+    bool surrenderAllowed() const
+    {
+        return surrender;
+    }
+
+    bool doubleAllowed() const
+    {
+        return doubleDown;
+    }
+
+    int maxHands() const
+    {
+        return splitHands;
+    }
+
+    bool doubleAfterSplitAllowed() const
+    {
+        return doubleAfterSplit;
+    }
+
+    bool resplitAcesAllowed() const
+    {
+        return resplitAces;
+    }
+
+    bool insuranceOffered() const
+    {
+        return insurance;
+    }
+
+    // Read the rules from lines of "key = value" (empty lines and
+    // comments, from '#' to the end of a line, are ignored). The keys are:
+    //   dealer = s17 | h17         blackjack = N:M (e.g. 3:2)
+    //   peek = yes | no            surrender = yes | no
+    //   double = yes | no          double-after-split = yes | no
+    //   split-hands = 1~4          resplit-aces = yes | no
+    //   insurance = yes | no
+    //   max-bet = 1~9              player-chips = N    dealer-chips = N
+    // Returns false with a message in error on a bad line.
+    bool read(std::istream &in, std::string &error);
+
+    // Short description of the rules (e.g. "S17, blackjack pays 3:2").
+    std::string describe() const;
+};
+
+// The dealer hits until the rules say to stand (S17 by default), drawing
+// from decks (a Decks, or any shoe with deal(), see ShoeCursor).
+template <class Rules = StandardRules, class Shoe = Decks>
+inline void dealerPlay(Hand &dealer, Shoe &decks,
+                       const Rules &rules = Rules())
+{
+    while (rules.dealerHits(dealer))
+        dealer.addCard(decks.deal());
+}
+
+// Decide the outcome of a hand from the way the player ended it
+// (in: b (busted), q (quit), j (blackjack), s (stand), u (surrender),
+// k (the dealer peeked at a blackjack)).
+// When the player stands, the dealer must have played already; a split
+// hand of 21 with two cards stands (it is not a blackjack).
+inline Outcome settle(char in, const Hand &player, const Hand &dealer)
+{
+    if (in == 'b')
+        return PLAYER_BUST;
+    if (in == 'q')
+        return PLAYER_QUIT;
+    // A late surrender loses the whole bet to a dealer's blackjack (one
+    // that was not peeked at).
+    if (in == 'u')
+        return dealer.blackjack() ? DEALER_BLACKJACK : PLAYER_SURRENDER;
+    if (in == 'k')
+        return DEALER_BLACKJACK;
+    if (in == 'j')
+        return dealer.blackjack() ? BLACKJACK_TIE : PLAYER_BLACKJACK;
+
+    int playerValue = player.getValue();
+    int dealerValue = dealer.getValue();
+    if (dealerValue > 21)
+        return DEALER_BUST;
+    if (dealerValue > playerValue)
+        return DEALER_WIN;
+    if (dealerValue < playerValue)
+        return PLAYER_WIN;
+    // If the dealer has the blackjack and the score is tied,
+    // the dealer wins.
+    return dealer.blackjack() ? DEALER_BLACKJACK : PUSH;
+}
+
+// Units (see CHIP_UNITS) gained by the player for the outcome of a round
+// with a bet of 1 chip (negative if the player loses them).
+template <class Rules = StandardRules>
+inline int payoffUnits(Outcome result, const Rules &rules = Rules())
+{
+    switch (result)
+    {
+    case PLAYER_BLACKJACK:
+        return rules.blackjackUnits();
+    case DEALER_BUST:
+    case PLAYER_WIN:
+        return CHIP_UNITS;
+    case BLACKJACK_TIE:
+    case PUSH:
+        return 0;
+    case PLAYER_SURRENDER:
+        return -CHIP_UNITS / 2;
+    default:
+        return -CHIP_UNITS;
+    }
+}
+
+// Units gained by an insurance of half of a 1-chip bet: it pays 2:1 if
+// the dealer has the blackjack.
+inline int insuranceUnits(const Hand &dealer)
+{
+    return dealer.blackjack() ? CHIP_UNITS : -CHIP_UNITS / 2;
+}
+
+// Whole chips for units gained by the player (negative if the player
+// loses them). Fractions of a chip are rounded down, in favor of the
+// house.
+inline int unitsToChips(int units)
+{
+    return units >= 0 ? units / CHIP_UNITS
+                      : -((-units + CHIP_UNITS - 1) / CHIP_UNITS);
+}
+
+// Chips gained by the player for the outcome of a hand
+// (negative if the player loses them), see unitsToChips().
+template <class Rules = StandardRules>
+inline int payoff(Outcome result, int bet, const Rules &rules = Rules())
+{
+    return unitsToChips(payoffUnits(result, rules) * bet);
+}
+
+#endif // BLACKJACK_RULES_H
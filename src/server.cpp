@@ -0,0 +1,341 @@
+#include "server.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "game.h"
+#include "random.h"
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE 0 // Before Linux 4.5, every worker wakes up.
+#endif
+
+using namespace std;
+
+namespace
+{
+// Stream buffer that appends the texts of a game to a string.
+class StringBuffer : public streambuf
+{
+public:
+    StringBuffer(string &s1) : s(s1) {}
+
+protected:
+    int overflow(int c)
+    {
+        if (c != EOF)
+            s.push_back((char)c);
+        return c;
+    }
+
+    streamsize xsputn(const char *p, streamsize n)
+    {
+        s.append(p, n);
+        return n;
+    }
+
+private:
+    string &s;
+};
+
+// Tags of the events of the listening socket and of stop().
+char listenTag, stopTag;
+
+const int MAX_LINE = 4096;      // Longest input line kept.
+const size_t KEEP_BUFFER = 4096; // Largest output buffer kept when idle.
+} // namespace
+
+// A client connection and its game.
+struct GameServer::Connection
+{
+    int fd;           // Socket of the client.
+    string in;        // Input line received so far.
+    string out;       // Texts not sent yet.
+    size_t sent;      // Bytes of out already sent.
+    StringBuffer buf; // Buffer of stream, appending to out.
+    ostream stream;   // Stream for the texts of the game.
+    Game game;        // Game of the session.
+    bool writing;     // true while waiting for the socket to be writable.
+
+    Connection(int fd1)
+        : fd(fd1), in(), out(), sent(0), buf(out), stream(&buf),
+          game(stream), writing(false)
+    {
+    }
+};
+
+// State of a worker thread: its epoll instance and its connections.
+struct GameServer::Worker
+{
+    int epollFd;
+    unordered_set<Connection *> connections;
+};
+
+GameServer::GameServer(int nWorker1, uint64_t seed1)
+    : nWorker(nWorker1), seed(seed1), supply(0), listenFd(-1), stopFd(-1),
+      unixPath(), workers(), pool(), stopping(false), nSession(0),
+      nAccepted(0), nLine(0)
+{
+    if (nWorker <= 0)
+        nWorker = thread::hardware_concurrency();
+    if (nWorker <= 0)
+        nWorker = 1;
+}
+
+GameServer::~GameServer()
+{
+    stop();
+    wait();
+}
+
+bool GameServer::listenTcp(int port, const string &address)
+{
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0)
+        return false;
+    int one = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1)
+    {
+        errno = EINVAL;
+        return false;
+    }
+    return bind(listenFd, (sockaddr *)&addr, sizeof(addr)) == 0 &&
+           listen(listenFd, SOMAXCONN) == 0;
+}
+
+bool GameServer::listenUnix(const string &path)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(addr.sun_path, path.c_str());
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0)
+        return false;
+    unlink(path.c_str());
+    if (bind(listenFd, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(listenFd, SOMAXCONN) != 0)
+        return false;
+    unixPath = path;
+    return true;
+}
+
+void GameServer::start()
+{
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    for (int i = 0; i < nWorker; i++)
+    {
+        Worker *w = new Worker();
+        w->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.ptr = &listenTag;
+        epoll_ctl(w->epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+        ev.events = EPOLLIN;
+        ev.data.ptr = &stopTag;
+        epoll_ctl(w->epollFd, EPOLL_CTL_ADD, stopFd, &ev);
+        workers.push_back(w);
+    }
+    for (int i = 0; i < nWorker; i++)
+        pool.push_back(thread(&GameServer::work, this, workers[i]));
+}
+
+void GameServer::stop()
+{
+    stopping = true;
+    if (stopFd >= 0)
+    {
+        uint64_t one = 1;
+        ssize_t n = write(stopFd, &one, sizeof(one));
+        (void)n;
+    }
+}
+
+void GameServer::wait()
+{
+    for (size_t i = 0; i < pool.size(); i++)
+        pool[i].join();
+    pool.clear();
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        Worker *w = workers[i];
+        while (!w->connections.empty())
+            closeConnection(w, *w->connections.begin());
+        close(w->epollFd);
+        delete w;
+    }
+    workers.clear();
+    if (listenFd >= 0)
+        close(listenFd);
+    if (stopFd >= 0)
+        close(stopFd);
+    listenFd = stopFd = -1;
+    if (!unixPath.empty())
+        unlink(unixPath.c_str());
+    unixPath.clear();
+}
+
+void GameServer::work(Worker *w)
+{
+    const int MAX_EVENTS = 64;
+    epoll_event events[MAX_EVENTS];
+    while (!stopping)
+    {
+        int n = epoll_wait(w->epollFd, events, MAX_EVENTS, -1);
+        for (int i = 0; i < n && !stopping; i++)
+        {
+            void *tag = events[i].data.ptr;
+            if (tag == &stopTag)
+                break;
+            if (tag == &listenTag)
+            {
+                acceptAll(w);
+                continue;
+            }
+            Connection *c = (Connection *)tag;
+            bool ok = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                ok = readInput(c);
+            if (ok)
+                ok = writeOutput(w, c);
+            if (!ok)
+                closeConnection(w, c);
+        }
+    }
+}
+
+void GameServer::acceptAll(Worker *w)
+{
+    while (true)
+    {
+        int fd = accept4(listenFd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            return; // EAGAIN, or out of descriptors.
+        }
+        int one = 1; // Only for TCP; fails harmlessly on Unix sockets.
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        Connection *c = new Connection(fd);
+        uint64_t state = seed + nAccepted++;
+        c->game.setShoeSupply(supply);
+        c->game.start(splitmix64(state));
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        epoll_ctl(w->epollFd, EPOLL_CTL_ADD, fd, &ev);
+        w->connections.insert(c);
+        nSession++;
+        if (!writeOutput(w, c))
+            closeConnection(w, c);
+    }
+}
+
+bool GameServer::readInput(Connection *c)
+{
+    char buf[4096];
+    while (!c->game.finished())
+    {
+        ssize_t n = read(c->fd, buf, sizeof(buf));
+        if (n == 0)
+            return false; // The client closed the connection.
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        for (ssize_t i = 0; i < n && !c->game.finished(); i++)
+        {
+            if (buf[i] != '\n')
+            {
+                if ((int)c->in.size() < MAX_LINE)
+                    c->in.push_back(buf[i]);
+                continue;
+            }
+            if (!c->in.empty() && c->in[c->in.size() - 1] == '\r')
+                c->in.erase(c->in.size() - 1);
+            c->game.input(c->in.c_str());
+            c->in.clear();
+            nLine++;
+        }
+    }
+    return true;
+}
+
+bool GameServer::writeOutput(Worker *w, Connection *c)
+{
+    while (c->sent < c->out.size())
+    {
+        ssize_t n = send(c->fd, c->out.data() + c->sent,
+                         c->out.size() - c->sent, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            c->sent += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            // Wait until the socket is writable.
+            if (!c->writing)
+            {
+                epoll_event ev;
+                ev.events = EPOLLIN | EPOLLOUT;
+                ev.data.ptr = c;
+                epoll_ctl(w->epollFd, EPOLL_CTL_MOD, c->fd, &ev);
+                c->writing = true;
+            }
+            return true;
+        }
+        return false;
+    }
+    c->out.clear();
+    c->sent = 0;
+    if (c->out.capacity() > KEEP_BUFFER)
+        string().swap(c->out); // Keep idle sessions small.
+    if (c->writing)
+    {
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        epoll_ctl(w->epollFd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->writing = false;
+    }
+    // The game is over once all texts are sent.
+    return !c->game.finished();
+}
+
+void GameServer::closeConnection(Worker *w, Connection *c)
+{
+    epoll_ctl(w->epollFd, EPOLL_CTL_DEL, c->fd, 0);
+    close(c->fd);
+    w->connections.erase(c);
+    delete c;
+    nSession--;
+}
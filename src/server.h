@@ -0,0 +1,109 @@
+#ifndef BLACKJACK_SERVER_H
+#define BLACKJACK_SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ShoeSupply;
+
+// Class that hosts many games behind one TCP or Unix socket (Linux only).
+// Every connection drives its own Game state machine: each input line
+// from the client is handled at once, and the texts up to the next prompt
+// are sent back. Connections are spread over a few worker threads, each
+// waiting on its own epoll instance with non-blocking sockets, so there is
+// no thread per player and an idle session only costs its Game and
+// buffers (about 1 KB).
+class GameServer
+{
+public:
+    // Constructor. nWorker == 0 uses all hardware threads; the games are
+    // shuffled with seeds derived from seed and the connection number.
+    GameServer(int nWorker = 0, uint64_t seed = 0);
+
+    // Destructor. Stops the workers and closes all sockets.
+    ~GameServer();
+
+    // Listen on a TCP port (of the given IPv4 address) or on a Unix
+    // socket. Returns false (with errno set) on failure.
+    bool listenTcp(int port, const std::string &address = "127.0.0.1");
+    bool listenUnix(const std::string &path);
+
+    // Deal the games from a supply of shoes shuffled in the background
+    // (before start(); 0 by default: every game shuffles its own shoe).
+    void setShoeSupply(ShoeSupply *supply1)
+    {
+        supply = supply1;
+    }
+
+    // Start the worker threads.
+    void start();
+
+    // Ask the workers to stop (safe to call from a signal handler).
+    void stop();
+
+    // Wait until the workers are stopped.
+    void wait();
+
+    // Returns true until stop() is called.
+    bool running() const
+    {
+        return !stopping;
+    }
+
+    // Number of open sessions.
+    int sessions() const
+    {
+        return nSession;
+    }
+
+    // Total number of sessions accepted.
+    long long accepted() const
+    {
+        return nAccepted;
+    }
+
+    // Total number of input lines handled.
+    long long linesHandled() const
+    {
+        return nLine;
+    }
+
+private:
+    struct Connection;
+    struct Worker;
+
+    // Loop of a worker thread.
+    void work(Worker *w);
+
+    // Accept all pending connections into a worker.
+    void acceptAll(Worker *w);
+
+    // Handle readable data of a connection. Returns false if the
+    // connection should be closed.
+    bool readInput(Connection *c);
+
+    // Send pending output of a connection. Returns false if the
+    // connection should be closed.
+    bool writeOutput(Worker *w, Connection *c);
+
+    // Close a connection and free its session.
+    void closeConnection(Worker *w, Connection *c);
+
+    int nWorker;                   // Number of worker threads.
+    uint64_t seed;                 // Master seed for the games.
+    ShoeSupply *supply;            // Supply of shoes, or 0.
+    int listenFd;                  // Listening socket.
+    int stopFd;                    // eventfd signaled by stop().
+    std::string unixPath;          // Path of the Unix socket, if any.
+    std::vector<Worker *> workers; // State of every worker.
+    std::vector<std::thread> pool; // Worker threads.
+    std::atomic<bool> stopping;    // true once stop() is called.
+    std::atomic<int> nSession;     // Number of open sessions.
+    std::atomic<long long> nAccepted; // Number of accepted sessions.
+    std::atomic<long long> nLine;     // Number of input lines handled.
+};
+
+#endif // BLACKJACK_SERVER_H
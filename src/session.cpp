@@ -0,0 +1,60 @@
+#include "session.h"
+
+#include <cstdlib>
+
+#include "game.h"
+
+using namespace std;
+
+bool readSessions(istream &in, vector<Session> &sessions)
+{
+    string line;
+    while (getline(in, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        if (line.compare(0, 5, "seed ") == 0)
+            sessions.push_back(Session(strtoull(line.c_str() + 5, 0, 10)));
+        else if (line.compare(0, 2, "> ") == 0 && !sessions.empty())
+            sessions.back().lines.push_back(line.substr(2));
+        else
+            return false;
+    }
+    return true;
+}
+
+void writeSession(ostream &out, const Session &session)
+{
+    out << "seed " << session.seed << '\n';
+    for (size_t i = 0; i < session.lines.size(); i++)
+        out << "> " << session.lines[i] << '\n';
+}
+
+void recordSession(istream &in, ostream &out, Session &session,
+                   HistoryWriter *history, const RuleConfig &rules)
+{
+    Game g(out, rules);
+    g.setHistory(history);
+    g.start(session.seed);
+    string line;
+    while (!g.finished())
+    {
+        if (!getline(in, line))
+            line.clear();
+        session.lines.push_back(line);
+        g.input(line.c_str());
+    }
+}
+
+int replaySession(const Session &session, ostream &out,
+                  HistoryWriter *history, const RuleConfig &rules)
+{
+    Game g(out, rules);
+    g.setHistory(history);
+    g.start(session.seed);
+    for (size_t i = 0; i < session.lines.size() && !g.finished(); i++)
+        g.input(session.lines[i].c_str());
+    while (!g.finished())
+        g.input("");
+    return g.roundsPlayed();
+}
@@ -0,0 +1,68 @@
+#ifndef BLACKJACK_SESSION_H
+#define BLACKJACK_SESSION_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "rules.h"
+
+class HistoryWriter;
+
+// Recorded sessions of the game, and a driver that replays them.
+//
+// Transcript format: a line "seed N" starts a session played with the
+// seed N, and every following line starting with "> " is an input line of
+// that session (the rest of the line is the input). Empty lines and lines
+// starting with '#' are ignored.
+
+// A recorded session: the seed for shuffling and the player's input lines.
+struct Session
+{
+    uint64_t seed;                  // Seed given to Game::start().
+    std::vector<std::string> lines; // Input lines of the player.
+
+    Session(uint64_t seed1 = 0) : seed(seed1), lines() {}
+};
+
+// Stream buffer that discards everything written to it
+// (used to suppress the output of the game).
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c)
+    {
+        return c;
+    }
+
+    std::streamsize xsputn(const char *, std::streamsize n)
+    {
+        return n;
+    }
+};
+
+// Read all sessions of a transcript. Returns false on a bad line.
+bool readSessions(std::istream &in, std::vector<Session> &sessions);
+
+// Write a session in the transcript format.
+void writeSession(std::ostream &out, const Session &session);
+
+// Play the game with input lines from in, and record them in session.
+// The output is the same as the one of Game::play().
+// The rounds are also recorded in history, if given, and the game is
+// played with the given rules.
+void recordSession(std::istream &in, std::ostream &out, Session &session,
+                   HistoryWriter *history = 0,
+                   const RuleConfig &rules = RuleConfig());
+
+// Replay a session, writing all texts of the game to out
+// (an empty line is assumed after the last recorded line, as at the end
+// of the standard input). Returns the number of rounds played.
+// The rounds are also recorded in history, if given, and the game is
+// played with the given rules (which should be the recorded ones).
+int replaySession(const Session &session, std::ostream &out,
+                  HistoryWriter *history = 0,
+                  const RuleConfig &rules = RuleConfig());
+
+#endif // BLACKJACK_SESSION_H
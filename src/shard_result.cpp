@@ -0,0 +1,172 @@
+#include "shard_result.h"
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace std;
+
+// Write and read values of fixed size (native byte order).
+template <class T>
+static void put(FILE *fp, const T &value, bool &ok)
+{
+    ok = ok && fwrite(&value, sizeof(T), 1, fp) == 1;
+}
+
+template <class T>
+static void get(FILE *fp, T &value, bool &ok)
+{
+    ok = ok && fread(&value, sizeof(T), 1, fp) == 1;
+}
+
+// Write and read a string (its size, then its characters).
+static void putString(FILE *fp, const string &text, bool &ok)
+{
+    uint32_t size = text.size();
+    put(fp, size, ok);
+    ok = ok && fwrite(text.data(), 1, size, fp) == size;
+}
+
+static void getString(FILE *fp, string &text, bool &ok)
+{
+    uint32_t size = 0;
+    get(fp, size, ok);
+    ok = ok && size < (1 << 16);
+    if (ok)
+    {
+        text.resize(size);
+        ok = fread(&text[0], 1, size, fp) == size;
+    }
+}
+
+bool ShardResult::sameRun(const ShardResult &other) const
+{
+    return policy == other.policy && rules == other.rules &&
+           seed == other.seed && nRound == other.nRound &&
+           nBlock == other.nBlock && shoe.nDeck == other.shoe.nDeck &&
+           shoe.penetration == other.shoe.penetration &&
+           shoe.continuous == other.shoe.continuous &&
+           results.size() == other.results.size() &&
+           diffs.size() == other.diffs.size();
+}
+
+bool ShardResult::add(const ShardResult &other)
+{
+    if (!sameRun(other))
+        return false;
+    vector<pair<long long, long long> > merged = blocks;
+    merged.insert(merged.end(), other.blocks.begin(), other.blocks.end());
+    sort(merged.begin(), merged.end());
+    // Join the adjacent ranges; overlapping ones were played twice.
+    size_t kept = 0;
+    for (size_t i = 0; i < merged.size(); i++)
+    {
+        if (kept > 0 && merged[i].first < merged[kept - 1].second)
+            return false;
+        if (kept > 0 && merged[i].first == merged[kept - 1].second)
+            merged[kept - 1].second = merged[i].second;
+        else
+            merged[kept++] = merged[i];
+    }
+    merged.resize(kept);
+    blocks = merged;
+    seconds = max(seconds, other.seconds);
+    for (size_t i = 0; i < results.size(); i++)
+        results[i].add(other.results[i]);
+    for (size_t i = 0; i < diffs.size(); i++)
+        diffs[i].add(other.diffs[i]);
+    return true;
+}
+
+long long ShardResult::blocksPlayed() const
+{
+    long long n = 0;
+    for (size_t i = 0; i < blocks.size(); i++)
+        n += blocks[i].second - blocks[i].first;
+    return n;
+}
+
+bool ShardResult::save(const string &file) const
+{
+    string temp = file + ".tmp";
+    FILE *fp = fopen(temp.c_str(), "wb");
+    if (!fp)
+        return false;
+    bool ok = true;
+    put(fp, SHARD_MAGIC, ok);
+    put(fp, SHARD_VERSION, ok);
+    putString(fp, policy, ok);
+    putString(fp, rules, ok);
+    put(fp, seed, ok);
+    put(fp, nRound, ok);
+    put(fp, nBlock, ok);
+    put(fp, shoe.nDeck, ok);
+    put(fp, shoe.penetration, ok);
+    put(fp, shoe.continuous, ok);
+    put(fp, seconds, ok);
+    uint32_t nRange = blocks.size();
+    put(fp, nRange, ok);
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        put(fp, blocks[i].first, ok);
+        put(fp, blocks[i].second, ok);
+    }
+    uint32_t nResult = results.size(), nDiff = diffs.size();
+    put(fp, nResult, ok);
+    for (size_t i = 0; i < results.size(); i++)
+        put(fp, results[i], ok);
+    put(fp, nDiff, ok);
+    for (size_t i = 0; i < diffs.size(); i++)
+        put(fp, diffs[i], ok);
+    ok = fclose(fp) == 0 && ok;
+    if (ok && rename(temp.c_str(), file.c_str()) == 0)
+        return true;
+    remove(temp.c_str());
+    return false;
+}
+
+bool ShardResult::load(const string &file)
+{
+    FILE *fp = fopen(file.c_str(), "rb");
+    if (!fp)
+        return false;
+    bool ok = true;
+    uint32_t magic = 0, version = 0;
+    get(fp, magic, ok);
+    get(fp, version, ok);
+    ok = ok && magic == SHARD_MAGIC && version == SHARD_VERSION;
+    getString(fp, policy, ok);
+    getString(fp, rules, ok);
+    get(fp, seed, ok);
+    get(fp, nRound, ok);
+    get(fp, nBlock, ok);
+    get(fp, shoe.nDeck, ok);
+    get(fp, shoe.penetration, ok);
+    get(fp, shoe.continuous, ok);
+    get(fp, seconds, ok);
+    ok = ok && nBlock >= 0 && nBlock < (1LL << 40) && shoe.nDeck >= 1;
+    uint32_t nRange = 0;
+    get(fp, nRange, ok);
+    ok = ok && nRange <= nBlock;
+    blocks.assign(ok ? nRange : 0, make_pair(0LL, 0LL));
+    for (size_t i = 0; ok && i < blocks.size(); i++)
+    {
+        get(fp, blocks[i].first, ok);
+        get(fp, blocks[i].second, ok);
+        ok = ok && blocks[i].first >= (i > 0 ? blocks[i - 1].second : 0) &&
+             blocks[i].first < blocks[i].second &&
+             blocks[i].second <= nBlock;
+    }
+    uint32_t nResult = 0, nDiff = 0;
+    get(fp, nResult, ok);
+    ok = ok && nResult >= 1 && nResult <= 64;
+    results.assign(ok ? nResult : 0, SimulationResult());
+    for (size_t i = 0; ok && i < results.size(); i++)
+        get(fp, results[i], ok);
+    get(fp, nDiff, ok);
+    ok = ok && nDiff <= nResult;
+    diffs.assign(ok ? nDiff : 0, PairedResult());
+    for (size_t i = 0; ok && i < diffs.size(); i++)
+        get(fp, diffs[i], ok);
+    fclose(fp);
+    return ok;
+}
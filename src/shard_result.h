@@ -0,0 +1,72 @@
+#ifndef BLACKJACK_SHARD_RESULT_H
+#define BLACKJACK_SHARD_RESULT_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "decks.h"
+#include "simulation_result.h"
+
+// Error exception for a bad shard (see Simulator::setShard()).
+struct BadShard
+{
+};
+
+// Results of a shard of a simulation run (see Simulator::setShard()): the
+// settings of the run, the blocks played, and the results of every seat
+// (or every policy compared, with their paired differences). The results
+// hold only sums, so shards of the same run merge exactly (see add())
+// into the result of the run played by a single process.
+//
+// File format (native byte order): SHARD_MAGIC, the version, the policy
+// and the rules (as text), the settings of the run, the seconds played,
+// the ranges of blocks, the results and the differences.
+struct ShardResult
+{
+    std::string policy; // Policies of the seats, as given.
+    std::string rules;  // Description of the rules.
+    uint64_t seed;      // Master seed.
+    long long nRound;   // Rounds of the whole run.
+    long long nBlock;   // Blocks of the whole run.
+    ShoeConfig shoe;    // Configuration of every shoe.
+    double seconds;     // Longest time a shard took.
+    // Blocks played: ranges of first to last - 1, in order.
+    std::vector<std::pair<long long, long long> > blocks;
+    std::vector<SimulationResult> results; // By seat or policy compared.
+    std::vector<PairedResult> diffs; // Differences with the first policy
+                                     // compared (empty otherwise).
+
+    ShardResult() : seed(0), nRound(0), nBlock(0), seconds(0)
+    {
+    }
+
+    // Returns true if other is a shard of the same run.
+    bool sameRun(const ShardResult &other) const;
+
+    // Merge a shard of the same run with other blocks. Returns false,
+    // leaving this result alone, for another run or blocks played twice.
+    bool add(const ShardResult &other);
+
+    // Number of blocks played.
+    long long blocksPlayed() const;
+
+    // Returns true if every block of the run was played.
+    bool complete() const
+    {
+        return blocksPlayed() == nBlock;
+    }
+
+    // Write to file, through a temporary file renamed over it. Returns
+    // false on failure.
+    bool save(const std::string &file) const;
+
+    // Read from file. Returns false if there is no valid result.
+    bool load(const std::string &file);
+};
+
+const uint32_t SHARD_MAGIC = 0x48534a42; // "BJSH" (little-endian).
+const uint32_t SHARD_VERSION = 1;
+
+#endif // BLACKJACK_SHARD_RESULT_H
@@ -0,0 +1,111 @@
+#include "shard_runner.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Parse a list of cpus such as "0-3,8-11".
+static vector<int> parseCpuList(const string &list)
+{
+    vector<int> cpus;
+    stringstream in(list);
+    string range;
+    while (getline(in, range, ','))
+    {
+        int first, last;
+        char dash;
+        stringstream parts(range);
+        if (!(parts >> first))
+            continue;
+        last = first;
+        if (parts >> dash >> last && dash != '-')
+            last = first;
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+vector<vector<int> > numaNodes()
+{
+    vector<vector<int> > nodes;
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (!dir)
+        return nodes;
+    vector<int> ids;
+    while (dirent *entry = readdir(dir))
+    {
+        int id;
+        char rest;
+        if (sscanf(entry->d_name, "node%d%c", &id, &rest) == 1)
+            ids.push_back(id);
+    }
+    closedir(dir);
+    sort(ids.begin(), ids.end());
+    for (size_t i = 0; i < ids.size(); i++)
+    {
+        ifstream in("/sys/devices/system/node/node" + to_string(ids[i]) +
+                    "/cpulist");
+        string list;
+        getline(in, list);
+        vector<int> cpus = parseCpuList(list);
+        if (!cpus.empty()) // Nodes with memory only are skipped.
+            nodes.push_back(cpus);
+    }
+    return nodes;
+}
+
+int runShardProcesses(const vector<ShardProcess> &processes)
+{
+    vector<pid_t> pids;
+    int nFailed = 0;
+    for (size_t i = 0; i < processes.size(); i++)
+    {
+        const ShardProcess &process = processes[i];
+        vector<char *> argv;
+        argv.push_back((char *)"blackjack");
+        for (size_t a = 0; a < process.args.size(); a++)
+            argv.push_back((char *)process.args[a].c_str());
+        argv.push_back(0);
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            nFailed++;
+            continue;
+        }
+        if (pid == 0)
+        {
+            if (!process.cpus.empty())
+            {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (size_t c = 0; c < process.cpus.size(); c++)
+                    CPU_SET(process.cpus[c], &set);
+                sched_setaffinity(0, sizeof(set), &set);
+            }
+            int null = open("/dev/null", O_WRONLY);
+            if (null >= 0)
+                dup2(null, STDOUT_FILENO);
+            execv("/proc/self/exe", argv.data());
+            _exit(127);
+        }
+        pids.push_back(pid);
+    }
+    for (size_t i = 0; i < pids.size(); i++)
+    {
+        int status;
+        if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0)
+            nFailed++;
+    }
+    return nFailed;
+}
@@ -0,0 +1,26 @@
+#ifndef BLACKJACK_SHARD_RUNNER_H
+#define BLACKJACK_SHARD_RUNNER_H
+
+#include <string>
+#include <vector>
+
+// Child process running a shard of a simulation (Linux only): the
+// arguments of the program, and the cpus to pin it to (none: any cpu).
+struct ShardProcess
+{
+    std::vector<std::string> args; // Arguments after the program name.
+    std::vector<int> cpus;         // Cpus the process may run on.
+};
+
+// Return the cpus of every NUMA node of the host (read from
+// /sys/devices/system/node), or nothing if they are not known.
+std::vector<std::vector<int> > numaNodes();
+
+// Start every process (running this program again, with its standard
+// output discarded) and wait for all of them. A process pinned to the
+// cpus of a node allocates its memory on that node too, the kernel
+// placing pages where they are first touched. Returns the number of
+// processes that failed.
+int runShardProcesses(const std::vector<ShardProcess> &processes);
+
+#endif // BLACKJACK_SHARD_RUNNER_H
@@ -0,0 +1,164 @@
+#include "shoe_supply.h"
+
+#include <utility>
+
+#include "card.h"
+#include "random.h"
+
+using namespace std;
+
+// Seed of the k-th shoe of nDeck decks of a supply seeded with seed.
+static uint64_t shoeSeed(uint64_t seed, int nDeck, uint64_t k)
+{
+    uint64_t state = seed ^ ((uint64_t)nDeck << 56);
+    splitmix64(state);
+    state += k * 0x9E3779B97F4A7C15ULL;
+    return splitmix64(state);
+}
+
+ShoeSupply::ShoeSupply(uint64_t seed1, int nThread, int capacity1)
+    : seed(seed1), capacity(capacity1 < 1 ? 1 : capacity1), nShoe(0),
+      nStall(0), version(0), sleeping(0), stopping(false)
+{
+    for (int n = 0; n <= MAX_SUPPLY_DECKS; n++)
+    {
+        Ring &ring = rings[n];
+        ring.used.store(false);
+        ring.slots = new Slot[capacity];
+        for (int i = 0; i < capacity; i++)
+            ring.slots[i].seq.store(i);
+        ring.head.store(0);
+        ring.tail.store(0);
+    }
+    if (nThread < 1)
+        nThread = 1;
+    for (int i = 0; i < nThread; i++)
+        threads.push_back(thread(&ShoeSupply::run, this));
+}
+
+ShoeSupply::~ShoeSupply()
+{
+    stopping = true;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        wake.notify_all();
+    }
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    for (int n = 0; n <= MAX_SUPPLY_DECKS; n++)
+        delete[] rings[n].slots;
+}
+
+bool ShoeSupply::exchange(vector<uint8_t> &cards)
+{
+    int nDeck = cards.size() / 52;
+    if (nDeck < 1 || nDeck > MAX_SUPPLY_DECKS || cards.size() % 52 != 0)
+        return false;
+    Ring &ring = rings[nDeck];
+    if (!ring.used.load(memory_order_acquire))
+    {
+        ring.used.store(true, memory_order_release);
+        wakeUp();
+    }
+    bool waited = false;
+    uint64_t pos = ring.tail.load(memory_order_relaxed);
+    Slot *slot;
+    while (true)
+    {
+        slot = &ring.slots[pos % capacity];
+        uint64_t seq = slot->seq.load(memory_order_acquire);
+        if (seq == pos + 1)
+        {
+            if (ring.tail.compare_exchange_weak(pos, pos + 1,
+                                                memory_order_relaxed))
+                break;
+        }
+        else if (seq < pos + 1)
+        {
+            // Not shuffled yet: wait for the threads.
+            if (!waited)
+                nStall.fetch_add(1, memory_order_relaxed);
+            waited = true;
+            this_thread::yield();
+            pos = ring.tail.load(memory_order_relaxed);
+        }
+        else
+            pos = ring.tail.load(memory_order_relaxed);
+    }
+    cards.swap(slot->cards);
+    slot->seq.store(pos + capacity, memory_order_release);
+    nShoe.fetch_add(1, memory_order_relaxed);
+    wakeUp();
+    return true;
+}
+
+void ShoeSupply::run()
+{
+    while (!stopping)
+    {
+        uint64_t seen = version.load();
+        // One shoe in every ring used at a time, until all are full.
+        bool filled = true;
+        while (filled && !stopping)
+        {
+            filled = false;
+            for (int n = 1; n <= MAX_SUPPLY_DECKS; n++)
+                if (rings[n].used.load(memory_order_acquire) && fill(n))
+                    filled = true;
+        }
+        unique_lock<std::mutex> lock(mutex);
+        sleeping++;
+        wake.wait(lock, [&]() { return stopping || version.load() != seen; });
+        sleeping--;
+    }
+}
+
+bool ShoeSupply::fill(int nDeck)
+{
+    Ring &ring = rings[nDeck];
+    uint64_t pos = ring.head.load(memory_order_relaxed);
+    Slot *slot;
+    while (true)
+    {
+        slot = &ring.slots[pos % capacity];
+        uint64_t seq = slot->seq.load(memory_order_acquire);
+        if (seq == pos)
+        {
+            if (ring.head.compare_exchange_weak(pos, pos + 1,
+                                                memory_order_relaxed))
+                break;
+        }
+        else if (seq < pos)
+            return false; // Full: the slot was not taken yet.
+        else
+            pos = ring.head.load(memory_order_relaxed);
+    }
+    // The cards in their initial order (as Decks::create()), then a full
+    // Fisher-Yates shuffle.
+    vector<uint8_t> &cards = slot->cards;
+    cards.resize(nDeck * 52);
+    int index = 0;
+    for (int i = 0; i < nDeck; i++)
+        for (int rank = 1; rank <= 13; rank++)
+        {
+            cards[index++] = Card(rank, 'c').getCode();
+            cards[index++] = Card(rank, 's').getCode();
+            cards[index++] = Card(rank, 'h').getCode();
+            cards[index++] = Card(rank, 'd').getCode();
+        }
+    Random rng(shoeSeed(seed, nDeck, pos));
+    for (int i = 0; i + 1 < (int)cards.size(); i++)
+        swap(cards[i], cards[i + rng.below(cards.size() - i)]);
+    slot->seq.store(pos + 1, memory_order_release);
+    return true;
+}
+
+void ShoeSupply::wakeUp()
+{
+    version.fetch_add(1);
+    if (sleeping.load() > 0)
+    {
+        lock_guard<std::mutex> lock(mutex);
+        wake.notify_all();
+    }
+}
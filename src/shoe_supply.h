@@ -0,0 +1,97 @@
+#ifndef BLACKJACK_SHOE_SUPPLY_H
+#define BLACKJACK_SHOE_SUPPLY_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+const int MAX_SUPPLY_DECKS = 8; // Most decks in a shoe of a ShoeSupply.
+
+// Class that shuffles shoes ahead of time in background threads, so that
+// a table needing a new shoe takes a ready one (see Decks::setSupply())
+// instead of shuffling between its rounds.
+// There is a ring of ready shoes for every number of decks, filled once a
+// table asks for it. A table exchanges the shoe it has dealt for a ready
+// one by swapping the buffers of cards, in O(1); the threads then shuffle
+// the returned buffer again, so that nothing is allocated once running.
+// The rings are bounded and lock-free (each slot carries a sequence
+// number): the threads sleep once all rings are full, and a table only
+// waits if the threads fall behind (see stalls()).
+// The k-th shoe of a ring is shuffled (a full Fisher-Yates shuffle of the
+// cards in their initial order) with a seed derived from the seed of the
+// supply, the number of decks and k, so that the shoes handed out are the
+// same whatever the threads and their timing.
+class ShoeSupply
+{
+public:
+    // Constructor. Starts nThread threads keeping capacity shoes ready in
+    // every ring used.
+    ShoeSupply(uint64_t seed1, int nThread = 1, int capacity1 = 8);
+
+    // Destructor. Stops the threads.
+    ~ShoeSupply();
+
+    // Exchange cards (a shoe of 1 to MAX_SUPPLY_DECKS decks) for the next
+    // shuffled shoe of the same size. Returns false, leaving cards alone,
+    // for other sizes.
+    bool exchange(std::vector<uint8_t> &cards);
+
+    // Number of shoes handed out.
+    long long shoes() const
+    {
+        return nShoe.load(std::memory_order_relaxed);
+    }
+
+    // Number of times a table had to wait for a shoe.
+    long long stalls() const
+    {
+        return nStall.load(std::memory_order_relaxed);
+    }
+
+private:
+    ShoeSupply(const ShoeSupply &);
+    ShoeSupply &operator=(const ShoeSupply &);
+
+    // A shoe in a ring. seq is the position it is free for (filled for
+    // position seq - 1 by a thread, then taken at seq + capacity - 1).
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> seq;
+        std::vector<uint8_t> cards;
+    };
+
+    // Ring of shoes of one number of decks.
+    struct Ring
+    {
+        std::atomic<bool> used;  // true once a table asked for this size.
+        Slot *slots;             // capacity slots.
+        alignas(64) std::atomic<uint64_t> head; // Next position to fill.
+        alignas(64) std::atomic<uint64_t> tail; // Next position to take.
+    };
+
+    // Loop of the threads.
+    void run();
+
+    // Shuffle a shoe into the ring of nDeck decks. Returns false if full.
+    bool fill(int nDeck);
+
+    // Wake the sleeping threads up (after a slot is freed).
+    void wakeUp();
+
+    uint64_t seed;        // Seed of the supply.
+    int capacity;         // Shoes in every ring.
+    Ring rings[MAX_SUPPLY_DECKS + 1];    // Rings by number of decks.
+    std::atomic<long long> nShoe;        // Shoes handed out.
+    std::atomic<long long> nStall;       // Waits for a shoe.
+    std::atomic<uint64_t> version;       // Changes as slots are freed.
+    std::atomic<int> sleeping;           // Threads sleeping.
+    std::atomic<bool> stopping;          // true once stopping.
+    std::mutex mutex;                    // For sleeping threads.
+    std::condition_variable wake;        // Wakes the threads up.
+    std::vector<std::thread> threads;    // The threads.
+};
+
+#endif // BLACKJACK_SHOE_SUPPLY_H
@@ -0,0 +1,167 @@
+#ifndef BLACKJACK_SIMULATION_RESULT_H
+#define BLACKJACK_SIMULATION_RESULT_H
+
+#include <algorithm>
+#include <cmath>
+
+#include "hand.h"
+#include "player_hands.h"
+#include "rules.h"
+
+const int MAX_TOTAL = 22; // Value of a busted hand in the histograms.
+
+// Sample variance of the chips gained in a round, from the number of
+// rounds, the sum of the units gained and the sum of their squares.
+inline double chipVariance(long long rounds, long long net,
+                           long long sumSquares)
+{
+    if (rounds < 2)
+        return 0.0;
+    double mean = (double)net / rounds;
+    double var = ((double)sumSquares - mean * net) / (rounds - 1);
+    return std::max(var, 0.0) / (CHIP_UNITS * CHIP_UNITS);
+}
+
+// Accumulated results of simulated rounds (1 chip bet per round).
+// Besides the counts, the sum of the squared units of every round gives
+// the variance, so that results of any threads and runs can be merged
+// and still give exact moments. Each thread keeps its own (aligned on a
+// cache line, so that threads never share one).
+struct alignas(64) SimulationResult
+{
+    long long rounds;              // Number of rounds played.
+    long long hands;               // Number of hands (after splits).
+    long long outcomes[N_OUTCOME]; // Number of hands for each outcome.
+    long long net; // Units gained by the player (see CHIP_UNITS).
+    long long sumSquares; // Sum of the squared units of every round.
+    // Number of hands by outcome, and by final value (2~21, MAX_TOTAL if
+    // busted) or by dealer's face-up card (1~10).
+    long long byTotal[MAX_TOTAL + 1][N_OUTCOME];
+    long long byUpCard[N_POINTS + 1][N_OUTCOME];
+
+    SimulationResult() : rounds(0), hands(0), net(0), sumSquares(0)
+    {
+        for (int i = 0; i < N_OUTCOME; i++)
+        {
+            outcomes[i] = 0;
+            for (int t = 0; t <= MAX_TOTAL; t++)
+                byTotal[t][i] = 0;
+            for (int up = 0; up <= N_POINTS; up++)
+                byUpCard[up][i] = 0;
+        }
+    }
+
+    // Count one round, with the dealer's hand and the units gained (see
+    // playRound()).
+    void add(const PlayerHands &player, const Hand &dealer, int units)
+    {
+        rounds++;
+        hands += player.size();
+        // The dealer's first card is hidden, the second is face-up.
+        int up = dealer.getCard(1).getPoints();
+        for (int i = 0; i < player.size(); i++)
+        {
+            Outcome result = player.outcome(i);
+            outcomes[result]++;
+            byTotal[player[i].getValue()][result]++;
+            byUpCard[up][result]++;
+        }
+        net += units;
+        sumSquares += (long long)units * units;
+    }
+
+    // Merge the results of other rounds.
+    void add(const SimulationResult &other)
+    {
+        rounds += other.rounds;
+        hands += other.hands;
+        net += other.net;
+        sumSquares += other.sumSquares;
+        for (int i = 0; i < N_OUTCOME; i++)
+        {
+            outcomes[i] += other.outcomes[i];
+            for (int t = 0; t <= MAX_TOTAL; t++)
+                byTotal[t][i] += other.byTotal[t][i];
+            for (int up = 0; up <= N_POINTS; up++)
+                byUpCard[up][i] += other.byUpCard[up][i];
+        }
+    }
+
+    // Chips gained by the player.
+    double netChips() const
+    {
+        return (double)net / CHIP_UNITS;
+    }
+
+    // Expected chips gained by the player per round.
+    double ev() const
+    {
+        return rounds == 0 ? 0.0 : netChips() / rounds;
+    }
+
+    // Variance of the chips gained in a round (sample variance).
+    double variance() const
+    {
+        return chipVariance(rounds, net, sumSquares);
+    }
+
+    // Half-width of the confidence interval of ev() (z: the normal
+    // quantile, 1.96 for 95%).
+    double margin(double z = 1.96) const
+    {
+        return rounds == 0 ? 0.0 : z * std::sqrt(variance() / rounds);
+    }
+};
+
+// Accumulated differences of paired rounds: the units gained by a player
+// minus the ones gained by a reference player on the same cards (see
+// Simulator::runCompare()). The rounds of a pair are strongly correlated,
+// so the variance of the difference is much smaller than the sum of the
+// variances of two independent runs.
+struct PairedResult
+{
+    long long rounds;     // Number of pairs of rounds.
+    long long net;        // Sum of the differences (in units).
+    long long sumSquares; // Sum of the squared differences.
+
+    PairedResult() : rounds(0), net(0), sumSquares(0)
+    {
+    }
+
+    // Count the difference of a pair of rounds (in units).
+    void add(int diff)
+    {
+        rounds++;
+        net += diff;
+        sumSquares += (long long)diff * diff;
+    }
+
+    // Merge the differences of other pairs.
+    void add(const PairedResult &other)
+    {
+        rounds += other.rounds;
+        net += other.net;
+        sumSquares += other.sumSquares;
+    }
+
+    // Expected difference of the chips gained per round.
+    double ev() const
+    {
+        return rounds == 0 ? 0.0 : (double)net / CHIP_UNITS / rounds;
+    }
+
+    // Variance of the difference in a round (sample variance).
+    double variance() const
+    {
+        return chipVariance(rounds, net, sumSquares);
+    }
+
+    // Half-width of the confidence interval of ev() (see
+    // SimulationResult::margin()).
+    double margin(double z = 1.96) const
+    {
+        return rounds == 0 ? 0.0 : z * std::sqrt(variance() / rounds);
+    }
+};
+
+#endif // BLACKJACK_SIMULATION_RESULT_H
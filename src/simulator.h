@@ -0,0 +1,918 @@
+#ifndef BLACKJACK_SIMULATOR_H
+#define BLACKJACK_SIMULATOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "checkpoint.h"
+#include "decks.h"
+#include "hand.h"
+#include "history.h"
+#include "player_hands.h"
+#include "precision_stop.h"
+#include "rules.h"
+#include "shard_result.h"
+#include "simulation_result.h"
+
+// Player policies for the headless simulation.
+// A policy decides the move of a hand from the player's hand, the
+// dealer's face-up card and the moves allowed besides hitting and
+// standing (a mask of CAN_DOUBLE, CAN_SPLIT and CAN_SURRENDER), without
+// any input or output: 'h' (hit), 's' (stand), 'd' (double), 'p' (split)
+// or 'u' (surrender). It also decides whether to take insurance when the
+// dealer shows an ace.
+
+// Policy that plays like the dealer (hits until the value >= 17).
+struct MimicDealerPolicy
+{
+    char decide(const Hand &player, const Card &, int) const
+    {
+        return player.getValue() < 17 ? 'h' : 's';
+    }
+
+    bool insure(const Hand &) const
+    {
+        return false;
+    }
+};
+
+// Policy that never risks busting (hits only below 12).
+struct NeverBustPolicy
+{
+    char decide(const Hand &player, const Card &, int) const
+    {
+        return player.getValue() < 12 ? 'h' : 's';
+    }
+
+    bool insure(const Hand &) const
+    {
+        return false;
+    }
+};
+
+// Reference to a policy of any type, so that the seats of a table (see
+// Seat) can play with policies of different types. Calls go through
+// function pointers.
+class PolicyRef
+{
+public:
+    template <class Policy>
+    PolicyRef(const Policy &policy1)
+        : policy(&policy1), decideOf(&decideWith<Policy>),
+          insureOf(&insureWith<Policy>)
+    {
+    }
+
+    char decide(const Hand &player, const Card &upCard, int moves) const
+    {
+        return decideOf(policy, player, upCard, moves);
+    }
+
+    bool insure(const Hand &player) const
+    {
+        return insureOf(policy, player);
+    }
+
+private:
+    template <class Policy>
+    static char decideWith(const void *policy, const Hand &player,
+                           const Card &upCard, int moves)
+    {
+        return static_cast<const Policy *>(policy)->decide(player, upCard,
+                                                           moves);
+    }
+
+    template <class Policy>
+    static bool insureWith(const void *policy, const Hand &player)
+    {
+        return static_cast<const Policy *>(policy)->insure(player);
+    }
+
+    const void *policy; // The policy referred to.
+    char (*decideOf)(const void *, const Hand &, const Card &, int);
+    bool (*insureOf)(const void *, const Hand &);
+};
+
+// Moves allowed to the active hand of the player besides hitting and
+// standing (a mask of CAN_DOUBLE, CAN_SPLIT and CAN_SURRENDER).
+template <class Rules>
+int allowedMoves(const PlayerHands &player, const Rules &rules)
+{
+    const Hand &hand = player.active();
+    bool firstTwo = hand.size() == 2;
+    bool splitAces = player.splitAces(player.activeIndex());
+    int moves = 0;
+    if (firstTwo && rules.doubleAllowed() && !splitAces &&
+        (!player.isSplit() || rules.doubleAfterSplitAllowed()))
+        moves |= CAN_DOUBLE;
+    if (player.canSplit(rules.maxHands(), rules.resplitAcesAllowed()))
+        moves |= CAN_SPLIT;
+    if (firstTwo && !player.isSplit() && rules.surrenderAllowed())
+        moves |= CAN_SURRENDER;
+    return moves;
+}
+
+// Play the active hand of the player until it ends (see playRound()).
+// Returns true if the hand stands, so that the dealer has to play.
+template <class Policy, class Rules, class Shoe>
+bool playHand(Shoe &decks, PlayerHands &player, const Card &upCard,
+              const Policy &policy, const Rules &rules, HandRecord *record)
+{
+    Hand &hand = player.active();
+    // A split hand gets its second card when its turn comes.
+    if (hand.size() == 1)
+        hand.addCard(decks.deal());
+    while (true)
+    {
+        if (hand.busted())
+        {
+            player.finish('b');
+            return false;
+        }
+        bool splitAces = player.splitAces(player.activeIndex());
+        int moves = allowedMoves(player, rules);
+        // Split aces get one card each, unless they are split again.
+        if (splitAces && !(moves & CAN_SPLIT))
+        {
+            player.finish('s');
+            return true;
+        }
+        char in = policy.decide(hand, upCard, moves);
+        // A move that is not allowed is played as a hit.
+        if ((in == 'd' && !(moves & CAN_DOUBLE)) ||
+            (in == 'p' && !(moves & CAN_SPLIT)) ||
+            (in == 'u' && !(moves & CAN_SURRENDER)))
+            in = 'h';
+        if (splitAces && in != 'p')
+            in = 's';
+        if (record)
+            record->decide(in);
+        switch (in)
+        {
+        case 'h':
+            hand.addCard(decks.deal());
+            break;
+        case 'd':
+            player.doubleDown();
+            hand.addCard(decks.deal());
+            player.finish(hand.busted() ? 'b' : 's');
+            return !hand.busted();
+        case 'p':
+            player.split();
+            hand.addCard(decks.deal());
+            break;
+        case 'u':
+            player.finish('u');
+            return false;
+        default:
+            player.finish('s');
+            return true;
+        }
+    }
+}
+
+// Play the hands of a player dealt two cards (see playRound()), taking
+// insurance first if offered and the policy wants it. Sets stood if a
+// hand stands (so that the dealer has to play), and returns the units
+// gained by the insurance.
+template <class Policy, class Rules, class Shoe>
+int playSeat(Shoe &decks, PlayerHands &player, const Hand &dealer,
+             const Policy &policy, const Rules &rules, HandRecord *record,
+             bool &stood)
+{
+    // The dealer's first card is hidden, the second is face-up.
+    Card upCard = dealer.getCard(1);
+    int units = 0;
+    if (rules.insuranceOffered() && upCard.getPoints() == 1 &&
+        policy.insure(player[0]))
+        units += insuranceUnits(dealer);
+
+    // With the peek rule, the dealer's blackjack ends the round at once.
+    if (player[0].blackjack())
+        player.finish('j');
+    else if (rules.dealerPeeks() && dealer.blackjack())
+        player.finish('k');
+    else
+        do
+            stood |= playHand(decks, player, upCard, policy, rules, record);
+        while (player.next());
+    return units;
+}
+
+// Settle every hand of a player against the dealer's hand (once the
+// dealer played, if needed). Returns the units gained.
+template <class Rules>
+int settleHands(PlayerHands &player, const Hand &dealer, const Rules &rules)
+{
+    int units = 0;
+    for (int i = 0; i < player.size(); i++)
+    {
+        Outcome result = settle(player.way(i), player[i], dealer);
+        player.setOutcome(i, result);
+        units += payoffUnits(result, rules) * player.bet(i);
+    }
+    return units;
+}
+
+// Play one round without any input or output, following the same
+// stages as the Game class (stages 2-4) with a bet of 1 chip, under the
+// given rule set (see rules.h): the hands of the player (see
+// PlayerHands) are played one after the other, and settled separately
+// against the dealer's hand. Returns the units gained in the round
+// (see CHIP_UNITS; doubles, splits and insurance included), and leaves
+// the outcome of every hand in player.
+// If record is given, the decisions, the first hand, the dealer's hand
+// and the units gained are recorded in it (after record->begin() was
+// called by the caller).
+// The cards come from decks: a Decks, or any shoe with the same
+// needsShuffle(), shuffle(), position() and deal() (see ShoeCursor).
+template <class Policy, class Rules = StandardRules, class Shoe = Decks>
+int playRound(Shoe &decks, PlayerHands &player, Hand &dealer,
+              const Policy &policy, const Rules &rules = Rules(),
+              HandRecord *record = 0)
+{
+    dealer.removeAllCards(); // return all cards
+    player.reset();          // return all cards
+    // Shuffle the cards once the cut card came out.
+    if (decks.needsShuffle())
+        decks.shuffle();
+    if (record)
+        record->position = (uint16_t)decks.position();
+
+    // Dealing two cards to each player.
+    dealer.addCard(decks.deal());
+    player[0].addCard(decks.deal());
+    dealer.addCard(decks.deal());
+    player[0].addCard(decks.deal());
+
+    bool stood = false;
+    int units = playSeat(decks, player, dealer, policy, rules, record, stood);
+    if (stood)
+        dealerPlay(dealer, decks, rules);
+    units += settleHands(player, dealer, rules);
+    if (record)
+        record->end(player[0], dealer, player.outcome(0), units);
+    return units;
+}
+
+// Seat of a table (see playTable()): the policy and the bet (in chips)
+// of a player, and the hands and the units gained of the current round.
+template <class Policy>
+struct Seat
+{
+    const Policy *policy; // Policy of the player.
+    int bet;              // Chips bet every round.
+    PlayerHands hands;    // Hands of the current round.
+    int units;            // Units gained in the current round.
+
+    Seat(const Policy *policy1 = 0, int bet1 = 1)
+        : policy(policy1), bet(bet1), units(0)
+    {
+    }
+};
+
+// Play one round at a table of nSeat seats drawing from the same decks,
+// against one dealer's hand. The seats are advanced together: the cards
+// are dealt in the order of playRound() (to the dealer, then to every
+// seat, twice), the seats play their hands in turn, the dealer plays once
+// for all of them, and every hand is settled against the dealer's hand.
+// The units gained by every seat (with its bet) are left in the seat.
+// A table of one seat with a bet of 1 chip plays like playRound().
+template <class Policy, class Rules = StandardRules>
+void playTable(Decks &decks, Seat<Policy> *seats, int nSeat, Hand &dealer,
+               const Rules &rules = Rules())
+{
+    dealer.removeAllCards(); // return all cards
+    for (int s = 0; s < nSeat; s++)
+        seats[s].hands.reset(); // return all cards
+    // Shuffle the cards once the cut card came out.
+    if (decks.needsShuffle())
+        decks.shuffle();
+
+    // Dealing two cards to each player.
+    for (int k = 0; k < 2; k++)
+    {
+        dealer.addCard(decks.deal());
+        for (int s = 0; s < nSeat; s++)
+            seats[s].hands[0].addCard(decks.deal());
+    }
+
+    bool stood = false;
+    for (int s = 0; s < nSeat; s++)
+        seats[s].units = playSeat(decks, seats[s].hands, dealer,
+                                  *seats[s].policy, rules, 0, stood);
+    if (stood)
+        dealerPlay(dealer, decks, rules);
+    for (int s = 0; s < nSeat; s++)
+        seats[s].units = (seats[s].units +
+                          settleHands(seats[s].hands, dealer, rules)) *
+                         seats[s].bet;
+}
+
+// Results of the players compared by Simulator::runCompare(): the results
+// of every player, and the differences of every player with the first one
+// (diffs[0] is empty).
+struct Comparison
+{
+    std::vector<SimulationResult> results;
+    std::vector<PairedResult> diffs;
+};
+
+// Class that runs rounds headlessly on all cores, of a single player or
+// of a table of seats.
+// Rounds are split into fixed-size blocks, and every block shuffles its
+// own decks from a seed derived from the master seed and the block index.
+// Threads pick blocks in any order, so results for a given seed are the
+// same regardless of the number of threads.
+// Rounds can be recorded in a hand history (see history.h), with a seed
+// record for every block.
+// A run of a single player can be checkpointed to a file in the
+// background (see Checkpointer) and resumed from it after an
+// interruption, with the same result as a run never interrupted, or it
+// can stop early once its EV is known to a given precision (see
+// PrecisionStop).
+// A run can also be split into shards, ranges of its blocks played by
+// separate processes (see setShard()): as every block has its own seed,
+// the results of the shards add up to the result of the whole run.
+class Simulator
+{
+public:
+    // Constructor. nThread == 0 uses all hardware threads.
+    Simulator(const ShoeConfig &shoe1 = ShoeConfig(), int nThread1 = 0,
+              uint64_t seed1 = 0)
+        : shoe(shoe1), nThread(nThread1), seed(seed1), checkpointFile(),
+          checkpointTag(), checkpointInterval(0), precision(0), z(1.96),
+          shardIndex(0), shardCount(1)
+    {
+        Decks check(shoe); // throws for a bad number of decks or cut.
+        if (nThread <= 0)
+            nThread = std::thread::hardware_concurrency();
+        if (nThread <= 0)
+            nThread = 1;
+    }
+
+    // Save the state of the runs of a single player to file every
+    // interval seconds, and resume them from it (see run()). tag
+    // describes the rules and the policy, which must match to resume.
+    void setCheckpoint(const std::string &file, const std::string &tag,
+                       double interval = 60)
+    {
+        checkpointFile = file;
+        checkpointTag = tag;
+        checkpointInterval = interval;
+    }
+
+    // Stop the runs of a single player once the half-width of the
+    // confidence interval of the EV (z: its normal quantile) is at most
+    // precision1 chips, or after all their rounds (0: never stop early).
+    void setPrecision(double precision1, double z1 = 1.96)
+    {
+        precision = precision1;
+        z = z1;
+    }
+
+    // Play only the index-th of count shards of the blocks of every run
+    // (0 <= index < count); throws BadShard otherwise. The results of all
+    // shards merge into the result of the whole run (see ShardResult). A
+    // shard never stops early (see setPrecision()).
+    void setShard(int index, int count)
+    {
+        if (count < 1 || index < 0 || index >= count)
+            throw BadShard();
+        shardIndex = index;
+        shardCount = count;
+    }
+
+    // Get the blocks of a run of nRound rounds that the shard plays:
+    // first to last - 1 (all of them without a shard).
+    void shardBlocks(long long nRound, long long &first,
+                     long long &last) const
+    {
+        long long nBlock = (nRound + BLOCK_ROUNDS - 1) / BLOCK_ROUNDS;
+        first = nBlock * shardIndex / shardCount;
+        last = nBlock * (shardIndex + 1) / shardCount;
+    }
+
+    // Play nRound rounds with the given policy and rule set (recording
+    // them in history, if given). See also runWithRules().
+    // With a checkpoint file (see setCheckpoint()), the run resumes from
+    // the file if it exists, and throws BadCheckpoint if the file holds
+    // another run or cannot be read; it cannot be recorded in a history. A run with a
+    // history or a checkpoint never stops early (see setPrecision()).
+    template <class Policy, class Rules = StandardRules>
+    SimulationResult run(long long nRound, const Policy &policy = Policy(),
+                         HistoryWriter *history = 0,
+                         const Rules &rules = Rules()) const
+    {
+        long long nBlock = (nRound + BLOCK_ROUNDS - 1) / BLOCK_ROUNDS;
+        long long first, last;
+        shardBlocks(nRound, first, last);
+        Checkpoint start;
+        std::unique_ptr<Checkpointer> checkpointer;
+        if (!checkpointFile.empty())
+        {
+            if (history)
+                throw BadCheckpoint();
+            start.tag = checkpointTag;
+            if (shardCount > 1)
+                start.tag += ", shard " + std::to_string(shardIndex) + "/" +
+                             std::to_string(shardCount);
+            start.seed = seed;
+            start.nRound = nRound;
+            start.nBlock = nBlock;
+            start.shoe = shoe;
+            start.done.assign(nBlock, false);
+            Checkpoint saved;
+            if (saved.load(checkpointFile))
+            {
+                if (!saved.sameRun(start))
+                    throw BadCheckpoint();
+                start = saved;
+            }
+            checkpointer.reset(new Checkpointer(
+                checkpointFile, checkpointInterval, start, nThread));
+            checkpointer->start();
+        }
+
+        std::unique_ptr<PrecisionStop> stop;
+        if (precision > 0 && !history && !checkpointer && shardCount == 1)
+            stop.reset(new PrecisionStop(precision, z));
+
+        BlockQueue queue(first, last, checkpointer ? &start : 0);
+        std::vector<WorkerResult> results(nThread);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < nThread; t++)
+            workers.push_back(std::thread(
+                &Simulator::runBlocks<Policy, Rules>, this, nRound,
+                std::ref(queue), std::cref(policy), std::cref(rules),
+                history, checkpointer.get(), stop.get(), t,
+                std::ref(results[t])));
+        SimulationResult total = start.total;
+        for (int t = 0; t < nThread; t++)
+            workers[t].join();
+        for (int t = 0; t < nThread; t++)
+        {
+            total.add(results[t].total);
+            // Blocks finished ahead of the prefix, up to the stop.
+            for (size_t i = 0; i < results[t].pending.size(); i++)
+                if (stop->confirmed(results[t].pending[i].first, true))
+                    total.add(results[t].pending[i].second);
+        }
+        if (checkpointer)
+            checkpointer->finish();
+        return total;
+    }
+
+    // Play nRound rounds at a table of seats sharing every shoe (see
+    // playTable()), the i-th seat playing with policies[i] and a bet of 1
+    // chip, under the given rule set. Returns the results of every seat.
+    // See also runTableWithRules().
+    template <class Policy, class Rules = StandardRules>
+    std::vector<SimulationResult>
+    runTable(long long nRound, const std::vector<Policy> &policies,
+             const Rules &rules = Rules()) const
+    {
+        long long first, nBlock;
+        shardBlocks(nRound, first, nBlock);
+        std::atomic<long long> nextBlock(first);
+        std::vector<std::vector<SimulationResult> > results(
+            nThread, std::vector<SimulationResult>(policies.size()));
+        std::vector<std::thread> workers;
+        for (int t = 0; t < nThread; t++)
+            workers.push_back(std::thread(
+                &Simulator::runTableBlocks<Policy, Rules>, this, nRound,
+                nBlock, std::ref(nextBlock), std::cref(policies),
+                std::cref(rules), std::ref(results[t])));
+        std::vector<SimulationResult> total(policies.size());
+        for (int t = 0; t < nThread; t++)
+        {
+            workers[t].join();
+            for (size_t s = 0; s < policies.size(); s++)
+                total[s].add(results[t][s]);
+        }
+        return total;
+    }
+
+    // Play nRound rounds with every policy on the same cards, under the
+    // given rule set (common random numbers): every shoe is shuffled once
+    // and dealt to the policies in turn, each playing the round alone
+    // from the same position (see ShoeCursor), and the next round starts
+    // where the first policy's round ended. The differences with the first
+    // policy are paired round by round, so that they are known to a given
+    // precision in far fewer rounds than with independent runs.
+    // See also runCompareWithRules().
+    template <class Policy, class Rules = StandardRules>
+    Comparison runCompare(long long nRound,
+                          const std::vector<Policy> &policies,
+                          const Rules &rules = Rules()) const
+    {
+        long long first, nBlock;
+        shardBlocks(nRound, first, nBlock);
+        std::atomic<long long> nextBlock(first);
+        std::vector<Comparison> results(nThread);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < nThread; t++)
+            workers.push_back(std::thread(
+                &Simulator::runCompareBlocks<Policy, Rules>, this, nRound,
+                nBlock, std::ref(nextBlock), std::cref(policies),
+                std::cref(rules), std::ref(results[t])));
+        Comparison total;
+        total.results.resize(policies.size());
+        total.diffs.resize(policies.size());
+        for (int t = 0; t < nThread; t++)
+        {
+            workers[t].join();
+            for (size_t k = 0; k < policies.size(); k++)
+            {
+                total.results[k].add(results[t].results[k]);
+                total.diffs[k].add(results[t].diffs[k]);
+            }
+        }
+        return total;
+    }
+
+    // Number of threads used.
+    int threads() const
+    {
+        return nThread;
+    }
+
+    static const long long BLOCK_ROUNDS = 1 << 16; // Rounds per block.
+
+private:
+    // Results of a worker: its rounds, and the blocks it keeps aside until
+    // the prefix of an early stop reaches them (see PrecisionStop).
+    struct WorkerResult
+    {
+        SimulationResult total;
+        std::vector<std::pair<long long, SimulationResult> > pending;
+    };
+
+    // Work of a single thread: play blocks until none are left
+    // (publishing its state to checkpointer, if given, as worker w, and
+    // stopping with stop, if given).
+    template <class Policy, class Rules>
+    void runBlocks(long long nRound, BlockQueue &queue,
+                   const Policy &policy, const Rules &rules,
+                   HistoryWriter *history, Checkpointer *checkpointer,
+                   PrecisionStop *stop, int w, WorkerResult &result) const
+    {
+        Decks decks(shoe);
+        PlayerHands player;
+        Hand dealer;
+        SimulationResult local, block;
+        std::unique_ptr<HistoryBuffer> buffer;
+        if (history)
+            buffer.reset(new HistoryBuffer(*history));
+        std::vector<long long> finished; // Blocks not published yet.
+        long long b;
+        const BlockState *state;
+        while (queue.next(b, state))
+        {
+            if (stop && !stop->admit(b))
+                break;
+            long long first = b * BLOCK_ROUNDS;
+            long long last = std::min(first + BLOCK_ROUNDS, nRound);
+            long long r = first;
+            if (state)
+            {
+                // The saved shoe of a block in progress.
+                decks.restore(state->decks);
+                r += state->round;
+            }
+            else
+            {
+                // Fresh decks in the initial order for every block.
+                decks.create(shoe.nDeck);
+                decks.seed(blockSeed(b));
+            }
+            if (stop)
+            {
+                // Rounds past the stop are not played.
+                block = SimulationResult();
+                for (; r < last && !stop->stopped(); r++)
+                {
+                    int units =
+                        playRound(decks, player, dealer, policy, rules);
+                    block.add(player, dealer, units);
+                }
+                if (r < last)
+                    break;
+                stop->finished(b, block);
+                result.pending.push_back(std::make_pair(b, block));
+                keepConfirmed(*stop, result.pending, local);
+                continue;
+            }
+            if (!buffer)
+            {
+                for (; r < last; r++)
+                {
+                    if (checkpointer && checkpointer->pending(w))
+                        checkpointer->publish(w, local, finished, b,
+                                              r - first, &decks);
+                    int units =
+                        playRound(decks, player, dealer, policy, rules);
+                    local.add(player, dealer, units);
+                }
+                if (checkpointer)
+                    finished.push_back(b);
+                continue;
+            }
+            buffer->next() = HandRecord::seedRecord(b, blockSeed(b));
+            for (; r < last; r++)
+            {
+                HandRecord &record = buffer->next();
+                record.begin(b, r - first, 1);
+                int units =
+                    playRound(decks, player, dealer, policy, rules, &record);
+                local.add(player, dealer, units);
+            }
+        }
+        if (checkpointer)
+            checkpointer->publish(w, local, finished, -1, 0, 0);
+        result.total = local;
+    }
+
+    // Move the blocks of pending that the prefix of stop reached into
+    // total.
+    static void
+    keepConfirmed(const PrecisionStop &stop,
+                  std::vector<std::pair<long long, SimulationResult> > &pending,
+                  SimulationResult &total)
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            if (stop.confirmed(pending[i].first))
+                total.add(pending[i].second);
+            else
+                pending[kept++] = pending[i];
+        }
+        pending.resize(kept);
+    }
+
+    // Work of a single thread at a table: play blocks until none are
+    // left.
+    template <class Policy, class Rules>
+    void runTableBlocks(long long nRound, long long nBlock,
+                        std::atomic<long long> &nextBlock,
+                        const std::vector<Policy> &policies,
+                        const Rules &rules,
+                        std::vector<SimulationResult> &results) const
+    {
+        Decks decks(shoe);
+        std::vector<Seat<Policy> > seats;
+        for (size_t s = 0; s < policies.size(); s++)
+            seats.push_back(Seat<Policy>(&policies[s]));
+        int nSeat = (int)seats.size();
+        Hand dealer;
+        std::vector<SimulationResult> local(nSeat);
+        long long b;
+        while ((b = nextBlock++) < nBlock)
+        {
+            // Fresh decks in the initial order for every block.
+            decks.create(shoe.nDeck);
+            decks.seed(blockSeed(b));
+            long long first = b * BLOCK_ROUNDS;
+            long long last = std::min(first + BLOCK_ROUNDS, nRound);
+            for (long long r = first; r < last; r++)
+            {
+                playTable(decks, seats.data(), nSeat, dealer, rules);
+                for (int s = 0; s < nSeat; s++)
+                    local[s].add(seats[s].hands, dealer, seats[s].units);
+            }
+        }
+        results = local;
+    }
+
+    // Work of a single thread comparing policies: play blocks until none
+    // are left.
+    template <class Policy, class Rules>
+    void runCompareBlocks(long long nRound, long long nBlock,
+                          std::atomic<long long> &nextBlock,
+                          const std::vector<Policy> &policies,
+                          const Rules &rules, Comparison &result) const
+    {
+        Decks decks(shoe);
+        ShoeCursor cursor(decks); // The shoe shared by the policies.
+        PlayerHands player;
+        Hand dealer;
+        Comparison local;
+        local.results.resize(policies.size());
+        local.diffs.resize(policies.size());
+        long long b;
+        while ((b = nextBlock++) < nBlock)
+        {
+            // Every shoe is seeded from the block and its number, so the
+            // cards do not depend on how far the policies dealt them.
+            long long nShoe = 0;
+            cursor.newShoe(shoeSeed(b, nShoe++));
+            int start = 0; // Position of the next round.
+            long long first = b * BLOCK_ROUNDS;
+            long long last = std::min(first + BLOCK_ROUNDS, nRound);
+            for (long long r = first; r < last; r++)
+            {
+                // A new shoe once the cut card came out.
+                if (r > first &&
+                    (shoe.continuous || start >= decks.cutCardPosition()))
+                {
+                    cursor.newShoe(shoeSeed(b, nShoe++));
+                    start = 0;
+                }
+                int next = start, reference = 0;
+                for (size_t k = 0; k < policies.size(); k++)
+                {
+                    cursor.seek(start);
+                    int units =
+                        playRound(cursor, player, dealer, policies[k], rules);
+                    local.results[k].add(player, dealer, units);
+                    if (k == 0)
+                    {
+                        reference = units;
+                        next = cursor.position();
+                    }
+                    else
+                        local.diffs[k].add(units - reference);
+                }
+                start = next;
+            }
+        }
+        result = local;
+    }
+
+    // Seed of the b-th block (splitmix64 of the master seed and b).
+    uint64_t blockSeed(long long b) const
+    {
+        uint64_t state = seed + b * 0x9E3779B97F4A7C15ULL;
+        return splitmix64(state);
+    }
+
+    // Seed of the n-th shoe of the b-th block (see runCompareBlocks()).
+    uint64_t shoeSeed(long long b, long long n) const
+    {
+        uint64_t state = blockSeed(b) + n * 0x9E3779B97F4A7C15ULL;
+        return splitmix64(state);
+    }
+
+    ShoeConfig shoe; // Configuration of every shoe.
+    int nThread;     // Number of worker threads.
+    uint64_t seed;   // Master seed.
+    std::string checkpointFile; // Checkpoint file, if any.
+    std::string checkpointTag;  // Rules and policy of the checkpoints.
+    double checkpointInterval;  // Seconds between checkpoints.
+    double precision; // Half-width of the EV to stop at (0: never).
+    double z;         // Normal quantile of the interval.
+    int shardIndex;   // Shard played (see setShard()).
+    int shardCount;   // Number of shards of a run.
+};
+
+// Runtime factory of the round engine: call job(rules) with the rules of
+// config as a rule set specialized for them (see FixedRules), or as the
+// runtime-flag engine (RuleConfig itself) for an uncommon payout or set
+// of moves. A job is a class with a template operator() over the rule
+// set, returning its type Result.
+// The helpers below pick the remaining rules one at a time.
+template <bool H17, int BJ_NUM, int BJ_DEN, bool PEEK, bool SURRENDER,
+          class Job>
+typename Job::Result pickMoves(const RuleConfig &config, const Job &job)
+{
+    // The moves of the original game, and the common casino moves
+    // (double any two cards, after splits too, split to 4 hands) are
+    // specialized.
+    if (!config.doubleDown && config.splitHands == 1 && !config.insurance)
+        return job(FixedRules<H17, BJ_NUM, BJ_DEN, PEEK, SURRENDER>());
+    if (config.doubleDown && config.splitHands == 4 &&
+        config.doubleAfterSplit && !config.resplitAces && !config.insurance)
+        return job(FixedRules<H17, BJ_NUM, BJ_DEN, PEEK, SURRENDER, true, 4,
+                              true, false, false>());
+    return job(config);
+}
+
+template <bool H17, int BJ_NUM, int BJ_DEN, bool PEEK, class Job>
+typename Job::Result pickSurrender(const RuleConfig &config, const Job &job)
+{
+    if (config.surrender)
+        return pickMoves<H17, BJ_NUM, BJ_DEN, PEEK, true>(config, job);
+    return pickMoves<H17, BJ_NUM, BJ_DEN, PEEK, false>(config, job);
+}
+
+template <bool H17, int BJ_NUM, int BJ_DEN, class Job>
+typename Job::Result pickPeek(const RuleConfig &config, const Job &job)
+{
+    if (config.peek)
+        return pickSurrender<H17, BJ_NUM, BJ_DEN, true>(config, job);
+    return pickSurrender<H17, BJ_NUM, BJ_DEN, false>(config, job);
+}
+
+template <bool H17, class Job>
+typename Job::Result pickPayout(const RuleConfig &config, const Job &job)
+{
+    // Payouts in units per chip (1:1, 3:2 and 6:5 are specialized).
+    switch (config.blackjackUnits())
+    {
+    case CHIP_UNITS:
+        return pickPeek<H17, 1, 1>(config, job);
+    case CHIP_UNITS * 3 / 2:
+        return pickPeek<H17, 3, 2>(config, job);
+    case CHIP_UNITS * 6 / 5:
+        return pickPeek<H17, 6, 5>(config, job);
+    default:
+        return job(config);
+    }
+}
+
+template <class Job>
+typename Job::Result withRules(const RuleConfig &config, const Job &job)
+{
+    if (config.hitSoft17)
+        return pickPayout<true>(config, job);
+    return pickPayout<false>(config, job);
+}
+
+// Jobs of the factory: the rounds of one player, of a table, or of
+// policies compared.
+template <class Policy>
+struct RunJob
+{
+    typedef SimulationResult Result;
+
+    const Simulator &sim;
+    long long nRound;
+    const Policy &policy;
+    HistoryWriter *history;
+
+    template <class Rules>
+    Result operator()(const Rules &rules) const
+    {
+        return sim.run(nRound, policy, history, rules);
+    }
+};
+
+template <class Policy>
+struct TableJob
+{
+    typedef std::vector<SimulationResult> Result;
+
+    const Simulator &sim;
+    long long nRound;
+    const std::vector<Policy> &policies;
+
+    template <class Rules>
+    Result operator()(const Rules &rules) const
+    {
+        return sim.runTable(nRound, policies, rules);
+    }
+};
+
+template <class Policy>
+struct CompareJob
+{
+    typedef Comparison Result;
+
+    const Simulator &sim;
+    long long nRound;
+    const std::vector<Policy> &policies;
+
+    template <class Rules>
+    Result operator()(const Rules &rules) const
+    {
+        return sim.runCompare(nRound, policies, rules);
+    }
+};
+
+// Play nRound rounds under the rules of config (see withRules()), with
+// Simulator::run(), Simulator::runTable() or Simulator::runCompare().
+template <class Policy>
+SimulationResult runWithRules(const Simulator &sim, const RuleConfig &config,
+                              long long nRound, const Policy &policy,
+                              HistoryWriter *history = 0)
+{
+    RunJob<Policy> job = {sim, nRound, policy, history};
+    return withRules(config, job);
+}
+
+template <class Policy>
+std::vector<SimulationResult>
+runTableWithRules(const Simulator &sim, const RuleConfig &config,
+                  long long nRound, const std::vector<Policy> &policies)
+{
+    TableJob<Policy> job = {sim, nRound, policies};
+    return withRules(config, job);
+}
+
+template <class Policy>
+Comparison runCompareWithRules(const Simulator &sim,
+                               const RuleConfig &config, long long nRound,
+                               const std::vector<Policy> &policies)
+{
+    CompareJob<Policy> job = {sim, nRound, policies};
+    return withRules(config, job);
+}
+
+#endif // BLACKJACK_SIMULATOR_H
@@ -0,0 +1,335 @@
+#include "strategy.h"
+
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+
+// Number of cards of a set (see CompositionStrategy::handKey()).
+static int cardsOf(uint64_t k)
+{
+    const int bits = CompositionStrategy::KEY_BITS;
+    int n = 0;
+    for (int i = 0; i < N_POINTS; i++)
+        n += (k >> (bits * i)) & ((1 << bits) - 1);
+    return n;
+}
+
+void StrategyTable::print(int nCard) const
+{
+    cout << nCard << (nCard == MAX_CARDS ? "+" : "") << " cards";
+    for (int up = 2; up <= N_POINTS + 1; up++)
+        cout << '\t' << (up > N_POINTS ? "A" : RANK_NAMES[up]);
+    cout << endl;
+    for (int soft = 0; soft <= 1; soft++)
+        for (int value = soft ? 12 : 4; value <= 21; value++)
+        {
+            cout << (soft ? "soft " : "hard ") << value;
+            for (int up = 2; up <= N_POINTS + 1; up++)
+            {
+                int u = up > N_POINTS ? 1 : up;
+                int e = index(u, value, soft, nCard);
+                cout << '\t'
+                     << (nCard == 2 && surrenders[e] ? 'R'
+                         : nCard == 2 && doubles[e]  ? 'D'
+                         : decisions[e] == 'h'       ? 'H'
+                                                     : 'S');
+            }
+            cout << endl;
+        }
+    if (nCard != 2)
+        return;
+    for (int pair = N_POINTS + 1; pair >= 2; pair--)
+    {
+        cout << "pair " << (pair > N_POINTS ? "A" : RANK_NAMES[pair]);
+        for (int up = 2; up <= N_POINTS + 1; up++)
+            cout << '\t'
+                 << (splits[up > N_POINTS ? 1 : up]
+                           [pair > N_POINTS ? 1 : pair]
+                         ? 'P'
+                         : '-');
+        cout << endl;
+    }
+}
+
+StrategyGenerator::StrategyGenerator(int nDeck1, int nThread1,
+                                     const RuleConfig &rules1)
+    : nDeck(nDeck1), nThread(nThread1), rules(rules1)
+{
+    int counts[N_POINTS + 1];
+    DealerProbabilities::fullShoe(nDeck, counts); // checks nDeck.
+    // The dealer's probabilities are computed in the worker threads, so
+    // the shoe is checked here for them.
+    if (counts[N_POINTS] > DealerProbabilities::MAX_COUNT)
+        throw BadNumberDecks();
+    if (nThread <= 0)
+        nThread = thread::hardware_concurrency();
+    if (nThread <= 0)
+        nThread = 1;
+}
+
+void StrategyGenerator::generate(StrategyTable &table,
+                                 CompositionStrategy *cd) const
+{
+    vector<HandMap> hands(N_POINTS + 1);
+    SplitTable splits;
+    atomic<int> nextCard(1);
+    vector<thread> workers;
+    for (int t = 0; t < nThread && t < N_POINTS; t++)
+        workers.push_back(thread(&StrategyGenerator::runCards, this,
+                                 ref(nextCard), ref(hands), ref(splits)));
+    for (int t = 0; t < (int)workers.size(); t++)
+        workers[t].join();
+
+    for (int up = 1; up <= N_POINTS; up++)
+    {
+        fillTable(table, up, hands[up]);
+        for (int pair = 1; pair <= N_POINTS; pair++)
+        {
+            table.splits[up][pair] = splits[up][pair];
+            if (cd)
+                cd->splits[up][pair] = splits[up][pair];
+        }
+        if (!cd)
+            continue;
+        for (HandMap::const_iterator it = hands[up].begin();
+             it != hands[up].end(); it++)
+        {
+            const HandEV &ev = it->second;
+            uint64_t k = CompositionStrategy::key(it->first, up);
+            cd->decisions[k] = ev.hit > ev.stand ? 'h' : 's';
+            if (cardsOf(it->first) != 2)
+                continue;
+            if (ev.dbl > max(ev.hit, ev.stand))
+                cd->doubles.insert(k);
+            if (rules.surrender && bestEV(ev, false) < ev.surrender)
+                cd->surrenders.insert(k);
+        }
+    }
+}
+
+void StrategyGenerator::runCards(atomic<int> &nextCard,
+                                 vector<HandMap> &hands,
+                                 SplitTable &splits) const
+{
+    int up;
+    while ((up = nextCard++) <= N_POINTS)
+    {
+        DealerProbabilities dealer(DealerProbabilities::DEFAULT_BUDGET,
+                                   rules.hitSoft17);
+        int counts[N_POINTS + 1];
+        DealerProbabilities::fullShoe(nDeck, counts);
+        counts[up]--;
+        int held[N_POINTS + 1] = {0};
+        // Every first two cards except the blackjack.
+        for (int a = 1; a <= N_POINTS; a++)
+            for (int b = a; b <= N_POINTS; b++)
+            {
+                if (a + b == 11 && (a == 1 || b == 1))
+                    continue;
+                if (counts[a] == 0 || counts[b] - (a == b) <= 0)
+                    continue;
+                counts[a]--, held[a]++;
+                counts[b]--, held[b]++;
+                evaluate(dealer, up, counts, held, 2, a + b,
+                         a == 1 || b == 1, hands[up]);
+                counts[a]++, held[a]--;
+                counts[b]++, held[b]--;
+            }
+        splitPairs(dealer, up, counts, hands[up], splits[up]);
+    }
+}
+
+void StrategyGenerator::splitPairs(DealerProbabilities &dealer, int up,
+                                   int counts[N_POINTS + 1], HandMap &hands,
+                                   bool split[N_POINTS + 1]) const
+{
+    int held[N_POINTS + 1] = {0};
+    for (int a = 1; a <= N_POINTS; a++)
+    {
+        split[a] = false;
+        if (counts[a] < 2)
+            continue;
+        // EV of not splitting the pair.
+        counts[a] -= 2, held[a] += 2;
+        HandEV pair = evaluate(dealer, up, counts, held, 2, 2 * a, a == 1,
+                               hands);
+        held[a] -= 2;
+        int total = 0;
+        for (int c = 1; c <= N_POINTS; c++)
+            total += counts[c];
+        // EV of one of the split hands: its second card is drawn from the
+        // shoe without the pair, and the hand is played on from there
+        // (the cards of the other hand are not removed). The cards left
+        // differ from the ones of an unsplit hand of the same cards, so
+        // the EVs are memoized apart.
+        HandMap splitHands;
+        bool das = rules.doubleDown && rules.doubleAfterSplit;
+        double ev = 0;
+        for (int c = 1; c <= N_POINTS; c++)
+        {
+            if (counts[c] == 0)
+                continue;
+            double p = (double)counts[c] / total;
+            counts[c]--, held[a]++, held[c]++;
+            HandEV sub = evaluate(dealer, up, counts, held, 2, a + c,
+                                  a == 1 || c == 1, splitHands);
+            counts[c]++, held[a]--, held[c]--;
+            // Split aces take one card each.
+            double best = a == 1 ? sub.stand : max(sub.stand, sub.hit);
+            if (a != 1 && das)
+                best = max(best, sub.dbl);
+            ev += p * best;
+        }
+        counts[a] += 2;
+        split[a] = 2 * ev > bestEV(pair, rules.surrender);
+    }
+}
+
+double StrategyGenerator::bestEV(const HandEV &ev, bool surrender) const
+{
+    double best = max(ev.stand, ev.hit);
+    if (rules.doubleDown)
+        best = max(best, ev.dbl);
+    if (surrender)
+        best = max(best, ev.surrender);
+    return best;
+}
+
+double StrategyGenerator::standEV(int value, int up,
+                                  const DealerOdds &odds) const
+{
+    double ev = odds.p[DEALER_BUSTS] - odds.p[DEALER_GOT_BJ];
+    for (int r = 17; r <= 21; r++)
+    {
+        if (value > r)
+            ev += odds.p[DEALER_17 + r - 17];
+        else if (value < r)
+            ev -= odds.p[DEALER_17 + r - 17];
+    }
+    // A peeking dealer ends the round on a blackjack before the player
+    // moves, so the moves only count when the dealer has none.
+    if (rules.peek && (up == 1 || up == N_POINTS))
+        ev = (ev + odds.p[DEALER_GOT_BJ]) / (1 - odds.p[DEALER_GOT_BJ]);
+    return ev;
+}
+
+double StrategyGenerator::surrenderEV(int up,
+                                      const DealerOdds &odds) const
+{
+    // (Given no dealer's blackjack if the dealer peeks, see standEV().)
+    if (rules.peek && (up == 1 || up == N_POINTS))
+        return -0.5;
+    return -0.5 * (1 - odds.p[DEALER_GOT_BJ]) - odds.p[DEALER_GOT_BJ];
+}
+
+StrategyGenerator::HandEV
+StrategyGenerator::evaluate(DealerProbabilities &dealer, int up,
+                            int counts[N_POINTS + 1], int held[N_POINTS + 1],
+                            int nCard, int hard, bool ace,
+                            HandMap &hands) const
+{
+    uint64_t k = 0;
+    const int bits = CompositionStrategy::KEY_BITS;
+    for (int i = 1; i <= N_POINTS; i++)
+        k |= (uint64_t)held[i] << (bits * (i - 1));
+    HandMap::const_iterator it = hands.find(k);
+    if (it != hands.end())
+        return it->second;
+
+    int value = (ace && hard < 12) ? hard + 10 : hard;
+    HandEV ev;
+    DealerOdds odds = dealer.compute(counts, up);
+    ev.stand = standEV(value, up, odds);
+    ev.surrender = surrenderEV(up, odds);
+    ev.hit = 0;
+    ev.dbl = 0; // Twice the EV of standing after one more card.
+    int total = 0;
+    for (int c = 1; c <= N_POINTS; c++)
+        total += counts[c];
+    if (total == 0)
+        ev.hit = -1, ev.dbl = -2; // No card is left to hit.
+    for (int c = 1; c <= N_POINTS; c++)
+    {
+        if (counts[c] == 0)
+            continue;
+        double p = (double)counts[c] / total;
+        if (hard + c > 21)
+        {
+            ev.hit -= p; // busted.
+            ev.dbl -= 2 * p;
+            continue;
+        }
+        counts[c]--, held[c]++;
+        HandEV sub = evaluate(dealer, up, counts, held, nCard + 1,
+                              hard + c, ace || c == 1, hands);
+        counts[c]++, held[c]--;
+        ev.hit += p * max(sub.stand, sub.hit);
+        ev.dbl += 2 * p * sub.stand;
+    }
+    hands[k] = ev;
+    return ev;
+}
+
+void StrategyGenerator::fillTable(StrategyTable &table, int up,
+                                  const HandMap &hands) const
+{
+    int counts[N_POINTS + 1];
+    DealerProbabilities::fullShoe(nDeck, counts);
+    counts[up]--;
+    int total = 52 * nDeck - 1;
+
+    vector<double> weight(StrategyTable::N_ENTRY, 0.0);
+    vector<double> stand(StrategyTable::N_ENTRY, 0.0);
+    vector<double> hit(StrategyTable::N_ENTRY, 0.0);
+    vector<double> dbl(StrategyTable::N_ENTRY, 0.0);
+    vector<double> surrender(StrategyTable::N_ENTRY, 0.0);
+    const int bits = CompositionStrategy::KEY_BITS;
+    const uint64_t mask = (1 << bits) - 1;
+    for (HandMap::const_iterator it = hands.begin(); it != hands.end();
+         it++)
+    {
+        int nCard = 0, hard = 0;
+        double logW = 0;
+        for (int i = 1; i <= N_POINTS; i++)
+        {
+            int h = (it->first >> (bits * (i - 1))) & mask;
+            nCard += h;
+            hard += h * i;
+            logW += logChoose(counts[i], h);
+        }
+        logW -= logChoose(total, nCard);
+        bool ace = (it->first & mask) != 0;
+        bool soft = ace && hard < 12;
+        int e = StrategyTable::index(up, soft ? hard + 10 : hard, soft,
+                                     nCard);
+        double w = exp(logW);
+        weight[e] += w;
+        stand[e] += w * it->second.stand;
+        hit[e] += w * it->second.hit;
+        if (nCard == 2)
+        {
+            dbl[e] += w * it->second.dbl;
+            surrender[e] += w * it->second.surrender;
+        }
+    }
+    for (int e = 0; e < StrategyTable::N_ENTRY; e++)
+        if (weight[e] > 0)
+        {
+            table.decisions[e] = hit[e] > stand[e] ? 'h' : 's';
+            table.evs[e] = max(hit[e], stand[e]) / weight[e];
+            // (Entries of 2 cards come first for every value.)
+            if (e % (StrategyTable::MAX_CARDS - 1) != 0)
+                continue;
+            table.doubles[e] = dbl[e] > max(hit[e], stand[e]);
+            HandEV sum = {stand[e], hit[e], dbl[e], surrender[e]};
+            table.surrenders[e] =
+                rules.surrender && bestEV(sum, false) < surrender[e];
+        }
+}
+
+double StrategyGenerator::logChoose(int n, int k)
+{
+    return lgamma(n + 1.0) - lgamma(k + 1.0) - lgamma(n - k + 1.0);
+}
@@ -0,0 +1,257 @@
+#ifndef BLACKJACK_STRATEGY_H
+#define BLACKJACK_STRATEGY_H
+
+#include <atomic>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "dealer_odds.h"
+#include "hand.h"
+#include "rules.h"
+
+// Class that represents a total-dependent strategy: the decision ('h' or
+// 's') and its expected chips for every player hand (value, soft or not,
+// number of cards) against every dealer's face-up card, stored in flat
+// arrays so that a decision is a single indexed load, with the hands to
+// surrender or double and the pairs to split when the rules allow it.
+// It can be used as a policy of the Simulator.
+class StrategyTable
+{
+public:
+    // Constructor. Until the table is generated, every hand plays like
+    // the dealer (hits until the value >= 17).
+    StrategyTable()
+    {
+        for (int up = 0; up <= N_POINTS; up++)
+            for (int soft = 0; soft <= 1; soft++)
+                for (int value = 0; value < N_VALUE; value++)
+                    for (int nCard = 2; nCard <= MAX_CARDS; nCard++)
+                    {
+                        int e = index(up, value, soft, nCard);
+                        decisions[e] = value < 17 ? 'h' : 's';
+                        evs[e] = 0;
+                        doubles[e] = false;
+                        surrenders[e] = false;
+                    }
+        for (int up = 0; up <= N_POINTS; up++)
+            for (int pair = 0; pair <= N_POINTS; pair++)
+                splits[up][pair] = false;
+    }
+
+    // Decide between 'h' (hit), 's' (stand), and 'd' (double), 'p'
+    // (split) or 'u' (surrender) if allowed by moves (see CAN_DOUBLE).
+    char decide(const Hand &player, const Card &upCard, int moves) const
+    {
+        int up = upCard.getPoints();
+        if ((moves & CAN_SPLIT) && splits[up][player.getCard(0).getPoints()])
+            return 'p';
+        int e = index(up, player.getValue(), player.isSoft(), player.size());
+        if ((moves & CAN_SURRENDER) && surrenders[e])
+            return 'u';
+        if ((moves & CAN_DOUBLE) && doubles[e])
+            return 'd';
+        return decisions[e];
+    }
+
+    // Insurance is never taken (it loses without counting cards).
+    bool insure(const Hand &) const
+    {
+        return false;
+    }
+
+    // Decision for a hand (value <= 21) against a face-up card (1~10).
+    char decision(int upCard, int value, bool soft, int nCard) const
+    {
+        return decisions[index(upCard, value, soft, nCard)];
+    }
+
+    // Expected chips of the decision above.
+    float ev(int upCard, int value, bool soft, int nCard) const
+    {
+        return evs[index(upCard, value, soft, nCard)];
+    }
+
+    // Print the decisions for hands of nCard cards (H: hit, S: stand,
+    // D: double, R: surrender), and the pairs to split (P) for 2 cards.
+    void print(int nCard) const;
+
+    // Hands with MAX_CARDS cards or more share their entries.
+    static const int MAX_CARDS = 6;
+
+private:
+    static const int N_VALUE = 22; // Values of hands (0~21).
+    static const int N_ENTRY =
+        (N_POINTS + 1) * 2 * N_VALUE * (MAX_CARDS - 1);
+
+    static int index(int upCard, int value, bool soft, int nCard)
+    {
+        if (nCard > MAX_CARDS)
+            nCard = MAX_CARDS;
+        if (value > 21)
+            value = 21;
+        return ((upCard * 2 + soft) * N_VALUE + value) * (MAX_CARDS - 1) +
+               nCard - 2;
+    }
+
+    char decisions[N_ENTRY]; // Decision for every entry.
+    float evs[N_ENTRY];      // Expected chips for every entry.
+    bool doubles[N_ENTRY];   // true if the hand of an entry is doubled.
+    bool surrenders[N_ENTRY]; // true if the hand is surrendered.
+    bool splits[N_POINTS + 1][N_POINTS + 1]; // Pairs split by face-up card.
+
+    friend class StrategyGenerator;
+};
+
+// Class that represents a composition-dependent strategy: the decision
+// for the exact cards held (counted by points) against every dealer's
+// face-up card. It can be used as a policy of the Simulator.
+class CompositionStrategy
+{
+public:
+    // Constructor. No pair is split until the strategy is generated.
+    CompositionStrategy()
+    {
+        for (int up = 0; up <= N_POINTS; up++)
+            for (int pair = 0; pair <= N_POINTS; pair++)
+                splits[up][pair] = false;
+    }
+
+    // Decide between 'h' (hit), 's' (stand), and 'd' (double), 'p'
+    // (split) or 'u' (surrender) if allowed by moves (see CAN_DOUBLE).
+    char decide(const Hand &player, const Card &upCard, int moves) const
+    {
+        int up = upCard.getPoints();
+        if ((moves & CAN_SPLIT) && splits[up][player.getCard(0).getPoints()])
+            return 'p';
+        uint64_t k = key(handKey(player), up);
+        if ((moves & CAN_SURRENDER) && surrenders.count(k))
+            return 'u';
+        if ((moves & CAN_DOUBLE) && doubles.count(k))
+            return 'd';
+        std::unordered_map<uint64_t, char>::const_iterator it =
+            decisions.find(k);
+        return it == decisions.end() ? 's' : it->second;
+    }
+
+    // Insurance is never taken.
+    bool insure(const Hand &) const
+    {
+        return false;
+    }
+
+    // Number of hands in the strategy.
+    size_t size() const
+    {
+        return decisions.size();
+    }
+
+    // Key of the cards held: the count of each points in 5 bits.
+    static uint64_t handKey(const Hand &hand)
+    {
+        uint64_t k = 0;
+        for (int i = 0; i < hand.size(); i++)
+        {
+            int points = hand.getCard(i).getPoints();
+            k += (uint64_t)1 << (KEY_BITS * (points - 1));
+        }
+        return k;
+    }
+
+    static const int KEY_BITS = 5; // Bits of each count in a key.
+
+private:
+    static uint64_t key(uint64_t hand, int upCard)
+    {
+        return hand << 4 | upCard;
+    }
+
+    std::unordered_map<uint64_t, char> decisions; // Decisions by hand, card.
+    std::unordered_set<uint64_t> doubles; // Hands doubled, by face-up card.
+    std::unordered_set<uint64_t> surrenders; // Hands surrendered.
+    bool splits[N_POINTS + 1][N_POINTS + 1]; // Pairs split by face-up card.
+
+    friend class StrategyGenerator;
+};
+
+// Class that generates the optimal strategies for a rule set (see
+// RuleConfig: S17 or H17, peek, surrender, doubles and doubles after
+// splits) and a full shoe. For every face-up card, the expected chips of
+// standing, hitting and doubling are computed exactly for every set of
+// cards the player can hold, using the dealer's probabilities for the
+// cards left (given that the dealer has no blackjack if the dealer
+// peeks). Splitting is approximated by two hands of one card played on
+// from the shoe without the pair (no re-split; split aces take one card
+// each), memoized apart from the hands not split. The total-dependent
+// table weighs those sets by their chance of being dealt.
+// Face-up cards are handled in parallel, each thread with its own cache.
+class StrategyGenerator
+{
+public:
+    // Constructor. nThread == 0 uses all hardware threads. Throws
+    // BadNumberDecks for a shoe too large for DealerProbabilities.
+    StrategyGenerator(int nDeck1 = 1, int nThread1 = 0,
+                      const RuleConfig &rules1 = RuleConfig());
+
+    // Generate the total-dependent table, and the composition-dependent
+    // strategy if cd is given.
+    void generate(StrategyTable &table, CompositionStrategy *cd = 0) const;
+
+private:
+    // Expected chips of standing, hitting, doubling and surrendering with
+    // a set of cards.
+    struct HandEV
+    {
+        double stand;
+        double hit;
+        double dbl;
+        double surrender;
+    };
+    // Sets of cards (see CompositionStrategy::handKey()) and their EVs.
+    typedef std::unordered_map<uint64_t, HandEV> HandMap;
+    // Pairs to split (by face-up card and points of the pair).
+    typedef bool SplitTable[N_POINTS + 1][N_POINTS + 1];
+
+    // Work of a single thread: handle face-up cards until none are left.
+    void runCards(std::atomic<int> &nextCard, std::vector<HandMap> &hands,
+                  SplitTable &splits) const;
+
+    // Decide the pairs to split against a face-up card (counts: cards
+    // left after the face-up card).
+    void splitPairs(DealerProbabilities &dealer, int up,
+                    int counts[N_POINTS + 1], HandMap &hands,
+                    bool split[N_POINTS + 1]) const;
+
+    // Best EV of a hand of two cards among the moves the rules allow
+    // (surrender too if surrender).
+    double bestEV(const HandEV &ev, bool surrender) const;
+
+    // Expected chips of standing with a value against the dealer (given
+    // no dealer's blackjack against an ace or a ten if the dealer peeks).
+    double standEV(int value, int up, const DealerOdds &odds) const;
+
+    // Expected chips of surrendering against the dealer (late: half of
+    // the bet, or all of it against a blackjack that was not peeked at).
+    double surrenderEV(int up, const DealerOdds &odds) const;
+
+    // EVs of the held cards (counts: cards left, held: cards held),
+    // memoized in hands.
+    HandEV evaluate(DealerProbabilities &dealer, int up,
+                    int counts[N_POINTS + 1], int held[N_POINTS + 1],
+                    int nCard, int hard, bool ace, HandMap &hands) const;
+
+    // Fill the entries of a face-up card by weighing every set of cards
+    // with its chance of being dealt from the shoe (without the face-up
+    // card): the product of C(counts[i], held[i]) over C(total, nCard).
+    void fillTable(StrategyTable &table, int up, const HandMap &hands) const;
+
+    // log of the binomial coefficient C(n, k).
+    static double logChoose(int n, int k);
+
+    int nDeck;        // Number of decks.
+    int nThread;      // Number of worker threads.
+    RuleConfig rules; // Rules the strategies are for.
+};
+
+#endif // BLACKJACK_STRATEGY_H
@@ -0,0 +1,415 @@
+#include "vector_env.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "simulator.h"
+
+using namespace std;
+
+namespace
+{
+// A table of the environment and the state of its round.
+struct EnvTable
+{
+    Decks decks;             // Shoe of the table.
+    PlayerHands player;      // Hands of the player.
+    Hand dealer;             // Hand of the dealer.
+    int phase;               // Phase of the round (BJ_PHASE_...).
+    int bet;                 // Chips bet on the round.
+    int units;               // Units gained so far in the round.
+    bool stood;              // true if a hand stands (the dealer plays).
+    int seen[N_POINTS + 1];  // Cards seen since the shuffle, by points.
+
+    // Constructor. The table waits for a bet, with a new shoe.
+    EnvTable(const ShoeConfig &shoe)
+        : decks(shoe), player(), dealer(), phase(BJ_PHASE_BET), bet(0),
+          units(0), stood(false)
+    {
+        for (int i = 0; i <= N_POINTS; i++)
+            seen[i] = 0;
+    }
+};
+} // namespace
+
+// Environment: the tables, their rules, and the threads stepping them.
+// The tables are cut into one contiguous range per thread; the caller of
+// bj_env_step() steps the first range, and waits for the others.
+struct bj_env
+{
+    RuleConfig rules;
+    vector<EnvTable> tables;
+
+    // Current step, handed to the threads.
+    const int32_t *actions;
+    int32_t *obs;
+    float *rewards;
+    uint8_t *dones;
+
+    vector<thread> threads;
+    mutex lock;
+    condition_variable startStep; // Signals a new step (or stopping).
+    condition_variable endStep;   // Signals a range done.
+    long long generation;         // Number of steps started.
+    int pending;                  // Ranges of the step not done yet.
+    bool stopping;                // true once destroyed.
+
+    // Step the tables of range r (of ranges()).
+    void stepRange(int r);
+
+    // Number of ranges (the caller and every thread).
+    int ranges() const
+    {
+        return threads.size() + 1;
+    }
+
+    // Loop of the thread stepping range r.
+    void work(int r);
+};
+
+// Deal a card from the shoe of table t, counting it as seen if shown.
+static Card draw(EnvTable &t, bool shown)
+{
+    // An empty shoe is shuffled by deal().
+    if (t.decks.remaining() == 0)
+        for (int i = 0; i <= N_POINTS; i++)
+            t.seen[i] = 0;
+    Card card = t.decks.deal();
+    if (shown)
+        t.seen[card.getPoints()]++;
+    return card;
+}
+
+// End the round of table t: the dealer plays if a hand stands, the hole
+// card and the dealer's cards are shown, and the hands are settled.
+// Returns true (the round is done).
+static bool endRound(EnvTable &t, const RuleConfig &rules)
+{
+    if (t.stood)
+        dealerPlay(t.dealer, t.decks, rules);
+    t.seen[t.dealer.getCard(0).getPoints()]++;
+    for (int i = 2; i < t.dealer.size(); i++)
+        t.seen[t.dealer.getCard(i).getPoints()]++;
+    t.units += settleHands(t.player, t.dealer, rules);
+    t.phase = BJ_PHASE_BET;
+    return true;
+}
+
+// Play the hands of table t that need no decision (busted hands, split
+// aces with their card), up to the next decision or the end of the round.
+// Returns true if the round is done.
+static bool advance(EnvTable &t, const RuleConfig &rules)
+{
+    while (true)
+    {
+        Hand &hand = t.player.active();
+        // A split hand gets its second card when its turn comes.
+        if (hand.size() == 1)
+            hand.addCard(draw(t, true));
+        if (hand.busted())
+            t.player.finish('b');
+        else if (t.player.splitAces(t.player.activeIndex()) &&
+                 !(allowedMoves(t.player, rules) & CAN_SPLIT))
+        {
+            // Split aces get one card each, unless split again.
+            t.player.finish('s');
+            t.stood = true;
+        }
+        else
+            return false;
+        if (!t.player.next())
+            return endRound(t, rules);
+    }
+}
+
+// Start playing the hands of table t, once insurance is decided.
+// Returns true if the round is done.
+static bool afterInsurance(EnvTable &t, const RuleConfig &rules)
+{
+    // With the peek rule, the dealer's blackjack ends the round at once.
+    if (t.player[0].blackjack())
+        t.player.finish('j');
+    else if (rules.dealerPeeks() && t.dealer.blackjack())
+        t.player.finish('k');
+    else
+    {
+        t.phase = BJ_PHASE_PLAY;
+        return advance(t, rules);
+    }
+    return endRound(t, rules);
+}
+
+// Deal a round at table t with a bet of action chips.
+// Returns true if the round is done.
+static bool startRound(EnvTable &t, int action, const RuleConfig &rules)
+{
+    t.bet = action < 1 ? 1 : action > rules.maxBet ? rules.maxBet : action;
+    t.units = 0;
+    t.stood = false;
+    t.dealer.removeAllCards();
+    t.player.reset();
+    if (t.decks.needsShuffle())
+    {
+        t.decks.shuffle();
+        for (int i = 0; i <= N_POINTS; i++)
+            t.seen[i] = 0;
+    }
+    // The dealer's first card is hidden, the second is face-up.
+    t.dealer.addCard(draw(t, false));
+    t.player[0].addCard(draw(t, true));
+    t.dealer.addCard(draw(t, true));
+    t.player[0].addCard(draw(t, true));
+    if (rules.insuranceOffered() && t.dealer.getCard(1).getPoints() == 1)
+    {
+        t.phase = BJ_PHASE_INSURE;
+        return false;
+    }
+    return afterInsurance(t, rules);
+}
+
+// Play a move of the active hand of table t (as playHand()).
+// Returns true if the round is done.
+static bool play(EnvTable &t, int action, const RuleConfig &rules)
+{
+    static const char MOVES[] = {'h', 's', 'd', 'p', 'u'};
+    char in = action >= 0 && action <= BJ_SURRENDER ? MOVES[action] : 'h';
+    int moves = allowedMoves(t.player, rules);
+    // A move that is not allowed is played as a hit.
+    if ((in == 'd' && !(moves & CAN_DOUBLE)) ||
+        (in == 'p' && !(moves & CAN_SPLIT)) ||
+        (in == 'u' && !(moves & CAN_SURRENDER)))
+        in = 'h';
+    if (t.player.splitAces(t.player.activeIndex()) && in != 'p')
+        in = 's';
+    Hand &hand = t.player.active();
+    switch (in)
+    {
+    case 'h':
+        hand.addCard(draw(t, true));
+        return advance(t, rules);
+    case 'p':
+        t.player.split();
+        hand.addCard(draw(t, true));
+        return advance(t, rules);
+    case 'd':
+        t.player.doubleDown();
+        hand.addCard(draw(t, true));
+        t.player.finish(hand.busted() ? 'b' : 's');
+        t.stood |= !hand.busted();
+        break;
+    case 'u':
+        t.player.finish('u');
+        break;
+    default:
+        t.player.finish('s');
+        t.stood = true;
+    }
+    if (t.player.next())
+        return advance(t, rules);
+    return endRound(t, rules);
+}
+
+// Write the observation of table t.
+static void observe(const EnvTable &t, const RuleConfig &rules,
+                    int32_t *out)
+{
+    for (int i = 0; i < BJ_OBS_SIZE; i++)
+        out[i] = 0;
+    out[BJ_OBS_PHASE] = t.phase;
+    out[BJ_OBS_BET] = t.bet;
+    out[BJ_OBS_REMAINING] = t.decks.remaining();
+    for (int i = 1; i <= N_POINTS; i++)
+        out[BJ_OBS_SEEN + i - 1] = t.seen[i];
+    if (t.phase == BJ_PHASE_BET)
+        return;
+    const Hand &hand = t.player.active();
+    out[BJ_OBS_VALUE] = hand.getValue();
+    out[BJ_OBS_SOFT] = hand.isSoft();
+    out[BJ_OBS_UP_CARD] = t.dealer.getCard(1).getPoints();
+    if (t.phase == BJ_PHASE_PLAY)
+        out[BJ_OBS_MOVES] = allowedMoves(t.player, rules);
+    out[BJ_OBS_HAND] = t.player.activeIndex();
+    out[BJ_OBS_HANDS] = t.player.size();
+}
+
+void bj_env::stepRange(int r)
+{
+    size_t first = tables.size() * r / ranges();
+    size_t last = tables.size() * (r + 1) / ranges();
+    for (size_t i = first; i < last; i++)
+    {
+        EnvTable &t = tables[i];
+        int action = actions[i];
+        bool done;
+        if (t.phase == BJ_PHASE_BET)
+            done = startRound(t, action, rules);
+        else if (t.phase == BJ_PHASE_INSURE)
+        {
+            if (action == 1)
+                t.units += insuranceUnits(t.dealer);
+            done = afterInsurance(t, rules);
+        }
+        else
+            done = play(t, action, rules);
+        dones[i] = done;
+        rewards[i] = done ? (float)t.units * t.bet / CHIP_UNITS : 0.0f;
+        observe(t, rules, obs + i * BJ_OBS_SIZE);
+    }
+}
+
+void bj_env::work(int r)
+{
+    long long seen = 0;
+    unique_lock<mutex> guard(lock);
+    while (true)
+    {
+        startStep.wait(guard,
+                       [&]() { return stopping || generation != seen; });
+        if (stopping)
+            return;
+        seen = generation;
+        guard.unlock();
+        stepRange(r);
+        guard.lock();
+        if (--pending == 0)
+            endStep.notify_one();
+    }
+}
+
+void bj_env_default_config(bj_env_config *config)
+{
+    RuleConfig rules;
+    config->n_env = 1024;
+    config->n_deck = 6;
+    config->penetration = DEFAULT_PENETRATION;
+    config->hit_soft17 = rules.hitSoft17;
+    config->blackjack_num = rules.blackjackNum;
+    config->blackjack_den = rules.blackjackDen;
+    config->peek = rules.peek;
+    config->surrender = rules.surrender;
+    config->double_down = rules.doubleDown;
+    config->split_hands = rules.splitHands;
+    config->double_after_split = rules.doubleAfterSplit;
+    config->resplit_aces = rules.resplitAces;
+    config->insurance = rules.insurance;
+    config->max_bet = rules.maxBet;
+    config->seed = 0;
+    config->n_thread = 1;
+}
+
+bj_env *bj_env_create(const bj_env_config *config)
+{
+    if (!config || config->n_env < 1 || config->n_deck < 1 ||
+        !(config->penetration > 0 && config->penetration <= 1) ||
+        config->blackjack_num < 0 || config->blackjack_den < 1 ||
+        CHIP_UNITS * config->blackjack_num % config->blackjack_den != 0 ||
+        config->split_hands < 1 ||
+        config->split_hands > PlayerHands::MAX_HANDS || config->max_bet < 1)
+        return 0;
+    bj_env *env = new (nothrow) bj_env();
+    if (!env)
+        return 0;
+    try
+    {
+        RuleConfig &rules = env->rules;
+        rules.hitSoft17 = config->hit_soft17;
+        rules.blackjackNum = config->blackjack_num;
+        rules.blackjackDen = config->blackjack_den;
+        rules.peek = config->peek;
+        rules.surrender = config->surrender;
+        rules.doubleDown = config->double_down;
+        rules.splitHands = config->split_hands;
+        rules.doubleAfterSplit = config->double_after_split;
+        rules.resplitAces = config->resplit_aces;
+        rules.insurance = config->insurance;
+        rules.maxBet = config->max_bet;
+        ShoeConfig shoe(config->n_deck, config->penetration);
+        env->tables.resize(config->n_env, EnvTable(shoe));
+        for (int i = 0; i < config->n_env; i++)
+        {
+            uint64_t state = config->seed + i;
+            env->tables[i].decks.seed(splitmix64(state));
+        }
+        env->generation = 0;
+        env->pending = 0;
+        env->stopping = false;
+        int nThread = config->n_thread;
+        if (nThread <= 0)
+            nThread = thread::hardware_concurrency();
+        if (nThread > config->n_env)
+            nThread = config->n_env;
+        for (int r = 1; r < nThread; r++)
+            env->threads.push_back(thread(&bj_env::work, env, r));
+    }
+    catch (...)
+    {
+        bj_env_destroy(env);
+        return 0;
+    }
+    bj_env_reset(env, 0);
+    return env;
+}
+
+void bj_env_destroy(bj_env *env)
+{
+    if (!env)
+        return;
+    {
+        lock_guard<mutex> guard(env->lock);
+        env->stopping = true;
+    }
+    env->startStep.notify_all();
+    for (size_t i = 0; i < env->threads.size(); i++)
+        env->threads[i].join();
+    delete env;
+}
+
+int bj_env_size(const bj_env *env)
+{
+    return env->tables.size();
+}
+
+void bj_env_reset(bj_env *env, int32_t *obs)
+{
+    for (size_t i = 0; i < env->tables.size(); i++)
+    {
+        EnvTable &t = env->tables[i];
+        t.decks.shuffle();
+        for (int k = 0; k <= N_POINTS; k++)
+            t.seen[k] = 0;
+        t.dealer.removeAllCards();
+        t.player.reset();
+        t.phase = BJ_PHASE_BET;
+        t.bet = 1;
+        t.units = 0;
+        t.stood = false;
+        if (obs)
+            observe(t, env->rules, obs + i * BJ_OBS_SIZE);
+    }
+}
+
+void bj_env_step(bj_env *env, const int32_t *actions, int32_t *obs,
+                 float *rewards, uint8_t *dones)
+{
+    env->actions = actions;
+    env->obs = obs;
+    env->rewards = rewards;
+    env->dones = dones;
+    if (env->threads.empty())
+    {
+        env->stepRange(0);
+        return;
+    }
+    {
+        lock_guard<mutex> guard(env->lock);
+        env->pending = env->threads.size();
+        env->generation++;
+    }
+    env->startStep.notify_all();
+    env->stepRange(0);
+    unique_lock<mutex> guard(env->lock);
+    env->endStep.wait(guard, [&]() { return env->pending == 0; });
+}
@@ -0,0 +1,116 @@
+#ifndef BLACKJACK_VECTOR_ENV_H
+#define BLACKJACK_VECTOR_ENV_H
+
+#include <stdint.h>
+
+// Vectorized environment for training agents, with a plain C interface
+// (built into the shared library blackjack_env).
+// An environment holds n independent tables, each with its own shoe and
+// one player, and is stepped for all tables at once: bj_env_step() takes
+// one action per table and writes the observations, rewards and done
+// flags of all tables into flat arrays given by the caller. Nothing is
+// allocated after bj_env_create(), and the tables can be stepped by a
+// few threads (see bj_env_config.n_thread).
+//
+// A round of a table goes through phases (see BJ_OBS_PHASE):
+//   BJ_PHASE_BET:    the action is the bet (1 to max_bet chips); the cards
+//                    are dealt.
+//   BJ_PHASE_INSURE: (the dealer shows an ace and insurance is offered)
+//                    the action is 1 to take insurance, 0 otherwise.
+//   BJ_PHASE_PLAY:   the action is a move (BJ_HIT, ...) of the active hand.
+//                    A move that is not allowed is played as a hit.
+// When the round ends (possibly right after the bet, on a blackjack),
+// done is 1, the reward is the chips gained in the round (negative if
+// lost), and the table is back at BJ_PHASE_BET. Otherwise done and the
+// reward are 0.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Moves of BJ_PHASE_PLAY.
+enum
+{
+    BJ_HIT = 0,
+    BJ_STAND = 1,
+    BJ_DOUBLE = 2,
+    BJ_SPLIT = 3,
+    BJ_SURRENDER = 4
+};
+
+// Phases of a round.
+enum
+{
+    BJ_PHASE_BET = 0,
+    BJ_PHASE_INSURE = 1,
+    BJ_PHASE_PLAY = 2
+};
+
+// Layout of the observation of a table (BJ_OBS_SIZE values).
+enum
+{
+    BJ_OBS_PHASE = 0,     // Phase of the round.
+    BJ_OBS_VALUE = 1,     // Value of the active hand (0 before the deal).
+    BJ_OBS_SOFT = 2,      // 1 if the active hand is soft.
+    BJ_OBS_UP_CARD = 3,   // Points of the dealer's face-up card (1~10).
+    BJ_OBS_MOVES = 4,     // Moves allowed besides hit and stand (a mask of
+                          // 1: double, 2: split, 4: surrender).
+    BJ_OBS_HAND = 5,      // Number of the active hand (after splits).
+    BJ_OBS_HANDS = 6,     // Number of hands.
+    BJ_OBS_BET = 7,       // Chips bet on the round.
+    BJ_OBS_REMAINING = 8, // Cards left in the shoe.
+    BJ_OBS_SEEN = 9,      // 10 values: the cards seen since the shuffle by
+                          // points (1: aces, ..., 10: tens and faces).
+    BJ_OBS_SIZE = 19
+};
+
+// Configuration of an environment (see bj_env_default_config()).
+typedef struct bj_env_config
+{
+    int n_env;                // Number of tables.
+    int n_deck;               // Decks in every shoe (1 or more).
+    double penetration;       // Fraction dealt before shuffling (0~1].
+    int hit_soft17;           // The rules (see RuleConfig).
+    int blackjack_num;
+    int blackjack_den;
+    int peek;
+    int surrender;
+    int double_down;
+    int split_hands;
+    int double_after_split;
+    int resplit_aces;
+    int insurance;
+    int max_bet;              // Largest bet in chips.
+    uint64_t seed;            // Seed of the shoes (table i: seed + i).
+    int n_thread;             // Threads stepping the tables (1: none).
+} bj_env_config;
+
+typedef struct bj_env bj_env;
+
+// Fill config with the defaults: 1024 tables of 6 decks dealt to 75%,
+// the rules of RuleConfig, bets up to 5 chips, and one thread.
+void bj_env_default_config(bj_env_config *config);
+
+// Create an environment. Returns 0 if the configuration is invalid.
+bj_env *bj_env_create(const bj_env_config *config);
+
+// Destroy an environment.
+void bj_env_destroy(bj_env *env);
+
+// Return the number of tables.
+int bj_env_size(const bj_env *env);
+
+// Start every table over at BJ_PHASE_BET (with its shoe shuffled) and
+// write the observations (n_env * BJ_OBS_SIZE values).
+void bj_env_reset(bj_env *env, int32_t *obs);
+
+// Play one action on every table (actions: n_env values), and write the
+// observations, rewards and done flags (n_env values each).
+void bj_env_step(bj_env *env, const int32_t *actions, int32_t *obs,
+                 float *rewards, uint8_t *dones);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BLACKJACK_VECTOR_ENV_H
@@ -0,0 +1,233 @@
+// Load generator for the game server (blackjack --serve).
+// Opens a number of idle sessions, then plays sessions from a few threads,
+// each answering every prompt at once, and reports the latency of the
+// requests (from sending a line until the next prompt is received):
+//   blackjack_load [--host ADDR] [--port N | --unix PATH] [--sessions N]
+//                  [--rounds N] [--idle N] [--threads N]
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Address of the server.
+static string host = "127.0.0.1", unixPath;
+static int port = 7777;
+
+// Connect to the server. Returns -1 on failure.
+static int connectServer()
+{
+    if (!unixPath.empty())
+    {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, unixPath.c_str(), sizeof(addr.sun_path) - 1);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+        return fd;
+    }
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// Read the texts of the server up to the next prompt (a line ending with
+// "): ") into text. Returns false if the server closed the connection.
+static bool readPrompt(int fd, string &text)
+{
+    text.clear();
+    char buf[4096];
+    while (true)
+    {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        text.append(buf, n);
+        size_t end = text.find_last_not_of(' ');
+        if (end != string::npos && end > 0 && text[end] == ':' &&
+            text[end - 1] == ')')
+            return true;
+    }
+}
+
+// Statistics of a thread of sessions.
+struct LoadStats
+{
+    vector<double> latencies; // Seconds of every request.
+    long long sessions;       // Sessions completed.
+    long long errors;         // Sessions that failed.
+
+    LoadStats() : latencies(), sessions(0), errors(0) {}
+};
+
+// Play one session of nRound rounds, answering every prompt.
+static bool playSession(int nRound, LoadStats &stats)
+{
+    int fd = connectServer();
+    if (fd < 0)
+        return false;
+    string text;
+    bool ok = readPrompt(fd, text);
+    int round = 0;
+    while (ok)
+    {
+        string line;
+        if (text.find("[1/2/4/6/8]") != string::npos)
+            line = "1\n";
+        else if (text.find("[1-5]") != string::npos)
+            line = "1\n";
+        else if (text.find("[h/s/r/q]") != string::npos)
+            line = "s\n";
+        else if (round++ < nRound)
+            line = "n\n";
+        else
+            line = "q\n";
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        if (write(fd, line.data(), line.size()) != (ssize_t)line.size())
+        {
+            ok = false;
+            break;
+        }
+        bool more = readPrompt(fd, text);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        stats.latencies.push_back(elapsed.count());
+        if (!more)
+            break; // The game is over (or the chips ran out).
+    }
+    close(fd);
+    return ok;
+}
+
+// Percentile p (0 to 1) of sorted values.
+static double percentile(const vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+int main(int argc, char *argv[])
+{
+    int nSession = 100, nRound = 10, nIdle = 0, nThread = 4;
+    for (int i = 1; i < argc; i++)
+    {
+        string opt = argv[i];
+        if (opt == "--host" && i + 1 < argc)
+            host = argv[++i];
+        else if (opt == "--port" && i + 1 < argc)
+            port = atoi(argv[++i]);
+        else if (opt == "--unix" && i + 1 < argc)
+            unixPath = argv[++i];
+        else if (opt == "--sessions" && i + 1 < argc)
+            nSession = atoi(argv[++i]);
+        else if (opt == "--rounds" && i + 1 < argc)
+            nRound = atoi(argv[++i]);
+        else if (opt == "--idle" && i + 1 < argc)
+            nIdle = atoi(argv[++i]);
+        else if (opt == "--threads" && i + 1 < argc)
+            nThread = max(1, atoi(argv[++i]));
+        else
+        {
+            cerr << "usage: " << argv[0] << " [--host ADDR] "
+                 << "[--port N | --unix PATH] [--sessions N] [--rounds N] "
+                 << "[--idle N] [--threads N]\n";
+            return 1;
+        }
+    }
+
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    // Idle sessions stay open (and silent) during the whole run.
+    vector<int> idle;
+    for (int i = 0; i < nIdle; i++)
+    {
+        int fd = connectServer();
+        if (fd < 0)
+        {
+            cerr << "*** Cannot open idle session " << i << ": "
+                 << strerror(errno) << "\n";
+            break;
+        }
+        idle.push_back(fd);
+    }
+    cerr << idle.size() << " idle session(s) open" << endl;
+
+    vector<LoadStats> stats(nThread);
+    vector<thread> pool;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int t = 0; t < nThread; t++)
+        pool.push_back(thread([&, t]() {
+            for (int s = t; s < nSession; s += nThread)
+            {
+                if (playSession(nRound, stats[t]))
+                    stats[t].sessions++;
+                else
+                    stats[t].errors++;
+            }
+        }));
+    for (size_t t = 0; t < pool.size(); t++)
+        pool[t].join();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    vector<double> all;
+    long long sessions = 0, errors = 0;
+    for (int t = 0; t < nThread; t++)
+    {
+        all.insert(all.end(), stats[t].latencies.begin(),
+                   stats[t].latencies.end());
+        sessions += stats[t].sessions;
+        errors += stats[t].errors;
+    }
+    sort(all.begin(), all.end());
+    cout << "Sessions: " << sessions << " (" << errors << " failed), "
+         << idle.size() << " idle" << endl;
+    cout << "Requests: " << all.size() << " in " << elapsed.count()
+         << " s (" << all.size() / elapsed.count() << " requests/s)" << endl;
+    cout << "Latency (us): p50 " << percentile(all, 0.5) * 1e6 << ", p90 "
+         << percentile(all, 0.9) * 1e6 << ", p99 "
+         << percentile(all, 0.99) * 1e6 << ", max "
+         << (all.empty() ? 0 : all.back() * 1e6) << endl;
+
+    for (size_t i = 0; i < idle.size(); i++)
+        close(idle[i]);
+    return errors ? 1 : 0;
+}